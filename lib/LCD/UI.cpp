@@ -3,7 +3,10 @@
 #include "image_data.h"
 #include "Debug.hpp"
 
-UI::UI()
+static uint8_t uiArenaBuffer[UI_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static_assert(sizeof(sim_data) + sizeof(logPlotColumn) * 320 + 2 * ARENA_ALIGN <= UI_ARENA_SIZE, "UI_ARENA_SIZE too small");
+
+UI::UI() : arena(uiArenaBuffer, sizeof(uiArenaBuffer))
 {
 }
 
@@ -21,6 +24,20 @@ void UI::begin()
 
 void UI::command()
 {
+    // the trajectory is kept from the POINT page until START is shown again, so RUN and RUN AGAIN can use it.
+    // Everything a page allocates itself is dropped when it returns
+    if (state == START)
+    {
+        arena.reset();
+        data = nullptr;
+    }
+    else if (state == POINT && !data)
+    {
+        data = arena.create<sim_data>();
+    }
+
+    ArenaScope page(arena);
+
     switch (state)
     {
     case START:
@@ -53,15 +70,37 @@ void UI::command()
     case GAIN_SELECT:
         gainSelectPage();
         break;
+#ifdef ENABLE_PROFILER
+    case STATS:
+        statsPage();
+        break;
+#endif
+    case BATCH:
+        batchPage();
+        break;
+    case LOGS:
+        logsPage();
+        break;
+    case END:
+        endPage();
+        break;
     default:
         startPage();
         break;
     }
+
+    LOG_DEBUG("Arena high water %u of %u bytes", (unsigned)arena.getHighWater(), (unsigned)arena.getSize());
 }
 
 bool UI::Touch_getXY()
 {
+    // every page loop polls the touch screen, drain queued telemetry and log frames here too
+    telemetry.service();
+    controller.serviceIdle(); // device probes and base pressure tracking between runs
+
+    AnalogSampler::lockAdc(); // the panel switches its drive pins while it reads, keep the sampler's ticks out of it
     TSPoint p = ts.getPoint();
+    AnalogSampler::unlockAdc();
     pinMode(YP, OUTPUT); // restore shared pins
     pinMode(XM, OUTPUT);
     digitalWrite(YP, HIGH); // because TFT control pins
@@ -103,15 +142,19 @@ bool UI::checkButton(Adafruit_GFX_Button &btn, bool down)
 void UI::startPage()
 {
     bool devicesStatus = controller.initDevices();
-    Adafruit_GFX_Button create_btn, upload_btn, settings_btn;
+    Adafruit_GFX_Button create_btn, upload_btn, settings_btn, batch_btn, logs_btn;
 
     create_btn.initButton(&tft, 160, 150, 200, 100, WHITE, WHITE, BLACK, (char *)"CREATE", 3);
     upload_btn.initButton(&tft, 160, 330, 200, 100, WHITE, WHITE, BLACK, (char *)"UPLOAD", 3);
     settings_btn.initButton(&tft, 300, 20, 40, 40, BLACK, RED, BLACK, (char *)"*", 3);
+    batch_btn.initButton(&tft, 60, 20, 100, 40, BLACK, ORANGE, BLACK, (char *)"BATCH", 2);
+    logs_btn.initButton(&tft, 170, 20, 100, 40, BLACK, WHITE, BLACK, (char *)"LOGS", 2);
 
     create_btn.drawButton(false);
     upload_btn.drawButton(false);
     settings_btn.drawButton(false);
+    batch_btn.drawButton(false);
+    logs_btn.drawButton(false);
 
     bool loop = true;
 
@@ -124,7 +167,7 @@ void UI::startPage()
             showError(false);
             delay(250);
 
-            devicesStatus = controller.initDevices();
+            devicesStatus = controller.devicesReady(); // brought back by serviceIdle(), not re-initialised here
 
             if (devicesStatus)
             {
@@ -141,6 +184,7 @@ void UI::startPage()
         }
         if (checkButton(upload_btn, down))
         {
+            state = UPLOAD;
             loop = false;
         }
         if (checkButton(settings_btn, down))
@@ -148,6 +192,16 @@ void UI::startPage()
             state = SETTINGS;
             loop = false;
         }
+        if (checkButton(batch_btn, down))
+        {
+            state = BATCH;
+            loop = false;
+        }
+        if (checkButton(logs_btn, down))
+        {
+            state = LOGS;
+            loop = false;
+        }
     }
     DBG("EXITING START PAGE");
 
@@ -169,6 +223,11 @@ void UI::settingsPage()
     calibrate_btn.drawButton(false);
     change_filter_btn.drawButton(false);
     gain_select_btn.drawButton(false);
+#ifdef ENABLE_PROFILER
+    Adafruit_GFX_Button stats_btn; // the profiler's page, only there when it is built in
+    stats_btn.initButton(&tft, 270, 20, 100, 40, BLACK, ORANGE, BLACK, (char *)"STATS", 2);
+    stats_btn.drawButton(false);
+#endif
 
     bool loop = true;
 
@@ -200,6 +259,14 @@ void UI::settingsPage()
             state = GAIN_SELECT;
             loop = false;
         }
+
+#ifdef ENABLE_PROFILER
+        if (checkButton(stats_btn, down))
+        {
+            state = STATS;
+            loop = false;
+        }
+#endif
     }
 
     DBG("EXITING SETTINGS PAGE");
@@ -208,7 +275,7 @@ void UI::settingsPage()
     tft.fillScreen(BLACK);
 }
 
-void UI::drawRectWithText(int16_t yPos, int16_t width, uint16_t colour, String text)
+void UI::drawRectWithText(int16_t yPos, int16_t width, uint16_t colour, const char *text)
 {
     width = constrain(width, 0, SCREEN_WIDTH); // Ensure width is within screen boundaries
     int16_t xPos = (SCREEN_WIDTH - width) / 2;
@@ -218,69 +285,52 @@ void UI::drawRectWithText(int16_t yPos, int16_t width, uint16_t colour, String t
     uint8_t vertPadding = 10;
     uint8_t charWidth = 6 * fontSize;  // font 1 = 6x8
     uint8_t charHeight = 8 * fontSize; // font 1 = 6x8
-    uint8_t charsPerLine = (uint8_t)floor((float)(width - (2 * horizPadding)) / (float)(charWidth));
 
-    uint8_t numLines = (uint8_t)ceil((float)text.length() / (float)charsPerLine);
-    uint8_t rectHeight = vertPadding + ((charHeight + vertPadding) * numLines);
+    char line[32]; // 26 characters across the screen at font size 2
+    size_t charsPerLine = (size_t)floor((float)(width - (2 * horizPadding)) / (float)(charWidth));
+    charsPerLine = constrain(charsPerLine, (size_t)1, sizeof(line) - 1);
 
-    String currentLineStr = "";
-    uint8_t currentLineNum = 1;
-    String currentWord = "";
-    uint8_t numWords = 0;
+    uint8_t numLines = (uint8_t)ceil((float)strlen(text) / (float)charsPerLine);
+    uint8_t rectHeight = vertPadding + ((charHeight + vertPadding) * numLines);
 
     tft.fillRect(xPos, yPos, width, rectHeight, colour);
     tft.setTextColor(BLACK);   // Set text color to white
     tft.setTextSize(fontSize); // Set text size (adjust as needed).
 
-    text += " "; // Add a space at the end to ensure the last word is processed
-
-    for (size_t i = 0; i < text.length(); ++i)
+    // each line takes words until the next one doesn't fit, then it's centred and printed
+    const char *next = text;
+    for (uint8_t currentLineNum = 0; *next; currentLineNum++)
     {
-        if (text[i] == ' ')
+        size_t lineLength = 0;
+        while (*next)
         {
-            numWords++;
-            bool exceedLineWidth = (((currentLineStr.length() + currentWord.length()) + 1) > charsPerLine);
-            bool endOfText = ((i + 1) == text.length());
-
-            if (endOfText || exceedLineWidth)
+            size_t wordLength = strcspn(next, " ");
+            if (lineLength && (lineLength + 1 + wordLength) > charsPerLine)
             {
-                if (endOfText)
-                {
-                    if (numWords > 1)
-                    {
-                        currentLineStr += " ";
-                    }
-
-                    currentLineStr += currentWord;
-                }
-
-                uint16_t textWidth = currentLineStr.length() * charWidth;
-                uint16_t fontXPos = (width - textWidth) / 2;
-                tft.setCursor(xPos + fontXPos, (yPos + ((currentLineNum - 1) * (charHeight + vertPadding)) + vertPadding)); // Position the text (adjust x and y coordinates as needed)
-                tft.print(currentLineStr);                                                                                  // Display the text
-
-                currentLineStr = currentWord;
-                currentWord = "";
-                currentLineNum++;
+                break;
             }
-            else
+
+            if (lineLength)
             {
-                if (numWords > 1)
-                {
-                    currentLineStr += " ";
-                }
-                currentLineStr += currentWord;
-                currentWord = "";
+                line[lineLength++] = ' ';
             }
+
+            size_t copied = min(wordLength, charsPerLine - lineLength); // a word longer than a line is cut
+            memcpy(line + lineLength, next, copied);
+            lineLength += copied;
+
+            next += wordLength;
+            next += strspn(next, " ");
         }
-        else
-        {
-            currentWord += text[i];
-        }
+        line[lineLength] = '\0';
+
+        uint16_t fontXPos = (width - (lineLength * charWidth)) / 2;
+        tft.setCursor(xPos + fontXPos, yPos + (currentLineNum * (charHeight + vertPadding)) + vertPadding); // Position the text
+        tft.print(line);
     }
 }
 
-void UI::progressBar(String text, float progress, int16_t yPos, uint16_t colour)
+void UI::progressBar(const char *text, float progress, int16_t yPos, uint16_t colour)
 {
     float progressWidth = SCREEN_WIDTH * progress;
 
@@ -468,10 +518,20 @@ void UI::createPage()
 
 void UI::uploadPage()
 {
-    Adafruit_GFX_Button back_btn;
+    Adafruit_GFX_Button back_btn, load_btn;
 
     back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    load_btn.initButton(&tft, 160, 430, 300, 50, BLACK, ORANGE, BLACK, (char *)"LOAD", 2);
     back_btn.drawButton(false);
+    load_btn.drawButton(true);
+
+    // every trajectory file, the listing is only read from the card when the folder changed
+
+    const char *folder = "/TRAJ";
+    dirIndex.select(folder, ".CSV");
+
+    listObj trajList = {50, 7, 0, -1};
+    drawList(trajList);
 
     bool loop = true;
 
@@ -485,6 +545,35 @@ void UI::uploadPage()
 
             loop = false;
         }
+
+        if (handleListTouch(trajList, down))
+        {
+            load_btn.drawButton(false);
+        }
+
+        if (checkButton(load_btn, down) && trajList.selected != -1)
+        {
+            // scans the file once for its length and apogee, the points are streamed during the run
+            char path[PATH_MAX_LENGTH + 1];
+            snprintf(path, sizeof(path), "%s/%s", folder, dirIndex.getName(trajList.selected));
+
+            if (controller.loadTrajectory(path))
+            {
+                streamSelected = true;
+                state = RUN;
+                loop = false;
+            }
+            else
+            {
+                showError(true, "Failed to load trajectory");
+                delay(500);
+                showError(false);
+
+                trajList.selected = -1;
+                drawList(trajList);
+                load_btn.drawButton(true);
+            }
+        }
     }
 
     DBG("EXITING UPLOAD PAGE");
@@ -497,12 +586,14 @@ void UI::uploadPage()
 
 void UI::pointPage()
 {
-    Adafruit_GFX_Button back_btn, save_btn;
+    Adafruit_GFX_Button back_btn, save_btn, model_btn;
 
     back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
     save_btn.initButton(&tft, 160, 430, 300, 50, BLACK, ORANGE, BLACK, (char *)"SAVE", 2);
+    model_btn.initButton(&tft, 270, 20, 100, 40, BLACK, WHITE, BLACK, (char *)(pointModel == SIM_MODEL_DRAG ? "DRAG" : "BASIC"), 2);
     back_btn.drawButton(false);
     save_btn.drawButton(false);
+    model_btn.drawButton(false);
 
     // Draw initial graph and sliders
     drawGraph(sliderApogee.sliderValue, sliderBurnTime.sliderValue);
@@ -527,10 +618,29 @@ void UI::pointPage()
         {
             // tft.fillRect(40, 80, 160, 80, GREEN);
 
+            // the simulation only placed the points interpolation needs, those are what gets cached and run
+            LOG_DEBUG("Profile points: %d, max error %f Pa", data->num_points, data->max_error);
+
+            // keep the profile so selecting it again loads the exact same points
+            if (!simCache.store(dataKey, *data))
+            {
+                DBG("Failed to cache trajectory");
+            }
+
+            streamSelected = false;
             state = RUN;
             loop = false;
         }
 
+        // switch between the simple and the drag model
+        if (checkButton(model_btn, down))
+        {
+            pointModel = (pointModel == SIM_MODEL_DRAG) ? SIM_MODEL_KINEMATIC : SIM_MODEL_DRAG;
+            model_btn.initButton(&tft, 270, 20, 100, 40, BLACK, WHITE, BLACK, (char *)(pointModel == SIM_MODEL_DRAG ? "DRAG" : "BASIC"), 2);
+            model_btn.drawButton(false);
+            drawGraph(sliderApogee.sliderValue, sliderBurnTime.sliderValue);
+        }
+
         bool slider1Touched = handleSliderTouch(sliderApogee, down);
         bool slider2Touched = handleSliderTouch(sliderBurnTime, down);
 
@@ -550,25 +660,35 @@ void UI::drawGraph(float apogee, float burnout_time)
     // Clear the previous graph area
     tft.fillRect(0, GRAPH_TOP, SCREEN_WIDTH, GRAPH_HEIGHT, BLACK);
 
-    // Run simulation
-    ROCKET_SIM sim(burnout_time, apogee, -10.0f);
-    data = sim.runSimulation();
+    // Load the trajectory from the cache, or simulate it with the same rounded parameters the cache is keyed on
+    dataKey = SimCache::makeKey(apogee, burnout_time, -10.0f, pointModel);
+
+    if (!simCache.load(dataKey, *data))
+    {
+        // simulated straight into data, velocity isn't needed
+        ROCKET_SIM sim(dataKey.burnout_time, dataKey.apogee, dataKey.terminal_velocity, pointModel);
+        if (!sim.runSimulation(*data, SIM_TIME | SIM_ALTITUDE))
+        {
+            updateTextBox("Invalid profile");
+            return;
+        }
+    }
 
     // Define scaling factors to fit the data within the screen
-    float total_time = data.time[data.num_points - 1];
+    float total_time = data->time[data->num_points - 1];
     float x_scale = float(SCREEN_WIDTH - 1) / total_time; // Scale x-axis based on total time
     float y_scale = float(GRAPH_HEIGHT - 1) / apogee;     // Scale y-axis based on max altitude
 
     // Initialize previous coordinates for line drawing
     int prev_x = 0;
-    int prev_y = GRAPH_TOP + GRAPH_HEIGHT - 1 - int(data.altitude[0] * y_scale);
+    int prev_y = GRAPH_TOP + GRAPH_HEIGHT - 1 - int(data->altitude[0] * y_scale);
 
     // Loop through data points to plot the graph
-    for (int i = 1; i < data.num_points; i++)
+    for (int i = 1; i < data->num_points; i++)
     {
         // Calculate screen coordinates
-        int x = int(data.time[i] * x_scale);
-        int y = GRAPH_TOP + GRAPH_HEIGHT - 1 - int(data.altitude[i] * y_scale);
+        int x = int(data->time[i] * x_scale);
+        int y = GRAPH_TOP + GRAPH_HEIGHT - 1 - int(data->altitude[i] * y_scale);
 
         // Constrain x and y to screen boundaries
         x = constrain(x, 0, SCREEN_WIDTH - 1);
@@ -583,7 +703,9 @@ void UI::drawGraph(float apogee, float burnout_time)
     }
 
     // Display apogee information
-    updateTextBox("Apogee=" + String(int(data.apogee)) + "m @T=" + String(data.time_at_apogee) + "s");
+    char apogeeText[32];
+    snprintf(apogeeText, sizeof(apogeeText), "Apogee=%dm @T=%.2fs", int(data->apogee), data->time_at_apogee);
+    updateTextBox(apogeeText);
 
     delay(50);
 }
@@ -593,7 +715,7 @@ float UI::mapFloat(float x, float in_min, float in_max, float out_min, float out
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-void UI::updateTextBox(String text)
+void UI::updateTextBox(const char *text)
 {
     // Clear the text area where you want to update the apogee value
     tft.fillRect(20, 170, 280, 22, WHITE); // Adjust width/height as needed to clear text area
@@ -633,6 +755,83 @@ bool UI::handleSliderTouch(sliderObj &slider, bool down)
     return false;
 }
 
+void UI::drawList(listObj &list)
+{
+    uint16_t count = dirIndex.getCount();
+    list.first = (count > list.rows) ? min(list.first, (uint16_t)(count - list.rows)) : 0;
+
+    tft.setTextSize(2);
+
+    for (uint8_t row = 0; row < list.rows; row++)
+    {
+        uint16_t i = list.first + row;
+        int16_t y = list.yPos + row * LIST_ROW_HEIGHT;
+
+        tft.fillRect(0, y, LIST_WIDTH, LIST_ROW_HEIGHT, BLACK);
+
+        if (i < count)
+        {
+            bool selected = (i == list.selected);
+            tft.fillRoundRect(0, y, LIST_WIDTH, LIST_ROW_HEIGHT - 10, 8, selected ? BLACK : WHITE);
+            tft.drawRoundRect(0, y, LIST_WIDTH, LIST_ROW_HEIGHT - 10, 8, WHITE);
+            tft.setTextColor(selected ? WHITE : BLACK);
+            tft.setCursor(10, y + 12);
+            tft.print(dirIndex.getName(i));
+        }
+    }
+
+    // scroll bar, the thumb covers the rows shown
+    int16_t barHeight = list.rows * LIST_ROW_HEIGHT - 10;
+    tft.fillRect(LIST_WIDTH + 10, list.yPos, SCREEN_WIDTH - LIST_WIDTH - 10, barHeight, PURPLE_1);
+
+    if (count > list.rows)
+    {
+        int16_t thumbTop = list.yPos + (int32_t)barHeight * list.first / count;
+        int16_t thumbHeight = max((int32_t)barHeight * list.rows / count, (int32_t)10);
+        tft.fillRect(LIST_WIDTH + 10, thumbTop, SCREEN_WIDTH - LIST_WIDTH - 10, thumbHeight, ORANGE);
+    }
+}
+
+// Returns true when a different file was selected
+bool UI::handleListTouch(listObj &list, bool down)
+{
+    if (!down || pixel_y < list.yPos || pixel_y >= list.yPos + list.rows * LIST_ROW_HEIGHT)
+    {
+        return false;
+    }
+
+    uint16_t count = dirIndex.getCount();
+
+    if (pixel_x > LIST_WIDTH)
+    {
+        // the thumb follows the finger along the bar
+        if (count > list.rows)
+        {
+            int32_t centre = mapFloat(pixel_y, list.yPos, list.yPos + list.rows * LIST_ROW_HEIGHT, 0, count);
+            uint16_t first = constrain(centre - list.rows / 2, (int32_t)0, (int32_t)(count - list.rows));
+
+            if (first != list.first)
+            {
+                list.first = first;
+                drawList(list);
+            }
+        }
+        delay(50);
+        return false;
+    }
+
+    uint16_t i = list.first + (pixel_y - list.yPos) / LIST_ROW_HEIGHT;
+    if (i >= count || i == list.selected)
+    {
+        return false;
+    }
+
+    list.selected = i;
+    drawList(list);
+    delay(touch_delay);
+    return true;
+}
+
 // ************************ RUN ************************
 
 void UI::runPage()
@@ -641,17 +840,19 @@ void UI::runPage()
 
     tft.fillRect(0, GRAPH_TOP, SCREEN_WIDTH, GRAPH_HEIGHT, BLACK);
 
-    Adafruit_GFX_Button back_btn, start_btn, stop_btn;
+    Adafruit_GFX_Button back_btn, start_btn, stop_btn, mode_btn;
     back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    mode_btn.initButton(&tft, 270, 20, 100, 40, BLACK, WHITE, BLACK, (char *)(controller.getControlMode() == CONTROL_MPC ? "MPC" : "PID"), 2);
     start_btn.initButton(&tft, 160, 380, 280, 50, BLACK, ORANGE, BLACK, (char *)"START", 2);
     stop_btn.initButton(&tft, 160, 430, 280, 50, BLACK, RED, BLACK, (char *)"STOP", 2);
 
     back_btn.drawButton(false);
+    mode_btn.drawButton(false);
     start_btn.drawButton(false);
 
     stop_btn.drawButton(true);
 
-    bool loop = (data.num_points > 0);
+    bool loop = streamSelected || (data && data->num_points > 0);
 
     while (loop)
     {
@@ -674,15 +875,18 @@ void UI::runPage()
 
             int prev_x = 0;
 
-            float maxVal = data.apogee * 1.1; // 10% more than max incase we overshoot
+            float apogee = streamSelected ? controller.getTrajectoryApogee() : data->apogee;
+            float finishTime = streamSelected ? controller.getTrajectoryDuration() : data->time[data->num_points - 1];
+
+            float maxVal = apogee * 1.1; // 10% more than max incase we overshoot
 
             float y_scale = float(GRAPH_HEIGHT - 1) / maxVal; // Scale y-axis based on max
-            float x_scale = float(SCREEN_WIDTH - 1) / data.time[data.num_points - 1];
+            float x_scale = float(SCREEN_WIDTH - 1) / finishTime;
             int prev_real_y = GRAPH_TOP + GRAPH_HEIGHT - 1;
             int prev_target_y = GRAPH_TOP + GRAPH_HEIGHT - 1;
 
             controller.setAlpha(sliderFilter.sliderValue);
-            bool initialisedController = controller.initData(data); // will have a delay for calibrating the sensor
+            bool initialisedController = streamSelected ? controller.initStream() : controller.initData(*data); // will have a delay for calibrating the sensor
 
             if (initialisedController)
             {
@@ -722,8 +926,11 @@ void UI::runPage()
                         target_y = constrain(target_y, GRAPH_TOP, GRAPH_TOP + GRAPH_HEIGHT - 1);
 
                         // update graph with live data
-                        tft.drawLine(prev_x, prev_real_y, x, real_y, WHITE);   // draw line for real_y
-                        tft.drawLine(prev_x, prev_target_y, x, target_y, RED); // draw line for target_y
+                        {
+                            PROFILE_SCOPE(PROBE_DRAW_LINE);
+                            tft.drawLine(prev_x, prev_real_y, x, real_y, WHITE);   // draw line for real_y
+                            tft.drawLine(prev_x, prev_target_y, x, target_y, RED); // draw line for target_y
+                        }
 
                         prev_x = x;
                         prev_real_y = real_y;
@@ -731,15 +938,21 @@ void UI::runPage()
                     }
                     else
                     {
+                        // trajectory finished or the controller stopped it, show how it went
+                        state = END;
+                        loop = false;
                         run = false;
                     }
 
+                    // top up the trajectory buffer while the card isn't needed by the control tick
+                    controller.serviceStream();
+
                     // Check if the stop button is pressed
                     bool down = Touch_getXY();
 
-                    if (checkButton(stop_btn, down))
+                    if (run && checkButton(stop_btn, down))
                     {
-                        state = START;
+                        state = END;
                         loop = false;
                         run = false;
 
@@ -760,6 +973,13 @@ void UI::runPage()
             }
         }
 
+        if (checkButton(mode_btn, down))
+        {
+            controller.setControlMode(controller.getControlMode() == CONTROL_MPC ? CONTROL_PID : CONTROL_MPC);
+            mode_btn.initButton(&tft, 270, 20, 100, 40, BLACK, WHITE, BLACK, (char *)(controller.getControlMode() == CONTROL_MPC ? "MPC" : "PID"), 2);
+            mode_btn.drawButton(false);
+        }
+
         if (checkButton(back_btn, down))
         {
             state = START;
@@ -788,8 +1008,11 @@ void UI::filteringPage()
 
     sliderFilter.sliderValue = controller.getAlpha();
 
+    char alpha[8];
+    snprintf(alpha, sizeof(alpha), "%.2f", sliderFilter.sliderValue);
+
     drawSlider(sliderFilter);
-    drawRectWithText(360, 100, ORANGE, String(sliderFilter.sliderValue));
+    drawRectWithText(360, 100, ORANGE, alpha);
 
     bool loop = true;
 
@@ -799,7 +1022,8 @@ void UI::filteringPage()
 
         if (handleSliderTouch(sliderFilter, down))
         {
-            drawRectWithText(360, 100, ORANGE, String(sliderFilter.sliderValue));
+            snprintf(alpha, sizeof(alpha), "%.2f", sliderFilter.sliderValue);
+            drawRectWithText(360, 100, ORANGE, alpha);
         }
 
         if (checkButton(back_btn, down))
@@ -818,7 +1042,6 @@ void UI::filteringPage()
         {
             float altitude = ROCKET_SIM::pressureToAltitude(controller.getLatestPressure());
             float ratio = mapFloat(altitude, -1000, 1000, 0, 1);
-            String altitudeStr = "altitude: " + String(altitude, 1) + "(m)";
 
             progressBar("altitude (m)", ratio, (SCREEN_HEIGHT - 40), ORANGE);
         }
@@ -868,24 +1091,13 @@ void UI::gainSelectPage()
 
     set_btn.drawButton(true);
 
-    // get all files in gain folder and list them as buttons
-
-    String folder = "/CONTROL";
-    const int maxNumFiles = 5; // Maximum number of files you expect
-    String files[maxNumFiles]; // Array to hold filenames
-    int fileCount = 0;         // Actual number of files found
-
-    controller.getFilesInFolder(folder, files, maxNumFiles, fileCount, ".CSV");
+    // every gain file, the listing is only read from the card when the folder changed
 
-    Adafruit_GFX_Button gain_btns[fileCount];
+    const char *folder = "/CONTROL";
+    dirIndex.select(folder, ".CSV");
 
-    for (int i = 0; i < fileCount; i++)
-    {
-        gain_btns[i].initButton(&tft, 160, 70 + (i * 50), SCREEN_WIDTH, 40, WHITE, WHITE, BLACK, (char *)files[i].c_str(), 2);
-        gain_btns[i].drawButton(false);
-    }
-
-    int selectedFileIter = -1;
+    listObj gainList = {50, 5, 0, -1};
+    drawList(gainList);
 
     bool loop = true;
 
@@ -900,22 +1112,19 @@ void UI::gainSelectPage()
             loop = false;
         }
 
-        for (int i = 0; i < fileCount; i++)
+        if (handleListTouch(gainList, down))
         {
-            if (checkButton(gain_btns[i], down))
-            {
-                gain_btns[i].drawButton(true);
-                set_btn.drawButton(false);
-                selectedFileIter = i;
-                break;
-            }
+            set_btn.drawButton(false);
         }
 
         if (checkButton(set_btn, down))
         {
-            if (selectedFileIter != -1)
+            if (gainList.selected != -1)
             {
-                bool gainsLoaded = controller.initGainSchedule((String)(folder + "/" + files[selectedFileIter]));
+                char path[PATH_MAX_LENGTH + 1];
+                snprintf(path, sizeof(path), "%s/%s", folder, dirIndex.getName(gainList.selected));
+
+                bool gainsLoaded = controller.initGainSchedule(path);
                 if (!gainsLoaded)
                 {
                     showError(true, "Failed to load gains");
@@ -923,9 +1132,9 @@ void UI::gainSelectPage()
                     showError(false);
                 }
 
-                gain_btns[selectedFileIter].drawButton(false);
+                gainList.selected = -1;
+                drawList(gainList);
                 set_btn.drawButton(true);
-                selectedFileIter = -1;
             }
         }
     }
@@ -936,16 +1145,94 @@ void UI::gainSelectPage()
     tft.fillScreen(BLACK);
 }
 
+// ************************ STATS ************************
+
+#ifdef ENABLE_PROFILER
+void UI::statsPage()
+{
+    Adafruit_GFX_Button back_btn, reset_btn, save_btn;
+    back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    reset_btn.initButton(&tft, 85, 430, 140, 50, BLACK, ORANGE, BLACK, (char *)"RESET", 2);
+    save_btn.initButton(&tft, 235, 430, 140, 50, BLACK, ORANGE, BLACK, (char *)"SAVE", 2);
+
+    back_btn.drawButton(false);
+    reset_btn.drawButton(false);
+    save_btn.drawButton(false);
+
+    unsigned long lastDraw = 0;
+    const unsigned long drawInterval = 500; // ms
+
+    bool loop = true;
+
+    while (loop)
+    {
+        bool down = Touch_getXY();
+
+        if (checkButton(back_btn, down))
+        {
+            state = SETTINGS;
+            loop = false;
+        }
+
+        if (checkButton(reset_btn, down))
+        {
+            profiler.reset();
+            lastDraw = 0;
+        }
+
+        if (checkButton(save_btn, down))
+        {
+            if (!controller.saveProfile())
+            {
+                showError(true, "Failed to save stats");
+                delay(500);
+                showError(false);
+            }
+        }
+
+        if (lastDraw == 0 || millis() - lastDraw >= drawInterval)
+        {
+            lastDraw = millis();
+
+            // two lines per probe: name and sample count, then avg/p99/max in microseconds
+            tft.setTextSize(2);
+            tft.setTextColor(WHITE, BLACK);
+
+            for (uint8_t i = 0; i < PROBE_COUNT; i++)
+            {
+                profileStats stats = profiler.getStats(i);
+                int16_t yPos = 60 + i * 56;
+
+                char line[32];
+                tft.fillRect(0, yPos, SCREEN_WIDTH, 40, BLACK);
+
+                snprintf(line, sizeof(line), "%s n=%lu", Profiler::getName(i), (unsigned long)stats.count);
+                tft.setCursor(10, yPos);
+                tft.print(line);
+
+                snprintf(line, sizeof(line), "%lu/%lu/%lu us", (unsigned long)(stats.avgNs / 1000), (unsigned long)(stats.p99Ns / 1000), (unsigned long)(stats.maxNs / 1000));
+                tft.setCursor(10, yPos + 20);
+                tft.print(line);
+            }
+        }
+    }
+
+    DBG("EXITING STATS PAGE");
+
+    // clear page before going to the next
+    tft.fillScreen(BLACK);
+}
+#endif // ENABLE_PROFILER
+
 // ************************************************** PAGES **************************************************
 
-void UI::showError(bool show, String msg)
+void UI::showError(bool show, const char *msg)
 {
     if (show)
     {
         if (!errorShowing)
         {
-            String errorMsg = "ERROR"; //  + msg; // having some issue with removing so just show error
-            drawRectWithText(0, 100, RED, errorMsg);
+            drawRectWithText(0, 100, RED, "ERROR"); // msg doesn't fit the box, just show error
             errorShowing = true;
         }
     }
@@ -954,4 +1241,357 @@ void UI::showError(bool show, String msg)
         drawRectWithText(0, 100, BLACK, "ERROR"); // black on black to hide for now :/
         errorShowing = false;
     }
-}
\ No newline at end of file
+}
+
+// ************************ END ************************
+
+void UI::endPage()
+{
+    Adafruit_GFX_Button back_btn, again_btn;
+    back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    again_btn.initButton(&tft, 160, 430, 280, 50, BLACK, ORANGE, BLACK, (char *)"RUN AGAIN", 2);
+
+    back_btn.drawButton(false);
+    again_btn.drawButton(false);
+
+    // accumulated by the controller during the run, also appended to RUN_SUMMARY_PATH
+    runSummary summary = controller.getRunSummary();
+
+    char lines[10][40];
+    snprintf(lines[0], sizeof(lines[0]), "%s %.1f s", controller.runCompleted() ? "Completed" : "Stopped", summary.duration);
+    snprintf(lines[1], sizeof(lines[1]), "RMS error %.0f Pa", summary.rmsError);
+    snprintf(lines[2], sizeof(lines[2]), "Max error %.0f Pa", summary.maxError);
+    snprintf(lines[3], sizeof(lines[3]), "Apogee error %.1f m", summary.apogeeError);
+    snprintf(lines[4], sizeof(lines[4]), "Lag %.0f ms", summary.lag * 1000);
+    snprintf(lines[5], sizeof(lines[5]), "Pump flat out %.1f s", summary.saturatedTime);
+    snprintf(lines[6], sizeof(lines[6]), "Loop p50 %lu us", (unsigned long)summary.loopP50Us);
+    snprintf(lines[7], sizeof(lines[7]), "p95/p99 %lu/%lu us", (unsigned long)summary.loopP95Us, (unsigned long)summary.loopP99Us);
+    snprintf(lines[8], sizeof(lines[8]), "Loop max %lu us", (unsigned long)summary.loopMaxUs);
+    snprintf(lines[9], sizeof(lines[9]), "Heap ops %lu", (unsigned long)summary.heapOperations);
+
+    tft.setTextSize(2);
+    tft.setTextColor(WHITE, BLACK);
+
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        tft.setCursor(10, 70 + i * 32);
+        tft.print(lines[i]);
+    }
+
+    bool loop = true;
+
+    while (loop)
+    {
+        bool down = Touch_getXY();
+
+        if (checkButton(back_btn, down))
+        {
+            state = START;
+            loop = false;
+        }
+
+        if (checkButton(again_btn, down))
+        {
+            state = RUN;
+            loop = false;
+        }
+    }
+
+    DBG("EXITING END PAGE");
+
+    // clear page before going to the next
+    tft.fillScreen(BLACK);
+}
+
+// ************************ BATCH ************************
+
+void UI::batchPage()
+{
+    Adafruit_GFX_Button back_btn, start_btn, stop_btn;
+    back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    start_btn.initButton(&tft, 160, 380, 280, 50, BLACK, ORANGE, BLACK, (char *)"START", 2);
+    stop_btn.initButton(&tft, 160, 430, 280, 50, BLACK, RED, BLACK, (char *)"STOP", 2);
+
+    back_btn.drawButton(false);
+    start_btn.drawButton(false);
+    stop_btn.drawButton(true);
+
+    if (!batch.load())
+    {
+        drawRectWithText(200, SCREEN_WIDTH, PURPLE_4, "No runs in " BATCH_MANIFEST);
+    }
+
+    unsigned long lastDraw = 0;
+    const unsigned long drawInterval = 500; // ms
+
+    bool loop = true;
+
+    while (loop)
+    {
+        // a control tick while running, the settle checks between runs
+        bool active = batch.service();
+
+        bool down = Touch_getXY();
+
+        if (!active && checkButton(back_btn, down))
+        {
+            state = START;
+            loop = false;
+        }
+
+        if (!active && checkButton(start_btn, down))
+        {
+            if (!batch.start())
+            {
+                showError(true, "Batch cannot start");
+                delay(500);
+                showError(false);
+            }
+            lastDraw = 0;
+        }
+
+        if (active && checkButton(stop_btn, down))
+        {
+            batch.abort();
+            lastDraw = 0;
+        }
+
+        if (lastDraw == 0 || millis() - lastDraw >= drawInterval)
+        {
+            lastDraw = millis();
+
+            // one line per run: number, result, rms error
+            tft.setTextSize(2);
+            tft.setTextColor(WHITE, BLACK);
+
+            for (uint8_t i = 0; i < batch.getNumRuns() && i < 12; i++)
+            {
+                const batchRun &run = batch.getRun(i);
+                bool current = (i == batch.getCurrentRun()) && (batch.getState() == BATCH_SETTLING || batch.getState() == BATCH_RUNNING);
+
+                char line[32];
+                if (current)
+                {
+                    snprintf(line, sizeof(line), "%2d %-8s", i + 1, batch.getState() == BATCH_RUNNING ? "running" : "settling");
+                }
+                else
+                {
+                    snprintf(line, sizeof(line), "%2d %-8s %6.0f Pa", i + 1, BatchRunner::resultName(run.result), run.summary.rmsError);
+                }
+
+                tft.fillRect(0, 60 + i * 24, SCREEN_WIDTH, 20, BLACK);
+                tft.setCursor(10, 60 + i * 24);
+                tft.print(line);
+            }
+        }
+    }
+
+    DBG("EXITING BATCH PAGE");
+
+    // clear page before going to the next
+    tft.fillScreen(BLACK);
+}
+
+// ************************ LOGS ************************
+
+void UI::logsPage()
+{
+    Adafruit_GFX_Button back_btn;
+    back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+
+    // one tab per folder of logs
+    const char *folders[] = {"/RUNS", "/BATCH", "/CALIB"};
+    const uint8_t numFolders = sizeof(folders) / sizeof(folders[0]);
+    Adafruit_GFX_Button folder_btns[numFolders];
+
+    for (uint8_t i = 0; i < numFolders; i++)
+    {
+        folder_btns[i].initButton(&tft, 100 + i * 80, 20, 75, 40, BLACK, WHITE, BLACK, (char *)(folders[i] + 1), 2);
+    }
+
+    uint8_t folder = 0;
+    listObj logList = {60, 8, 0, -1};
+    bool redraw = true;
+
+    bool loop = true;
+
+    while (loop)
+    {
+        if (redraw)
+        {
+            redraw = false;
+
+            back_btn.drawButton(false);
+            for (uint8_t i = 0; i < numFolders; i++)
+            {
+                folder_btns[i].drawButton(i == folder);
+            }
+
+            // contains() looks through the whole listing, so finding a log's index doesn't touch the card
+            dirIndex.select(folders[folder], ".CSV");
+            drawList(logList);
+        }
+
+        bool down = Touch_getXY();
+
+        if (checkButton(back_btn, down))
+        {
+            state = START;
+            loop = false;
+        }
+
+        for (uint8_t i = 0; i < numFolders; i++)
+        {
+            if (i != folder && checkButton(folder_btns[i], down))
+            {
+                folder = i;
+                logList = {60, 8, 0, -1};
+                redraw = true;
+            }
+        }
+
+        if (handleListTouch(logList, down))
+        {
+            const char *name = dirIndex.getName(logList.selected);
+
+            if (dirIndex.contains(LogIndex::indexPath(name).c_str()))
+            {
+                tft.fillScreen(BLACK);
+                char path[PATH_MAX_LENGTH + 1];
+                snprintf(path, sizeof(path), "%s/%s", folders[folder], name);
+                plotLog(path);
+                tft.fillScreen(BLACK);
+            }
+            else
+            {
+                showError(true, "Log has no index");
+                delay(500);
+                showError(false);
+            }
+
+            logList.selected = -1;
+            redraw = true;
+        }
+    }
+
+    DBG("EXITING LOGS PAGE");
+
+    // clear page before going to the next
+    tft.fillScreen(BLACK);
+}
+
+void UI::plotLog(const char *path)
+{
+    Adafruit_GFX_Button back_btn;
+    back_btn.initButton(&tft, 20, 20, 40, 40, BLACK, RED, BLACK, (char *)"<", 3);
+    back_btn.drawButton(false);
+
+    LogIndex index;
+    if (!index.open(path) || index.getBlocks() == 0)
+    {
+        showError(true, "Failed to open log");
+        delay(500);
+        showError(false);
+        return;
+    }
+
+    const int plotTop = 60;
+    const int plotHeight = 380;
+
+    // one entry per screen column, from the arena rather than 5 KB of stack, released again by the scope
+    ArenaScope plot(arena);
+    logPlotColumn *columns = arena.createArray<logPlotColumn>(SCREEN_WIDTH);
+    if (!columns)
+    {
+        showError(true, "Out of memory");
+        delay(500);
+        showError(false);
+        return;
+    }
+
+    float fullStart = index.getStartTime();
+    float fullEnd = index.getEndTime();
+    float maxAltitude = max(ROCKET_SIM::pressureToAltitude(index.getMinPressure()), 1.0f);
+
+    float startTime = fullStart;
+    float endTime = fullEnd;
+    bool redraw = true;
+
+    bool loop = true;
+
+    while (loop)
+    {
+        if (redraw)
+        {
+            redraw = false;
+
+            // the whole run only reads the index, a zoom only the log blocks it shows
+            if (!index.plot(startTime, endTime, columns, SCREEN_WIDTH))
+            {
+                showError(true, "Failed to read log");
+                delay(500);
+                showError(false);
+                break;
+            }
+
+            tft.fillRect(0, plotTop, SCREEN_WIDTH, plotHeight, BLACK);
+
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+            {
+                const logPlotColumn &column = columns[x];
+
+                if (column.minSetpoint <= column.maxSetpoint)
+                {
+                    int top = mapFloat(ROCKET_SIM::pressureToAltitude(column.minSetpoint), 0, maxAltitude, plotTop + plotHeight, plotTop);
+                    int bottom = mapFloat(ROCKET_SIM::pressureToAltitude(column.maxSetpoint), 0, maxAltitude, plotTop + plotHeight, plotTop);
+                    tft.drawFastVLine(x, constrain(top, plotTop, plotTop + plotHeight), max(bottom - top, 1), RED);
+                }
+
+                if (column.minPressure <= column.maxPressure)
+                {
+                    int top = mapFloat(ROCKET_SIM::pressureToAltitude(column.minPressure), 0, maxAltitude, plotTop + plotHeight, plotTop);
+                    int bottom = mapFloat(ROCKET_SIM::pressureToAltitude(column.maxPressure), 0, maxAltitude, plotTop + plotHeight, plotTop);
+                    tft.drawFastVLine(x, constrain(top, plotTop, plotTop + plotHeight), max(bottom - top, 1), WHITE);
+                }
+            }
+
+            char label[40];
+            snprintf(label, sizeof(label), "%.1f-%.1f s %lu lines", startTime, endTime, (unsigned long)index.getLinesRead());
+            tft.fillRect(50, 10, SCREEN_WIDTH - 50, 20, BLACK);
+            tft.setTextSize(1);
+            tft.setTextColor(WHITE, BLACK);
+            tft.setCursor(60, 15);
+            tft.print(label);
+        }
+
+        bool down = Touch_getXY();
+
+        if (checkButton(back_btn, down))
+        {
+            if (startTime > fullStart || endTime < fullEnd)
+            {
+                // zoomed, back to the whole run first
+                startTime = fullStart;
+                endTime = fullEnd;
+                redraw = true;
+            }
+            else
+            {
+                loop = false;
+            }
+        }
+        else if (down && pixel_y > plotTop && pixel_y < plotTop + plotHeight)
+        {
+            // 4x around the tapped time
+            float span = (endTime - startTime) / 4;
+            float centre = mapFloat(pixel_x, 0, SCREEN_WIDTH, startTime, endTime);
+
+            startTime = constrain(centre - span / 2, fullStart, fullEnd - span);
+            endTime = startTime + span;
+            redraw = true;
+            delay(touch_delay);
+        }
+    }
+
+    index.close();
+}
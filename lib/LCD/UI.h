@@ -2,17 +2,33 @@
 #include <MCUFRIEND_kbv.h>
 #include <TouchScreen.h>
 #include "ROCKET_SIM.h"
+#include "SimCache.h"
 #include "Controller.h"
+#include "BatchRunner.h"
+#include "DirIndex.h"
+#include "Arena.hpp"
+
+// a sim_data for the session from the POINT page on, plus the largest page's own buffers
+#define UI_ARENA_SIZE (16 * 1024)
 
 struct sliderObj
 {
     uint16_t yPos;
-    String text;
+    const char *text;
     float sliderValue;
     float minSliderValue;
     float maxSliderValue;
 };
 
+// rows of the files dirIndex has selected, see drawList()
+struct listObj
+{
+    uint16_t yPos;
+    uint8_t rows;     // shown at once, the bar on the right scrolls through the rest
+    uint16_t first;   // file in the top row
+    int16_t selected; // -1 for none
+};
+
 class UI
 {
 public:
@@ -33,16 +49,24 @@ public:
     void filteringPage();
     void sensorPlotterPage();
     void gainSelectPage();
+#ifdef ENABLE_PROFILER
+    void statsPage();
+#endif
+    void batchPage();
+    void logsPage();
 
     // Creating objects
-    void showError(bool show, String msg = "");
-    void drawRectWithText(int16_t yPos, int16_t width, uint16_t colour, String text);
-    void progressBar(String text, float progress, int16_t yPos, uint16_t colour);
+    void showError(bool show, const char *msg = "");
+    void drawRectWithText(int16_t yPos, int16_t width, uint16_t colour, const char *text);
+    void progressBar(const char *text, float progress, int16_t yPos, uint16_t colour);
     void drawSlider(sliderObj &slider);
+    void drawList(listObj &list);
     void drawGraph(float apogee, float finishTime);
+    void plotLog(const char *path);
 
     // Event handling
     bool handleSliderTouch(sliderObj &slider, bool down);
+    bool handleListTouch(listObj &list, bool down);
     bool checkButton(Adafruit_GFX_Button &btn, bool down);
     bool Touch_getXY();
     void command();
@@ -50,10 +74,17 @@ public:
 private:
     float mapFloat(float x, float in_min, float in_max, float out_min, float out_max);
     float compute_a_b(double g, double t_b, double S_a);
-    void updateTextBox(String text);
+    void updateTextBox(const char *text);
 
-    sim_data data;
+    Arena arena;              // see command() for what lives how long
+    sim_data *data = nullptr; // in the arena, nullptr outside a POINT .. RUN session
+    simKey dataKey;           // parameters data was generated from
+    SimCache simCache;
     Controller controller;
+    BatchRunner batch = BatchRunner(controller); // runs queued from the card, see batchPage()
+
+    bool streamSelected = false; // run the trajectory picked on the upload page instead of data
+    simModel pointModel = SIM_MODEL_KINEMATIC; // physics used on the POINT page
 
     bool errorShowing = false;
 
@@ -95,6 +126,8 @@ private:
     const int SLIDER_Y = (SCREEN_HEIGHT / 2 + 10);
     const int SLIDER_WIDTH = 280;
     const int SLIDER_HEIGHT = 60;
+    const int LIST_WIDTH = 270; // rows, the scroll bar takes the rest of the width
+    const int LIST_ROW_HEIGHT = 50;
 
     sliderObj sliderApogee = {250, "Apogee", 200, 25, 2000};
     sliderObj sliderBurnTime = {320, "Burn time", 2, 0.05, 4};
@@ -115,7 +148,11 @@ private:
         RUN,
         MOTOR,
         FILTERING,
-        GAIN_SELECT
+        GAIN_SELECT,
+        STATS,
+        BATCH,
+        LOGS,
+        END
     };
 
     pageState state;
@@ -1,17 +1,50 @@
 #ifndef DATATYPE_H
 #define DATATYPE_H
 
-static const int resolution = 8 * 320;
+#include <stdint.h>
 
+static const int resolution = 8 * 320; // integration steps over the whole flight
+
+// most points a profile holds, ROCKET_SIM only places as many as SIM_TOLERANCE_PA needs
+#ifndef SIM_MAX_POINTS
+#define SIM_MAX_POINTS 512
+#endif
+
+// largest error allowed between the simulated pressure and linear interpolation of the profile's points, Pa
+#ifndef SIM_TOLERANCE_PA
+#define SIM_TOLERANCE_PA 5.0f
+#endif
+
+// columns of sim_data, ROCKET_SIM only computes the ones asked for
+enum simColumn : uint8_t
+{
+    SIM_TIME = 0x01,
+    SIM_ALTITUDE = 0x02,
+    SIM_VELOCITY = 0x04,
+    SIM_PRESSURE = 0x08,
+    SIM_ALL = 0x0F
+};
+
+// physics ROCKET_SIM generates the trajectory with
+enum simModel : uint8_t
+{
+    SIM_MODEL_KINEMATIC, // constant thrust, gravity, instant switch to terminal velocity
+    SIM_MODEL_DRAG       // quadratic drag, mass depletion during the burn, smooth approach to terminal velocity
+};
+
+// points 0 .. num_points - 1 are valid, entries past that are not touched.
+// Time is explicit, points are closer together where the pressure curve bends
 struct sim_data
 {
-    float velocity[resolution];
-    float altitude[resolution];
-    float pressure[resolution];
-    float time[resolution];
+    float velocity[SIM_MAX_POINTS];
+    float altitude[SIM_MAX_POINTS];
+    float pressure[SIM_MAX_POINTS];
+    float time[SIM_MAX_POINTS];
     float apogee = 0;
     float time_at_apogee = 0;
     int num_points = 0;
+    uint8_t columns = 0; // simColumn flags of the columns holding data
+    float max_error = 0; // largest pressure interpolation error against the simulation, Pa
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,103 +1,449 @@
 #include "ROCKET_SIM.h"
 
-ROCKET_SIM::ROCKET_SIM(float burnout_time, float apogee, float terminal_velocity)
+ROCKET_SIM::ROCKET_SIM(float burnout_time, float apogee, float terminal_velocity, simModel model)
 {
     this->burnout_time = burnout_time;
     this->apogee = apogee;
     this->terminal_velocity = terminal_velocity;
+    this->model = model;
 }
 
-sim_data &ROCKET_SIM::runSimulation()
+bool ROCKET_SIM::runSimulation(sim_data &data, uint8_t columns, float tolerance)
 {
-    // DBG("Initialised constants: " + String(this->burnout_time) + ", " + String(this->apogee) + ", " + String(this->terminal_velocity));
+    data.num_points = 0;
+    data.columns = 0;
+    data.max_error = 0;
 
-    float acceleration = compute_a_b(this->gravity, this->burnout_time, this->apogee);
+    const bool keepVelocity = columns & SIM_VELOCITY;
 
-    // DBG("Acceleration: " + String(acceleration));
+    modelParams params;
+    float flightTime = 0;
+    bool valid = (model == SIM_MODEL_DRAG) ? prepareDrag(params, flightTime) : prepareKinematic(params, flightTime);
 
-    float time_apogee = abs((this->burnout_time * (acceleration - this->gravity)) / (-this->gravity));
+    // points only where the pressure curve needs them, stopping at touchdown
+    if (!valid || !placePoints(data, params, flightTime, tolerance, keepVelocity))
+    {
+        data.num_points = 0;
+        return false;
+    }
 
-    // DBG("Time to apogee: " + String(time_apogee));
+    int max_index = 0;
+    for (int i = 1; i < data.num_points; i++)
+    {
+        if (data.altitude[i] > data.altitude[max_index])
+        {
+            max_index = i;
+        }
+    }
+
+    data.apogee = data.altitude[max_index];
+    data.time_at_apogee = data.time[max_index];
+
+    // a profile that doesn't fly to the apogee asked for would be run as if it did
+    if (!(abs(data.apogee - this->apogee) <= apogee_tolerance * this->apogee))
+    {
+        data.num_points = 0;
+        return false;
+    }
+
+    // pressure is always there, points are placed by it
+    data.columns = SIM_TIME | SIM_ALTITUDE | SIM_PRESSURE | (keepVelocity ? SIM_VELOCITY : 0);
+    return true;
+}
+
+bool ROCKET_SIM::prepareKinematic(modelParams &params, float &flightTime)
+{
+    float acceleration = compute_a_b(this->gravity, this->burnout_time, this->apogee);
+
+    float time_apogee = abs((this->burnout_time * (acceleration - this->gravity)) / (-this->gravity));
 
     // time and distance from apogee to terminal velocity
     float time_a_t = abs(this->terminal_velocity / this->gravity);
-    float dist_t = this->apogee + ((pow(this->terminal_velocity, 2)) / (2 * this->gravity));
+    float dist_t = this->apogee + ((this->terminal_velocity * this->terminal_velocity) / (2 * this->gravity));
 
     // time from terminal to landing
     float time_t_l = abs(dist_t / terminal_velocity);
 
     float time_total = time_apogee + time_a_t + time_t_l;
 
-    // DBG("Total time: " + String(time_total));
+    // also catches NaN from parameters that can't reach the apogee
+    if (!(time_total > 0))
+    {
+        return false;
+    }
+
+    params.thrust = acceleration;
+    params.dragAscent = 0;
+    params.dragDescent = 0;
+    flightTime = time_total;
+    return true;
+}
+
+float ROCKET_SIM::dragAcceleration(const modelParams &params, float burnout_time, float time, float velocity, bool burning)
+{
+    // mass relative to dry mass falls linearly from 1 / (1 - propellant_fraction) to 1 during the burn
+    float thrust = 0;
+    float mass = 1;
+
+    if (burning)
+    {
+        float launchMass = 1.0f / (1.0f - propellant_fraction);
+        mass = launchMass - (launchMass - 1.0f) * min(time / burnout_time, 1.0f);
+        thrust = params.thrust;
+    }
+
+    // drag opposes motion, the parachute is out once the rocket is coming down
+    float drag = (velocity > 0) ? -params.dragAscent * velocity * velocity : params.dragDescent * velocity * velocity;
+
+    return (thrust + drag) / mass + gravity;
+}
+
+void ROCKET_SIM::rk4Step(const modelParams &params, float burnout_time, float time, float dt, float &altitude, float &velocity)
+{
+    // acceleration doesn't depend on altitude, so altitude only needs the velocity at each stage.
+    // Steps never cross burnout, whether the motor is burning is decided once for all four stages
+    float halfDt = 0.5f * dt;
+    bool burning = time < burnout_time;
+
+    float a1 = dragAcceleration(params, burnout_time, time, velocity, burning);
+    float v2 = velocity + halfDt * a1;
+    float a2 = dragAcceleration(params, burnout_time, time + halfDt, v2, burning);
+    float v3 = velocity + halfDt * a2;
+    float a3 = dragAcceleration(params, burnout_time, time + halfDt, v3, burning);
+    float v4 = velocity + dt * a3;
+    float a4 = dragAcceleration(params, burnout_time, time + dt, v4, burning);
+
+    altitude += (dt / 6.0f) * (velocity + 2.0f * v2 + 2.0f * v3 + v4);
+    velocity += (dt / 6.0f) * (a1 + 2.0f * a2 + 2.0f * a3 + a4);
+}
+
+float ROCKET_SIM::dragApogee(const modelParams &params, float &time_apogee)
+{
+    // coarse RK4 of the ascent only, the burn is split into whole steps so burnout sits on a step boundary
+    const int burnSteps = 32;
+    const float dt = this->burnout_time / burnSteps;
+
+    float altitude = 0;
+    float velocity = 0;
+    float time = 0;
+
+    for (int i = 0; i < burnSteps; i++)
+    {
+        rk4Step(params, this->burnout_time, time, dt, altitude, velocity);
+        time = (i + 1) * dt;
+    }
+
+    if (velocity <= 0)
+    {
+        time_apogee = time;
+        return altitude;
+    }
 
-    if (time_total <= 0)
+    // coast until velocity changes sign. Gravity alone stops the rocket in v / g and drag only makes that shorter,
+    // so the step is sized from it and the loop can't run out before apogee unless the integration has gone wrong
+    const int coastSteps = 256;
+    const float coastDt = (velocity / -gravity) / coastSteps;
+    for (int i = 0; i < 2 * coastSteps; i++)
     {
-        return this->data;
+        float lastAltitude = altitude;
+        float lastVelocity = velocity;
+        rk4Step(params, this->burnout_time, time, coastDt, altitude, velocity);
+
+        if (velocity <= 0)
+        {
+            // velocity is close to linear over one step, altitude gains half the step's average to the zero crossing
+            float fraction = lastVelocity / (lastVelocity - velocity);
+            time_apogee = time + fraction * coastDt;
+            return lastAltitude + 0.5f * lastVelocity * fraction * coastDt;
+        }
+
+        time += coastDt;
     }
 
-    for (int i = 0; i < resolution; i++)
+    time_apogee = time;
+    return NAN;
+}
+
+bool ROCKET_SIM::prepareDrag(modelParams &params, float &flightTime)
+{
+    if (!(this->burnout_time > 0) || !(this->apogee > 0) || !(this->terminal_velocity < 0))
     {
-        this->data.altitude[i] = 0.0f;
-        this->data.velocity[i] = 0.0f;
-        this->data.pressure[i] = 0.0f;
+        return false;
     }
 
-    float prev_t = 0.0;
-    float dt = 0;
+    params.dragAscent = drag_ascent;
+    params.dragDescent = -gravity / (terminal_velocity * terminal_velocity); // drag equals weight at terminal velocity
 
-    // Previous graph point
-    int prev_x = 0;
-    int prev_y = 0;
+    // find the thrust that reaches the apogee, secant method started from the kinematic model's acceleration
+    float kinematic = compute_a_b(this->gravity, this->burnout_time, this->apogee);
+    if (!(kinematic > 0)) // also catches NaN when the apogee is out of reach
+    {
+        return false;
+    }
 
-    for (int x = 1; x < resolution; x++)
+    float time_apogee = 0;
+    float thrust0 = kinematic - gravity;
+    params.thrust = thrust0;
+    float error0 = dragApogee(params, time_apogee) - this->apogee;
+
+    float thrust1 = thrust0 * 1.2f;
+    params.thrust = thrust1;
+    float error1 = dragApogee(params, time_apogee) - this->apogee;
+
+    for (int i = 0; (i < 20) && (abs(error1) > 0.05f) && (error1 != error0); i++)
+    {
+        float thrust2 = thrust1 - error1 * (thrust1 - thrust0) / (error1 - error0);
+        thrust2 = max(thrust2, 0.5f * thrust1); // apogee is very flat in thrust when drag dominates, don't jump past zero
+
+        thrust0 = thrust1;
+        error0 = error1;
+        thrust1 = thrust2;
+
+        params.thrust = thrust1;
+        error1 = dragApogee(params, time_apogee) - this->apogee;
+    }
+
+    // also catches NaN from a coast that never reached apogee
+    if (!(abs(error1) <= apogee_tolerance * this->apogee))
     {
-        this->data.time[x] = mapFloat(x, 1.0f, float(resolution - 1), 0.0f, time_total);
-        dt = this->data.time[x] - prev_t;
+        return false;
+    }
+    params.thrust = thrust1;
 
-        if (this->data.time[x] >= this->burnout_time)
+    // falling from rest with quadratic drag takes v_t / g * acosh(e^(h g / v_t^2)), acosh(e^y) ~ y + ln2 for large y
+    float vt = -this->terminal_velocity;
+    float y = this->apogee * -gravity / (vt * vt);
+    float descentTime = (vt / -gravity) * ((y > 20.0f) ? (y + 0.693147f) : acoshf(expf(y)));
+
+    // with some margin, the drag model's landing time is an estimate
+    flightTime = (time_apogee + descentTime) * 1.05f;
+    return true;
+}
+
+void ROCKET_SIM::step(const modelParams &params, float time, float dt, float &altitude, float &velocity)
+{
+    if (model == SIM_MODEL_DRAG)
+    {
+        rk4Step(params, this->burnout_time, time, dt, altitude, velocity);
+        return;
+    }
+
+    // constant acceleration over the step, straight to terminal velocity once the fall reaches it
+    float acceleration = params.thrust;
+    if (time >= this->burnout_time)
+    {
+        if (velocity <= this->terminal_velocity)
         {
-            if (this->data.velocity[x - 1] <= this->terminal_velocity)
-            {
-                acceleration = 0;
-                this->data.velocity[x - 1] = this->terminal_velocity;
-            }
-            else
+            acceleration = 0;
+            velocity = this->terminal_velocity;
+        }
+        else
+        {
+            acceleration = this->gravity;
+        }
+    }
+
+    altitude += velocity * dt + 0.5f * acceleration * dt * dt;
+    velocity += acceleration * dt;
+}
+
+float ROCKET_SIM::advance(const modelParams &params, float maxStep, float duration, flightState &state, const chord *line)
+{
+    // equal steps no longer than maxStep and at least four, so a short segment is still checked inside and not only
+    // at its end. The step holding burnout is split so no step integrates across it
+    int steps = max(4, (int)ceilf(duration / maxStep));
+    float dt = duration / steps;
+    float start = state.time;
+    float error = 0;
+
+    for (int i = 1; i <= steps; i++)
+    {
+        float from = state.time;
+        float to = (i == steps) ? start + duration : start + i * dt;
+
+        if ((from < this->burnout_time) && (to > this->burnout_time))
+        {
+            step(params, from, this->burnout_time - from, state.altitude, state.velocity);
+            step(params, this->burnout_time, to - this->burnout_time, state.altitude, state.velocity);
+        }
+        else
+        {
+            step(params, from, to - from, state.altitude, state.velocity);
+        }
+        state.time = to;
+
+        if (line)
+        {
+            float expected = line->pressure + line->slope * (to - line->time);
+            error = max(error, abs(altitudeToPressure(state.altitude) - expected));
+            if (error > line->tolerance)
             {
-                acceleration = this->gravity;
+                break;
             }
         }
+    }
+
+    return error;
+}
+
+bool ROCKET_SIM::placePoints(sim_data &data, const modelParams &params, float flightTime, float tolerance, bool keepVelocity)
+{
+    // Each segment from the last point is integrated at the fine step, then again against the straight line to its
+    // end. Too far from the line anywhere in between and the segment is halved, well inside it and the next one is
+    // twice as long. Burnout, apogee and touchdown always get a point of their own, so the curve is followed as
+    // closely there as the tolerance needs instead of only as closely as a fixed grid allows
+    const float maxStep = flightTime / float(resolution - 1);
+    const float minSegment = maxStep / 16; // taken whatever its error, keeps a corner from halving forever
+    const float maxSegment = flightTime / 4;
+
+    flightState state = {0, 0, 0};
+    float pressure = altitudeToPressure(0);
+
+    data.time[0] = 0;
+    data.altitude[0] = 0;
+    data.pressure[0] = pressure;
+    if (keepVelocity)
+    {
+        data.velocity[0] = 0;
+    }
+    int points = 1;
 
-        // Update velocity and altitude using kinematic equations
-        this->data.altitude[x] = this->data.altitude[x - 1] + (this->data.velocity[x - 1] * dt) + (0.5 * acceleration * pow(dt, 2));
-        this->data.pressure[x] = altitudeToPressure(this->data.altitude[x]);
-        this->data.velocity[x] = this->data.velocity[x - 1] + acceleration * dt;
+    float segment = maxStep;
+    bool pastApogee = false;
+    bool trimmed = false; // this attempt was shortened to end on apogee or the ground, don't do it twice
+    float maxError = 0;
+
+    while (true)
+    {
+        float planned = segment;
+        bool toBurnout = (state.time < this->burnout_time) && (state.time + segment >= this->burnout_time);
+        if (toBurnout)
+        {
+            segment = this->burnout_time - state.time;
+        }
+
+        flightState end = state;
+        advance(params, maxStep, segment, end);
+
+        // end on apogee and on touchdown rather than somewhere past them, velocity and altitude are close to linear
+        if (!trimmed && !pastApogee && (end.velocity < 0))
+        {
+            segment *= state.velocity / (state.velocity - end.velocity);
+            trimmed = true;
+            continue;
+        }
+        if (!trimmed && pastApogee && (end.altitude < 0))
+        {
+            segment *= state.altitude / (state.altitude - end.altitude);
+            trimmed = true;
+            continue;
+        }
 
-        // Update previous points
-        prev_x = x;
-        prev_y = this->data.altitude[x];
-        prev_t = this->data.time[x];
+        float endPressure = altitudeToPressure(end.altitude);
+        chord line = {state.time, pressure, (endPressure - pressure) / segment, tolerance};
+        flightState check = state;
+        float error = advance(params, maxStep, segment, check, &line);
 
-        if (this->data.altitude[x] < 1.0 && this->data.time[x] > time_apogee)
+        if ((error > tolerance) && (segment > minSegment))
+        {
+            segment *= 0.5f;
+            trimmed = false;
+            continue;
+        }
+
+        if (points == SIM_MAX_POINTS)
+        {
+            LOG_WARN("Profile needs more than %d points", SIM_MAX_POINTS);
+            return false;
+        }
+
+        state = end;
+        if (toBurnout)
+        {
+            state.time = this->burnout_time;
+            segment = planned;
+        }
+        pressure = endPressure;
+
+        data.time[points] = state.time;
+        data.altitude[points] = state.altitude;
+        data.pressure[points] = pressure;
+        if (keepVelocity)
+        {
+            data.velocity[points] = state.velocity;
+        }
+        points++;
+
+        maxError = max(maxError, error);
+
+        // a segment trimmed to apogee can stop a hair short of it, don't trim to it again
+        if ((state.velocity <= 0) || trimmed)
+        {
+            pastApogee = true;
+        }
+        trimmed = false;
+
+        if (pastApogee && (state.altitude < 1.0f))
         {
-            this->data.num_points = x;
             break;
         }
+
+        // still in the air long after it should have landed
+        if (state.time > 2 * flightTime)
+        {
+            return false;
+        }
+
+        if (error < 0.25f * tolerance)
+        {
+            segment = min(2 * segment, maxSegment);
+        }
+    }
+
+    data.num_points = points;
+    data.max_error = maxError;
+    return true;
+}
+
+bool ROCKET_SIM::fillColumns(sim_data &data, uint8_t columns)
+{
+    uint8_t missing = columns & ~data.columns;
+
+    if ((missing & SIM_PRESSURE) && (data.columns & SIM_ALTITUDE))
+    {
+        altitudeToPressure(data.altitude, data.pressure, data.num_points);
+        data.columns |= SIM_PRESSURE;
     }
 
-    // Find the maximum altitude and its index
-    float *max_ptr = std::max_element(this->data.altitude, this->data.altitude + this->data.num_points);
-    int max_index = static_cast<int>(max_ptr - this->data.altitude);
+    // time, altitude and velocity need the simulation to be run again
+    return (columns & ~data.columns) == 0;
+}
 
-    // DBG("Max index: " + String(max_index));
+bool ROCKET_SIM::samplePressure(const sim_data &data, float time, int &cursor, float &pressure)
+{
+    if ((data.num_points < 2) || (time >= data.time[data.num_points - 1]))
+    {
+        return false;
+    }
 
-    // Retrieve the maximum altitude and corresponding time
-    this->data.apogee = this->data.altitude[max_index];
+    // first point at or after time, points are ascending so the search continues from the last call
+    cursor = constrain(cursor, 1, data.num_points - 1);
+    while ((cursor > 1) && (data.time[cursor - 1] > time))
+    {
+        cursor--;
+    }
+    while (data.time[cursor] < time)
+    {
+        cursor++;
+    }
 
-    // DBG("Apogee: " + String(this->data.apogee) + "m");
+    float t0 = data.time[cursor - 1];
+    float t1 = data.time[cursor];
+    float fraction = (t1 > t0) ? constrain((time - t0) / (t1 - t0), 0.0f, 1.0f) : 1.0f;
 
-    this->data.time_at_apogee = this->data.time[max_index];
+    pressure = data.pressure[cursor - 1] + fraction * (data.pressure[cursor] - data.pressure[cursor - 1]);
 
-    return this->data;
+    return true;
 }
 
 float ROCKET_SIM::compute_a_b(double g, double t_b, double S_a)
@@ -130,11 +476,6 @@ float ROCKET_SIM::compute_a_b(double g, double t_b, double S_a)
     return y;
 }
 
-float ROCKET_SIM::mapFloat(float x, float in_min, float in_max, float out_min, float out_max)
-{
-    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
-
 float ROCKET_SIM::altitudeToPressure(float h)
 {
     // Calculate the base of the exponent
@@ -149,6 +490,61 @@ float ROCKET_SIM::altitudeToPressure(float h)
     return P;
 }
 
+// ln(x) for x > 0: x = m * 2^e with m in [sqrt(1/2), sqrt(2)), ln(m) = 2 atanh((m - 1) / (m + 1)) as a series
+static inline float batchLog(float x)
+{
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    int32_t e = (bits - 0x3F3504F3) >> 23; // 0x3F3504F3 is sqrt(1/2)
+    bits -= e << 23;
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    float t = (m - 1.0f) / (m + 1.0f);
+    float t2 = t * t;
+    float lnm = 2.0f * t * (1.0f + t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7 + t2 * (1.0f / 9)))));
+
+    return lnm + float(e) * 0.693147181f;
+}
+
+// e^y for |y| < 87: y = k ln2 + r with |r| <= ln2 / 2, e^r as a degree 7 polynomial, 2^k added to the exponent bits
+static inline float batchExp(float y)
+{
+    const float roundMagic = 12582912.0f; // 1.5 * 2^23, adding it rounds to an integer
+
+    float kf = y * 1.442695041f + roundMagic;
+    int32_t k;
+    memcpy(&k, &kf, sizeof(k));
+    k -= 0x4B400000; // bits of roundMagic
+    kf -= roundMagic;
+
+    float r = (y - kf * 0.693145752f) - kf * 1.428606766e-6f; // ln2 split in two for precision
+    float p = 1.0f + r * (1.0f + r * (1.0f / 2 + r * (1.0f / 6 + r * (1.0f / 24 + r * (1.0f / 120 + r * (1.0f / 720 + r * (1.0f / 5040)))))));
+
+    int32_t bits;
+    memcpy(&bits, &p, sizeof(bits));
+    bits += k << 23;
+    memcpy(&p, &bits, sizeof(p));
+
+    return p;
+}
+
+void ROCKET_SIM::altitudeToPressure(const float *__restrict altitude, float *__restrict pressure, int count)
+{
+    // same formula as the scalar version, P = P0 * base^n computed as P0 * e^(n ln(base)) in single precision.
+    // Valid up to ~44 km where base reaches 0
+    const float scale = temp_lapse_rate / temperature;
+    const float exponent = (gravity * molar_mass) / (gas_constant * temp_lapse_rate);
+
+    for (int i = 0; i < count; i++)
+    {
+        float base = 1.0f + scale * (altitude[i] - h_b);
+        pressure[i] = static_pressure * batchExp(exponent * batchLog(base));
+    }
+}
+
 float ROCKET_SIM::pressureToAltitude(float P)
 {
     // Calculate the exponent for (P / static_pressure) based on rearranged formula
@@ -8,16 +8,73 @@
 class ROCKET_SIM
 {
 public:
-    ROCKET_SIM(float burnout_time, float apogee, float terminal_velocity);
+    ROCKET_SIM(float burnout_time, float apogee, float terminal_velocity, simModel model = SIM_MODEL_KINEMATIC);
+
+    // bump whenever runSimulation() output changes, invalidates trajectories cached on the SD card
+    static constexpr uint32_t modelVersion = 5;
 
     static float altitudeToPressure(float h);
     static float pressureToAltitude(float P);
 
-    sim_data &runSimulation();
+    // altitudeToPressure() over a whole column, branch free single precision so it vectorises
+    static void altitudeToPressure(const float *altitude, float *pressure, int count);
+
+    // fills time, altitude and pressure plus velocity if requested, with points placed so linear interpolation stays
+    // within tolerance Pa of the simulated pressure. Sets data.max_error to the largest error left. Returns false if
+    // the parameters can't fly or the profile needs more than SIM_MAX_POINTS
+    bool runSimulation(sim_data &data, uint8_t columns = SIM_ALL, float tolerance = SIM_TOLERANCE_PA);
+
+    // computes columns that weren't requested when data was generated, only pressure can be derived afterwards
+    static bool fillColumns(sim_data &data, uint8_t columns);
+
+    // pressure at time, interpolated between points. cursor is the point search starts from, start at 1 and keep it
+    // between calls with ascending times. Returns false past the last point
+    static bool samplePressure(const sim_data &data, float time, int &cursor, float &pressure);
 
 private:
     float compute_a_b(double g, double t_b, double S_a);
-    float mapFloat(float x, float in_min, float in_max, float out_min, float out_max);
+
+    struct modelParams
+    {
+        float thrust;     // SIM_MODEL_DRAG thrust / dry mass, SIM_MODEL_KINEMATIC net acceleration during the burn, m/s^2
+        float dragAscent; // drag acceleration / v^2 at dry mass, 1/m
+        float dragDescent;
+    };
+
+    struct flightState
+    {
+        float time;
+        float altitude;
+        float velocity;
+    };
+
+    // straight line between two profile points in pressure, and how far the flight may stray from it
+    struct chord
+    {
+        float time;
+        float pressure;
+        float slope;
+        float tolerance;
+    };
+
+    // model parameters for the requested flight and an upper bound on its length, false if it can't fly
+    bool prepareKinematic(modelParams &params, float &flightTime);
+    bool prepareDrag(modelParams &params, float &flightTime);
+
+    // one step of the model that doesn't cross burnout
+    void step(const modelParams &params, float time, float dt, float &altitude, float &velocity);
+
+    // moves state on by duration in steps of at most maxStep. With a line, returns the largest pressure difference
+    // from it after any step, stopping early once that is past its tolerance
+    float advance(const modelParams &params, float maxStep, float duration, flightState &state, const chord *line = nullptr);
+
+    // fill data up to touchdown with as few points as the tolerance allows, false if they don't fit
+    bool placePoints(sim_data &data, const modelParams &params, float flightTime, float tolerance, bool keepVelocity);
+
+    // SIM_MODEL_DRAG
+    static float dragAcceleration(const modelParams &params, float burnout_time, float time, float velocity, bool burning);
+    static void rk4Step(const modelParams &params, float burnout_time, float time, float dt, float &altitude, float &velocity);
+    float dragApogee(const modelParams &params, float &time_apogee); // NaN if the coast never turns over
 
     // constants
     static constexpr float gravity = -9.81;
@@ -28,11 +85,17 @@ private:
     static constexpr float molar_mass = 0.0289644;     // kg/mol
     static constexpr float h_b = 0.0;                  // base altitude, m
 
+    // fraction of the requested apogee a trajectory may miss it by before runSimulation() rejects it
+    static constexpr float apogee_tolerance = 0.01;
+
+    // SIM_MODEL_DRAG, per unit dry mass. Descent drag comes from the terminal velocity
+    static constexpr float drag_ascent = 0.0004;     // 1/m, ~9 m/s^2 at 150 m/s
+    static constexpr float propellant_fraction = 0.2; // of the launch mass, burnt at a constant rate
+
     float burnout_time;
     float apogee;
     float terminal_velocity;
-
-    sim_data data;
+    simModel model;
 };
 
 #endif // ROCKET_SIM_H
\ No newline at end of file
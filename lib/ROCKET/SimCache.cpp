@@ -0,0 +1,278 @@
+#include "SimCache.h"
+#include "ROCKET_SIM.h"
+#include "Checksum.hpp"
+#include "DirIndex.h"
+
+#define SIM_CACHE_INDEX_MAGIC 0x31584953 // "SIX1"
+
+SimCache::SimCache() : numEntries(0), indexLoaded(false)
+{
+}
+
+simKey SimCache::makeKey(float apogee, float burnout_time, float terminal_velocity, simModel model)
+{
+    // slider values are continuous, round them so the same selection always gives the same key.
+    // The simulation has to be run with the rounded values for the cache to hold exactly what it would produce
+    simKey key;
+    key.apogee = round(apogee);                               // 1 m
+    key.burnout_time = round(burnout_time * 100.0f) / 100.0f; // 10 ms
+    key.terminal_velocity = round(terminal_velocity * 10.0f) / 10.0f;
+    key.tolerance = SIM_TOLERANCE_PA;
+    key.model = model;
+    key.modelVersion = ROCKET_SIM::modelVersion;
+    return key;
+}
+
+bool SimCache::load(const simKey &key, sim_data &data)
+{
+    if (!indexLoaded && !loadIndex())
+    {
+        return false;
+    }
+
+    uint32_t hash = crc32(&key, sizeof(key));
+    int entry = findEntry(hash, key);
+
+    if (entry < 0)
+    {
+        return false;
+    }
+
+    File file = SD.open(entryPath(hash).c_str(), FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+
+    simCacheHeader header;
+    bool valid = (file.read(&header, sizeof(header)) == sizeof(header));
+
+    valid = valid && (header.magic == SIM_CACHE_MAGIC) && (memcmp(&header.key, &key, sizeof(key)) == 0);
+    valid = valid && (header.num_points > 0) && (header.num_points <= SIM_MAX_POINTS);
+
+    if (valid)
+    {
+        int columnSize = header.num_points * sizeof(float);
+
+        valid = (file.read(data.time, columnSize) == columnSize);
+        valid = valid && (file.read(data.altitude, columnSize) == columnSize);
+        valid = valid && (file.read(data.pressure, columnSize) == columnSize);
+
+        uint32_t crc = crc32(data.time, columnSize);
+        crc = crc32Update(crc, data.altitude, columnSize);
+        crc = crc32Update(crc, data.pressure, columnSize);
+
+        valid = valid && (crc == header.dataCrc);
+    }
+
+    file.close();
+
+    if (!valid)
+    {
+        LOG_WARN("Discarding corrupt cache entry: %s", entryPath(hash).c_str());
+        data.num_points = 0;
+        return false;
+    }
+
+    // velocity isn't cached, nothing downstream of the simulation uses it
+    data.num_points = header.num_points;
+    data.columns = SIM_TIME | SIM_ALTITUDE | SIM_PRESSURE;
+    data.apogee = header.apogee;
+    data.time_at_apogee = header.time_at_apogee;
+    data.max_error = header.max_error;
+
+    // LRU stamp is only written back with the next store() to avoid a card write per slider move
+    entries[entry].lastUsed = nextStamp();
+
+    return true;
+}
+
+bool SimCache::store(const simKey &key, const sim_data &data)
+{
+    if ((data.num_points <= 0) || ((data.columns & (SIM_TIME | SIM_ALTITUDE | SIM_PRESSURE)) != (SIM_TIME | SIM_ALTITUDE | SIM_PRESSURE)))
+    {
+        return false;
+    }
+
+    if (!indexLoaded)
+    {
+        loadIndex();
+    }
+
+    if (!indexLoaded)
+    {
+        // no card, or an index that is there but couldn't be read: saving over it would orphan every entry it
+        // lists. A cache folder that doesn't exist yet is a new, empty cache
+        if (SD.exists(SIM_CACHE_FOLDER) || !SD.mkdir(SIM_CACHE_FOLDER))
+        {
+            return false;
+        }
+        indexLoaded = true;
+    }
+
+    uint32_t hash = crc32(&key, sizeof(key));
+    int entry = findEntry(hash, key);
+
+    if (entry >= 0)
+    {
+        entries[entry].lastUsed = nextStamp();
+        return saveIndex();
+    }
+
+    if (!SD.exists(SIM_CACHE_FOLDER) && !SD.mkdir(SIM_CACHE_FOLDER))
+    {
+        DBG("Failed to create folder: " SIM_CACHE_FOLDER);
+        return false;
+    }
+
+    // make room by dropping the least recently used entry
+    if (numEntries >= SIM_CACHE_MAX_ENTRIES)
+    {
+        uint8_t oldest = 0;
+        for (uint8_t i = 1; i < numEntries; i++)
+        {
+            if (entries[i].lastUsed < entries[oldest].lastUsed)
+            {
+                oldest = i;
+            }
+        }
+
+        SD.remove(entryPath(entries[oldest].hash).c_str());
+        dirIndex.touch(entryPath(entries[oldest].hash).c_str());
+        entries[oldest] = entries[--numEntries];
+    }
+
+    pathString path = entryPath(hash);
+    int columnSize = data.num_points * sizeof(float);
+
+    simCacheHeader header;
+    header.magic = SIM_CACHE_MAGIC;
+    header.key = key;
+    header.num_points = data.num_points;
+    header.apogee = data.apogee;
+    header.time_at_apogee = data.time_at_apogee;
+    header.max_error = data.max_error;
+    header.dataCrc = crc32(data.time, columnSize);
+    header.dataCrc = crc32Update(header.dataCrc, data.altitude, columnSize);
+    header.dataCrc = crc32Update(header.dataCrc, data.pressure, columnSize);
+
+    // FILE_WRITE appends, start from an empty file
+    SD.remove(path.c_str());
+
+    File file = SD.open(path.c_str(), FILE_WRITE);
+    dirIndex.touch(path.c_str());
+    if (!file)
+    {
+        LOG_ERROR("Failed to open file: %s", path.c_str());
+        return false;
+    }
+
+    bool success = (file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header));
+    success = success && (file.write((const uint8_t *)data.time, columnSize) == (size_t)columnSize);
+    success = success && (file.write((const uint8_t *)data.altitude, columnSize) == (size_t)columnSize);
+    success = success && (file.write((const uint8_t *)data.pressure, columnSize) == (size_t)columnSize);
+
+    file.close();
+
+    if (!success)
+    {
+        SD.remove(path.c_str());
+        return false;
+    }
+
+    entries[numEntries].key = key;
+    entries[numEntries].hash = hash;
+    entries[numEntries].lastUsed = nextStamp();
+    numEntries++;
+
+    return saveIndex();
+}
+
+bool SimCache::loadIndex()
+{
+    // the index only counts as loaded once it was read, or the card showed it isn't there: a load() before the card
+    // is mounted mustn't leave an empty index for the next store() to save
+    numEntries = 0;
+
+    File file = SD.open(SIM_CACHE_INDEX, FILE_READ);
+    if (!file)
+    {
+        indexLoaded = SD.exists(SIM_CACHE_FOLDER);
+        return false;
+    }
+
+    // a bad or truncated index is no use and gets replaced, a read that fails is the card going away
+    uint32_t header[2]; // magic, number of entries
+    bool valid = (file.size() >= sizeof(header));
+    bool read = !valid || (file.read(header, sizeof(header)) == sizeof(header));
+    valid = valid && read && (header[0] == SIM_CACHE_INDEX_MAGIC) && (header[1] <= SIM_CACHE_MAX_ENTRIES);
+
+    if (valid)
+    {
+        uint32_t entriesSize = header[1] * sizeof(simCacheEntry);
+        valid = (file.size() >= sizeof(header) + entriesSize);
+        read = !valid || (file.read(entries, entriesSize) == (int)entriesSize);
+        valid = valid && read;
+    }
+
+    file.close();
+
+    indexLoaded = read;
+
+    numEntries = valid ? header[1] : 0;
+
+    return valid;
+}
+
+bool SimCache::saveIndex()
+{
+    SD.remove(SIM_CACHE_INDEX);
+
+    File file = SD.open(SIM_CACHE_INDEX, FILE_WRITE);
+    dirIndex.touch(SIM_CACHE_INDEX);
+    if (!file)
+    {
+        return false;
+    }
+
+    uint32_t header[2] = {SIM_CACHE_INDEX_MAGIC, numEntries};
+    size_t entriesSize = numEntries * sizeof(simCacheEntry);
+
+    bool success = (file.write((const uint8_t *)header, sizeof(header)) == sizeof(header));
+    success = success && (file.write((const uint8_t *)entries, entriesSize) == entriesSize);
+
+    file.close();
+
+    return success;
+}
+
+int SimCache::findEntry(uint32_t hash, const simKey &key)
+{
+    for (uint8_t i = 0; i < numEntries; i++)
+    {
+        if (entries[i].hash == hash && memcmp(&entries[i].key, &key, sizeof(key)) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+pathString SimCache::entryPath(uint32_t hash)
+{
+    char path[sizeof(SIM_CACHE_FOLDER) + 13]; // folder, slash and 8.3 file name
+    snprintf(path, sizeof(path), SIM_CACHE_FOLDER "/%08lX.SIM", (unsigned long)hash);
+    return pathString(path);
+}
+
+uint32_t SimCache::nextStamp()
+{
+    uint32_t newest = 0;
+    for (uint8_t i = 0; i < numEntries; i++)
+    {
+        newest = max(newest, entries[i].lastUsed);
+    }
+
+    return newest + 1;
+}
@@ -0,0 +1,69 @@
+#ifndef SIM_CACHE_H
+#define SIM_CACHE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "DataType.h"
+#include "Debug.hpp"
+#include "FixedString.hpp"
+
+#define SIM_CACHE_FOLDER "/SIMCACHE"
+#define SIM_CACHE_INDEX SIM_CACHE_FOLDER "/INDEX.BIN"
+#define SIM_CACHE_MAX_ENTRIES 16
+#define SIM_CACHE_MAGIC 0x314D4953 // "SIM1"
+
+// everything that determines the output of ROCKET_SIM
+struct simKey
+{
+    float apogee;
+    float burnout_time;
+    float terminal_velocity;
+    float tolerance; // ROCKET_SIM::runSimulation() tolerance, Pa
+    uint32_t model;  // simModel
+    uint32_t modelVersion;
+};
+
+struct simCacheEntry
+{
+    simKey key;
+    uint32_t hash;     // file name of the entry, /SIMCACHE/<hash>.SIM
+    uint32_t lastUsed; // LRU stamp, highest is most recent
+};
+
+// Layout of a .SIM file: simCacheHeader followed by the time, altitude and pressure columns (num_points floats each)
+struct simCacheHeader
+{
+    uint32_t magic;
+    simKey key;
+    int32_t num_points;
+    float apogee;
+    float time_at_apogee;
+    float max_error;  // from ROCKET_SIM::runSimulation()
+    uint32_t dataCrc; // CRC-32 of the three columns
+};
+
+// Keeps simulated trajectories on the SD card so re-selecting a profile loads the exact same points
+// instead of re-running the simulation. The least recently used entry is dropped when the cache is full.
+class SimCache
+{
+public:
+    SimCache();
+
+    static simKey makeKey(float apogee, float burnout_time, float terminal_velocity, simModel model = SIM_MODEL_KINEMATIC);
+
+    bool load(const simKey &key, sim_data &data);
+    bool store(const simKey &key, const sim_data &data);
+
+private:
+    bool loadIndex();
+    bool saveIndex();
+    int findEntry(uint32_t hash, const simKey &key);
+    pathString entryPath(uint32_t hash);
+    uint32_t nextStamp();
+
+    simCacheEntry entries[SIM_CACHE_MAX_ENTRIES];
+    uint8_t numEntries;
+    bool indexLoaded;
+};
+
+#endif // SIM_CACHE_H
@@ -0,0 +1,66 @@
+#include "Arena.hpp"
+
+Arena::Arena(uint8_t *buffer_, size_t size_) : buffer(buffer_), size(size_), used(0), highWater(0), failures(0)
+{
+}
+
+void *Arena::allocate(size_t bytes, size_t align)
+{
+    // align the address rather than the offset, the buffer itself may not be aligned
+    uintptr_t start = (uintptr_t)(buffer + used);
+    size_t padding = (align - (start % align)) % align;
+
+    if (padding + bytes > size - used)
+    {
+        failures++;
+        return nullptr;
+    }
+
+    void *memory = buffer + used + padding;
+    used += padding + bytes;
+
+    if (used > highWater)
+    {
+        highWater = used;
+    }
+
+    return memory;
+}
+
+size_t Arena::mark()
+{
+    return used;
+}
+
+void Arena::release(size_t mark)
+{
+    if (mark < used)
+    {
+        used = mark;
+    }
+}
+
+void Arena::reset()
+{
+    used = 0;
+}
+
+size_t Arena::getSize()
+{
+    return size;
+}
+
+size_t Arena::getUsed()
+{
+    return used;
+}
+
+size_t Arena::getHighWater()
+{
+    return highWater;
+}
+
+uint32_t Arena::getFailures()
+{
+    return failures;
+}
@@ -0,0 +1,70 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+// Bump allocator over a fixed buffer, for objects that live for a page or a session of pages instead of the whole
+// program. Nothing is freed on its own: release() drops everything allocated after a mark() and reset() drops the
+// lot, so allocation never touches the heap and can't fragment it. Objects are never destroyed, only trivially
+// destructible types can be created.
+#define ARENA_ALIGN 8
+
+class Arena
+{
+public:
+    Arena(uint8_t *buffer_, size_t size_);
+
+    void *allocate(size_t bytes, size_t align = ARENA_ALIGN); // nullptr when it doesn't fit
+
+    template <typename T>
+    T *create()
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        void *memory = allocate(sizeof(T), alignof(T));
+        return memory ? new (memory) T() : nullptr;
+    }
+
+    template <typename T>
+    T *createArray(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        void *memory = allocate(sizeof(T) * count, alignof(T));
+        return memory ? new (memory) T[count]() : nullptr;
+    }
+
+    size_t mark();
+    void release(size_t mark);
+    void reset();
+
+    size_t getSize();
+    size_t getUsed();
+    size_t getHighWater(); // most ever used at once
+    uint32_t getFailures(); // allocations that didn't fit
+
+private:
+    uint8_t *buffer;
+    size_t size;
+    size_t used;
+    size_t highWater;
+    uint32_t failures;
+};
+
+// releases everything allocated in the enclosing block
+class ArenaScope
+{
+public:
+    ArenaScope(Arena &arena_) : arena(arena_), top(arena_.mark()) {}
+    ~ArenaScope() { arena.release(top); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    Arena &arena;
+    size_t top;
+};
+
+#endif // ARENA_HPP
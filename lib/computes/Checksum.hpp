@@ -0,0 +1,23 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 (IEEE 802.3, reflected 0xEDB88320). Pass the previous result back in as `crc` to checksum data in chunks.
+uint32_t crc32Update(uint32_t crc, const void *data, size_t len);
+
+inline uint32_t crc32(const void *data, size_t len)
+{
+    return crc32Update(0, data, len);
+}
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), used to check telemetry frames
+uint16_t crc16Update(uint16_t crc, const void *data, size_t len);
+
+inline uint16_t crc16(const void *data, size_t len)
+{
+    return crc16Update(0xFFFF, data, len);
+}
+
+#endif // CHECKSUM_HPP
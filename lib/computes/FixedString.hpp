@@ -0,0 +1,113 @@
+#ifndef FIXED_STRING_HPP
+#define FIXED_STRING_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// The part of Arduino String the firmware uses, with the capacity fixed at compile time so it never allocates.
+// Appends that don't fit are cut short and remembered, see truncated().
+template <size_t N>
+class FixedString
+{
+public:
+    FixedString() : len(0), cut(false) { text[0] = '\0'; }
+    FixedString(const char *s) : FixedString() { append(s); }
+
+    FixedString &operator=(const char *s)
+    {
+        len = 0;
+        cut = false;
+        text[0] = '\0';
+        append(s);
+        return *this;
+    }
+
+    FixedString &operator+=(const char *s)
+    {
+        append(s);
+        return *this;
+    }
+
+    FixedString &operator+=(char c)
+    {
+        char s[2] = {c, '\0'};
+        append(s);
+        return *this;
+    }
+
+    template <size_t M>
+    FixedString &operator+=(const FixedString<M> &s)
+    {
+        append(s.c_str());
+        return *this;
+    }
+
+    FixedString operator+(const char *s) const
+    {
+        FixedString result(*this);
+        result += s;
+        return result;
+    }
+
+    template <size_t M>
+    FixedString operator+(const FixedString<M> &s) const
+    {
+        return *this + s.c_str();
+    }
+
+    bool operator==(const char *s) const { return strcmp(text, s) == 0; }
+
+    const char *c_str() const { return text; }
+    unsigned int length() const { return len; }
+    bool truncated() const { return cut; }
+
+    bool endsWith(const char *suffix) const
+    {
+        size_t suffixLength = strlen(suffix);
+        return suffixLength <= len && memcmp(text + len - suffixLength, suffix, suffixLength) == 0;
+    }
+
+private:
+    void append(const char *s)
+    {
+        size_t n = strlen(s);
+        if (len + n > N)
+        {
+            n = N - len;
+            cut = true;
+        }
+        memcpy(text + len, s, n);
+        len += n;
+        text[len] = '\0';
+    }
+
+    char text[N + 1];
+    size_t len;
+    bool cut;
+};
+
+// Card paths. STRING_FREE builds keep them in fixed buffers instead of Arduino String; code that only constructs,
+// assigns, adds with + and +=, and reads c_str() builds either way
+#define PATH_MAX_LENGTH 63
+
+#ifdef STRING_FREE
+typedef FixedString<PATH_MAX_LENGTH> pathString;
+#else
+#include <Arduino.h>
+typedef String pathString;
+#endif
+
+// path with its extension, if it has one, swapped for extension, e.g. ".IDX"
+inline pathString withExtension(const char *path, const char *extension)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - path) : strlen(path);
+
+    char buffer[PATH_MAX_LENGTH + 1];
+    snprintf(buffer, sizeof(buffer), "%.*s%s", (int)stem, path, extension);
+    return pathString(buffer);
+}
+
+#endif // FIXED_STRING_HPP
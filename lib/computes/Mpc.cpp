@@ -0,0 +1,289 @@
+#include "Mpc.hpp"
+#include <math.h>
+
+Mpc::Mpc() : step(0.1f), trackingWeight(1.0f), effortWeight(0.01f), rateWeight(1.0f), low(0), high(100), iterations(0)
+{
+    reset();
+}
+
+void Mpc::setStep(float seconds)
+{
+    step = seconds;
+}
+
+void Mpc::setWeights(float tracking, float effort, float rate)
+{
+    // effort has to stay above zero, it keeps the Hessian positive definite
+    trackingWeight = tracking;
+    effortWeight = (effort > 1e-6f) ? effort : 1e-6f;
+    rateWeight = rate;
+}
+
+void Mpc::setLimits(float low_, float high_)
+{
+    low = low_;
+    high = high_;
+}
+
+void Mpc::reset(float command)
+{
+    previous = command;
+    for (uint8_t i = 0; i < MPC_HORIZON; i++)
+    {
+        plan[i] = command;
+        bound[i] = FREE;
+    }
+}
+
+void Mpc::buildProblem(float pressure, const float *reference, float leakRate, float pumpGain, float ambient)
+{
+    // exact discretisation: P[k+1] = alpha * P[k] + beta * u[k] + gamma
+    float alpha, beta, gamma;
+    if (leakRate * step < 1e-6f)
+    {
+        alpha = 1;
+        beta = -pumpGain * step;
+        gamma = 0;
+    }
+    else
+    {
+        alpha = expf(-leakRate * step);
+        beta = -pumpGain * (1 - alpha) / leakRate;
+        gamma = ambient * (1 - alpha);
+    }
+
+    // powers of alpha, and tail[n] = sum of alpha^2t for t = 0..n
+    float power[MPC_HORIZON];
+    float tail[MPC_HORIZON];
+    power[0] = 1;
+    tail[0] = 1;
+    for (uint8_t i = 1; i < MPC_HORIZON; i++)
+    {
+        power[i] = power[i - 1] * alpha;
+        tail[i] = tail[i - 1] + power[i] * power[i];
+    }
+
+    // prediction P = free + G u with G[k][j] = alpha^(k-j) beta, so G'G[i][j] = beta^2 alpha^|i-j| tail[N-1-max(i,j)]
+    float tracking = trackingWeight * beta * beta;
+    for (uint8_t i = 0; i < MPC_HORIZON; i++)
+    {
+        for (uint8_t j = 0; j <= i; j++)
+        {
+            float value = tracking * power[i - j] * tail[MPC_HORIZON - 1 - i];
+            H[i][j] = value;
+            H[j][i] = value;
+        }
+
+        // effort, and the rate term's tridiagonal (u[i] - u[i-1])^2
+        H[i][i] += effortWeight + rateWeight * ((i < MPC_HORIZON - 1) ? 2 : 1);
+        if (i > 0)
+        {
+            H[i][i - 1] -= rateWeight;
+            H[i - 1][i] -= rateWeight;
+        }
+    }
+
+    // tracking error of the free response, then g = weight * G' error by a backward sweep
+    float error[MPC_HORIZON];
+    float predicted = pressure;
+    for (uint8_t k = 0; k < MPC_HORIZON; k++)
+    {
+        predicted = alpha * predicted + gamma;
+        error[k] = predicted - reference[k];
+    }
+
+    float sweep = 0;
+    for (int8_t j = MPC_HORIZON - 1; j >= 0; j--)
+    {
+        sweep = error[j] + alpha * sweep;
+        g[j] = trackingWeight * beta * sweep;
+    }
+    g[0] -= rateWeight * previous;
+}
+
+bool Mpc::solve(float pressure, const float *reference, float leakRate, float pumpGain, float ambient, float &command)
+{
+    buildProblem(pressure, reference, leakRate, pumpGain, ambient);
+
+    // warm start from the last plan moved on a step, clamped so the active set starts feasible
+    for (uint8_t i = 0; i < MPC_HORIZON; i++)
+    {
+        float u = plan[(i < MPC_HORIZON - 1) ? i + 1 : i];
+        if (u <= low)
+        {
+            plan[i] = low;
+            bound[i] = AT_LOW;
+        }
+        else if (u >= high)
+        {
+            plan[i] = high;
+            bound[i] = AT_HIGH;
+        }
+        else
+        {
+            plan[i] = u;
+            bound[i] = FREE;
+        }
+    }
+
+    bool optimal = false;
+    uint8_t free[MPC_HORIZON];
+    float solution[MPC_HORIZON];
+
+    for (iterations = 1; iterations <= MPC_MAX_ITERATIONS; iterations++)
+    {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < MPC_HORIZON; i++)
+        {
+            if (bound[i] == FREE)
+            {
+                free[count++] = i;
+            }
+        }
+
+        if ((count > 0) && solveFree(free, count, solution))
+        {
+            // move towards the unconstrained optimum of the free commands, stopping at the first bound in the way
+            float fraction = 1;
+            int8_t blocking = -1;
+
+            for (uint8_t n = 0; n < count; n++)
+            {
+                float u = plan[free[n]];
+                float target = solution[n];
+                float limit = (target < low) ? low : ((target > high) ? high : target);
+
+                if ((limit != target) && (target != u))
+                {
+                    float reach = (limit - u) / (target - u);
+                    if (reach < fraction)
+                    {
+                        fraction = (reach > 0) ? reach : 0;
+                        blocking = free[n];
+                    }
+                }
+            }
+
+            for (uint8_t n = 0; n < count; n++)
+            {
+                plan[free[n]] += fraction * (solution[n] - plan[free[n]]);
+            }
+
+            if (blocking >= 0)
+            {
+                bool atLow = plan[blocking] - low < high - plan[blocking];
+                plan[blocking] = atLow ? low : high;
+                bound[blocking] = atLow ? AT_LOW : AT_HIGH;
+                continue;
+            }
+        }
+
+        // free block is optimal, release the bound whose multiplier has the wrong sign by the most
+        int8_t release = -1;
+        float worst = 1e-4f * (1 + fabsf(g[0]));
+
+        for (uint8_t i = 0; i < MPC_HORIZON; i++)
+        {
+            if (bound[i] == FREE)
+            {
+                continue;
+            }
+
+            float gradient = g[i];
+            for (uint8_t j = 0; j < MPC_HORIZON; j++)
+            {
+                gradient += H[i][j] * plan[j];
+            }
+
+            // at the low bound the cost must rise going up, at the high bound it must rise going down
+            float violation = (bound[i] == AT_LOW) ? -gradient : gradient;
+            if (violation > worst)
+            {
+                worst = violation;
+                release = i;
+            }
+        }
+
+        if (release < 0)
+        {
+            optimal = true;
+            break;
+        }
+
+        bound[release] = FREE;
+    }
+
+    previous = plan[0];
+    command = plan[0];
+    return optimal;
+}
+
+bool Mpc::solveFree(uint8_t *free, uint8_t count, float *solution)
+{
+    // H_FF x = -(g_F + H_FA u_A), Cholesky of the free block in factor's lower triangle
+    for (uint8_t r = 0; r < count; r++)
+    {
+        float rhs = -g[free[r]];
+        for (uint8_t j = 0; j < MPC_HORIZON; j++)
+        {
+            if (bound[j] != FREE)
+            {
+                rhs -= H[free[r]][j] * plan[j];
+            }
+        }
+        solution[r] = rhs;
+
+        for (uint8_t c = 0; c <= r; c++)
+        {
+            float sum = H[free[r]][free[c]];
+            for (uint8_t k = 0; k < c; k++)
+            {
+                sum -= factor[r][k] * factor[c][k];
+            }
+
+            if (r == c)
+            {
+                if (sum <= 0)
+                {
+                    return false;
+                }
+                factor[r][r] = sqrtf(sum);
+            }
+            else
+            {
+                factor[r][c] = sum / factor[c][c];
+            }
+        }
+    }
+
+    // forward then back substitution
+    for (uint8_t r = 0; r < count; r++)
+    {
+        for (uint8_t k = 0; k < r; k++)
+        {
+            solution[r] -= factor[r][k] * solution[k];
+        }
+        solution[r] /= factor[r][r];
+    }
+
+    for (int8_t r = count - 1; r >= 0; r--)
+    {
+        for (uint8_t k = r + 1; k < count; k++)
+        {
+            solution[r] -= factor[k][r] * solution[k];
+        }
+        solution[r] /= factor[r][r];
+    }
+
+    return true;
+}
+
+uint8_t Mpc::getIterations()
+{
+    return iterations;
+}
+
+const float *Mpc::getPlan()
+{
+    return plan;
+}
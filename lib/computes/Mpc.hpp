@@ -0,0 +1,55 @@
+#ifndef MPC_HPP
+#define MPC_HPP
+
+#include <stdint.h>
+
+#define MPC_HORIZON 20                     // steps looked ahead
+#define MPC_MAX_ITERATIONS (3 * MPC_HORIZON) // a cold start into saturation takes two per step, beyond that keep the best feasible plan
+
+// Model predictive control of the first order chamber model dP/dt = leakRate * (ambient - P) - pumpGain * u
+// over a fixed horizon. Each solve is a box constrained QP in the commands, tracking error plus effort plus
+// command rate, solved by a primal active set method with a Cholesky factorisation of the free block.
+// Everything is sized by MPC_HORIZON at compile time, nothing is allocated.
+class Mpc
+{
+public:
+    Mpc();
+
+    void setStep(float seconds);
+    void setWeights(float tracking, float effort, float rate);
+    void setLimits(float low, float high);
+    void reset(float command = 0);
+
+    bool solve(float pressure, const float *reference, float leakRate, float pumpGain, float ambient, float &command);
+
+    uint8_t getIterations();
+    const float *getPlan();
+
+private:
+    void buildProblem(float pressure, const float *reference, float leakRate, float pumpGain, float ambient);
+    bool solveFree(uint8_t *free, uint8_t count, float *solution);
+
+    enum boundState : uint8_t
+    {
+        FREE,
+        AT_LOW,
+        AT_HIGH
+    };
+
+    float step;
+    float trackingWeight;
+    float effortWeight;
+    float rateWeight;
+    float low;
+    float high;
+    float previous; // command applied over the last step, the rate term starts from it
+
+    float H[MPC_HORIZON][MPC_HORIZON]; // cost Hessian
+    float g[MPC_HORIZON];              // cost gradient at zero commands
+    float factor[MPC_HORIZON][MPC_HORIZON];
+    float plan[MPC_HORIZON];           // commands over the horizon, kept to warm start the next solve
+    boundState bound[MPC_HORIZON];
+    uint8_t iterations;
+};
+
+#endif // MPC_HPP
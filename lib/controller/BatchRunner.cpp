@@ -0,0 +1,308 @@
+#include "BatchRunner.h"
+
+BatchRunner::BatchRunner(Controller &controller_) : controller(controller_), numRuns(0), current(0), state(BATCH_IDLE),
+                                                    settleStartMillis(0), settledSinceMillis(0), lastSettleCheckMillis(0),
+                                                    settled(false), summary(256)
+{
+}
+
+bool BatchRunner::load(const char *manifest)
+{
+    if (state == BATCH_SETTLING || state == BATCH_RUNNING)
+    {
+        return false;
+    }
+
+    numRuns = 0;
+    current = 0;
+    state = BATCH_IDLE;
+
+    File file = SD.open(manifest, FILE_READ);
+    if (!file)
+    {
+        LOG_ERROR("Failed to open batch manifest: %s", manifest);
+        return false;
+    }
+
+    char line[128];
+    while (file.available())
+    {
+        size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+
+        if (numRuns >= BATCH_MAX_RUNS)
+        {
+            LOG_WARN("Batch manifest has more than %d runs, the rest are ignored", BATCH_MAX_RUNS);
+            break;
+        }
+
+        if (parseLine(line, runs[numRuns]))
+        {
+            numRuns++;
+        }
+    }
+
+    file.close();
+
+    LOG_INFO("Batch of %d runs: %s", numRuns, manifest);
+
+    return numRuns > 0;
+}
+
+bool BatchRunner::parseLine(char *line, batchRun &run)
+{
+    // up to three comma separated fields, surrounding spaces dropped
+    char *fields[3] = {nullptr, nullptr, nullptr};
+    uint8_t count = 0;
+    char *field = line;
+
+    while (field && count < 3)
+    {
+        char *comma = strchr(field, ',');
+        if (comma)
+        {
+            *comma = '\0';
+        }
+
+        while (*field == ' ' || *field == '\t')
+        {
+            field++;
+        }
+
+        char *end = field + strlen(field);
+        while (end > field && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        {
+            *--end = '\0';
+        }
+
+        fields[count++] = field;
+        field = comma ? comma + 1 : nullptr;
+    }
+
+    if (!fields[0][0] || fields[0][0] == '#' || strcasecmp(fields[0], "trajectory") == 0)
+    {
+        return false;
+    }
+
+    run.trajectory = fields[0];
+    run.gains = (count > 1) ? fields[1] : "";
+    run.alpha = (count > 2 && fields[2][0]) ? atof(fields[2]) : -1;
+
+    run.result = RUN_PENDING;
+    memset(&run.summary, 0, sizeof(run.summary));
+
+    return true;
+}
+
+bool BatchRunner::start()
+{
+    if (numRuns == 0 || state == BATCH_SETTLING || state == BATCH_RUNNING)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < numRuns; i++)
+    {
+        runs[i].result = RUN_PENDING;
+        memset(&runs[i].summary, 0, sizeof(runs[i].summary));
+    }
+
+    if (!summary.createFile("run, trajectory, gains, alpha, result, duration, rms error, max error, samples", BATCH_SUMMARY))
+    {
+        LOG_ERROR("Failed to create batch summary");
+        return false;
+    }
+
+    current = 0;
+    state = BATCH_SETTLING;
+    settleStartMillis = millis();
+    settled = false;
+
+    return true;
+}
+
+bool BatchRunner::service()
+{
+    unsigned long now = millis();
+
+    if (state == BATCH_SETTLING)
+    {
+        if (now - lastSettleCheckMillis < BATCH_SETTLE_CHECK_MS)
+        {
+            return true;
+        }
+        lastSettleCheckMillis = now;
+
+        if (!controller.chamberSettled())
+        {
+            settled = false;
+
+            if (now - settleStartMillis >= BATCH_SETTLE_TIMEOUT_MS)
+            {
+                LOG_ERROR("Chamber didn't return to base pressure, batch stopped");
+                abort();
+                return false;
+            }
+            return true;
+        }
+
+        // back at base pressure, held there for a while so it isn't just passing through
+        if (!settled)
+        {
+            settled = true;
+            settledSinceMillis = now;
+        }
+
+        if (now - settledSinceMillis < BATCH_SETTLE_HOLD_MS)
+        {
+            return true;
+        }
+
+        if (startRun())
+        {
+            state = BATCH_RUNNING;
+        }
+        else
+        {
+            finishRun(RUN_SKIPPED);
+        }
+        return true;
+    }
+
+    if (state == BATCH_RUNNING)
+    {
+        if (!controller.iterate())
+        {
+            finishRun(controller.runCompleted() ? RUN_OK : RUN_FAILED);
+            return (state == BATCH_SETTLING);
+        }
+
+        controller.serviceStream();
+        return true;
+    }
+
+    return false;
+}
+
+bool BatchRunner::startRun()
+{
+    batchRun &run = runs[current];
+
+    LOG_INFO("Batch run %d of %d: %s", current + 1, numRuns, run.trajectory.c_str());
+
+    // same order as the RUN page, with the settings from the manifest in place of the sliders
+    if (!controller.initDevices() || !controller.loadTrajectory(run.trajectory.c_str()))
+    {
+        LOG_ERROR("Batch run %d: can't open %s", current + 1, run.trajectory.c_str());
+        return false;
+    }
+
+    if (run.gains.length() && !controller.initGainSchedule(run.gains.c_str()))
+    {
+        LOG_ERROR("Batch run %d: can't load gains %s", current + 1, run.gains.c_str());
+        return false;
+    }
+
+    if (run.alpha >= 0)
+    {
+        controller.setAlpha(run.alpha);
+    }
+
+    if (!controller.initStream())
+    {
+        return false;
+    }
+
+    controller.initPID();
+
+    return controller.run(BATCH_RUN_LOG);
+}
+
+void BatchRunner::finishRun(batchResult result)
+{
+    controller.stop();
+
+    batchRun &run = runs[current];
+    run.result = result;
+    if (result != RUN_SKIPPED)
+    {
+        run.summary = controller.getRunSummary();
+    }
+
+    writeSummaryLine(run);
+
+    LOG_INFO("Batch run %d: %s", current + 1, resultName(result));
+
+    if (++current >= numRuns)
+    {
+        state = BATCH_DONE;
+        return;
+    }
+
+    // the next run waits for the chamber to leak back up
+    state = BATCH_SETTLING;
+    settleStartMillis = millis();
+    settled = false;
+}
+
+void BatchRunner::abort()
+{
+    if (state == BATCH_RUNNING)
+    {
+        finishRun(RUN_ABORTED);
+    }
+
+    controller.stop();
+
+    // runs that never started are left out of the summary
+    state = BATCH_ABORTED;
+}
+
+bool BatchRunner::writeSummaryLine(const batchRun &run)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%d,%s,%s,%.2f,%s,%.2f,%.1f,%.1f,%lu\n", current + 1, run.trajectory.c_str(), run.gains.c_str(),
+             run.alpha, resultName(run.result), run.summary.duration, run.summary.rmsError, run.summary.maxError,
+             (unsigned long)run.summary.samples);
+
+    bool written = summary.writeToBuffer(line);
+    summary.flushBuffer();
+    return written;
+}
+
+batchState BatchRunner::getState()
+{
+    return state;
+}
+
+uint8_t BatchRunner::getNumRuns()
+{
+    return numRuns;
+}
+
+uint8_t BatchRunner::getCurrentRun()
+{
+    return current;
+}
+
+const batchRun &BatchRunner::getRun(uint8_t index)
+{
+    return runs[min(index, (uint8_t)(BATCH_MAX_RUNS - 1))];
+}
+
+const char *BatchRunner::resultName(batchResult result)
+{
+    switch (result)
+    {
+    case RUN_OK:
+        return "ok";
+    case RUN_FAILED:
+        return "failed";
+    case RUN_SKIPPED:
+        return "skipped";
+    case RUN_ABORTED:
+        return "aborted";
+    default:
+        return "pending";
+    }
+}
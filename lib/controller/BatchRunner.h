@@ -0,0 +1,92 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "Arduino.h"
+#include <SD.h>
+#include "Debug.hpp"
+#include "Controller.h"
+#include "SD.hpp"
+
+#define BATCH_MANIFEST "/BATCH/queue.csv"
+#define BATCH_SUMMARY "/BATCH/summary" // Sd-style prefix, a new _N.csv per batch
+#define BATCH_RUN_LOG "/BATCH/run"     // per-run logs written by the controller, _N.csv
+#define BATCH_MAX_RUNS 16
+
+// between runs the chamber has to be back at the base pressure and stay there this long
+#define BATCH_SETTLE_HOLD_MS 2000
+#define BATCH_SETTLE_TIMEOUT_MS 120000 // gives up on the batch, the chamber isn't leaking back up
+#define BATCH_SETTLE_CHECK_MS 100
+
+enum batchState
+{
+    BATCH_IDLE,
+    BATCH_SETTLING, // waiting for the chamber to re-equilibrate before the next run
+    BATCH_RUNNING,
+    BATCH_DONE,
+    BATCH_ABORTED,
+};
+
+enum batchResult : uint8_t
+{
+    RUN_PENDING,
+    RUN_OK,       // reached the end of the trajectory
+    RUN_FAILED,   // stopped early by the controller: out of bounds, lost reading, interlock
+    RUN_SKIPPED,  // couldn't be started: missing file, bad gains, devices
+    RUN_ABORTED,  // stopped from the UI
+};
+
+struct batchRun
+{
+    pathString trajectory; // file streamed for the run
+    pathString gains;      // gain schedule, empty keeps the one loaded
+    float alpha;       // reading filter, below 0 keeps the current one
+
+    batchResult result;
+    runSummary summary; // the controller's metrics once the run has ended
+};
+
+// Runs a queue of trajectories back to back without the UI. The queue comes from a manifest on the card, one run
+// per line:
+//   trajectory, gains, alpha        e.g. /TRAJ/ALT1K.CSV, /CONTROL/gains.csv, 0.5
+// gains and alpha may be left empty; blank lines, '#' comments and a "trajectory" header are skipped.
+// service() is called from the page loop and never blocks for longer than a control tick. Each run is logged to its
+// own file and appended to a summary table as soon as it ends, so a pulled plug keeps the finished rows.
+class BatchRunner
+{
+public:
+    BatchRunner(Controller &controller_);
+
+    bool load(const char *manifest = BATCH_MANIFEST);
+    bool start();
+    bool service();
+    void abort();
+
+    batchState getState();
+    uint8_t getNumRuns();
+    uint8_t getCurrentRun();
+    const batchRun &getRun(uint8_t index);
+
+    static const char *resultName(batchResult result);
+
+private:
+    bool parseLine(char *line, batchRun &run);
+    bool startRun();
+    void finishRun(batchResult result);
+    bool writeSummaryLine(const batchRun &run);
+
+    Controller &controller;
+
+    batchRun runs[BATCH_MAX_RUNS];
+    uint8_t numRuns;
+    uint8_t current;
+    batchState state;
+
+    unsigned long settleStartMillis;
+    unsigned long settledSinceMillis;
+    unsigned long lastSettleCheckMillis;
+    bool settled;
+
+    Sd summary; // one line per run, flushed as each run ends
+};
+
+#endif // BATCH_RUNNER_H
@@ -1,17 +1,52 @@
 #include "Controller.h"
+#include "ROCKET_SIM.h"
 #include <algorithm>
 
-Controller::Controller() : running(false), calibrationRunning(false), sensorInitialised(false), sdInitialised(false), dataInitialised(false), gainScheduleInitialised(false), alpha(0.5), logFreq(20)
+Controller::Controller() : streaming(false), running(false), calibrationRunning(false), dataInitialised(false), gainScheduleInitialised(false), alpha(0.5), logFreq(20)
 {
     logTime = 1000000 / logFreq; // convert to microseconds
+
+    // watches the pump from a timer interrupt, see SafetyMonitor
+    safetyMonitor.begin(pump);
 }
 
 bool Controller::initDevices(float alpha_)
 {
-    sdInitialised = sd.init(SD_CS);
-    sensorInitialised = initSensor(alpha_);
+    filteredReading = 101325; // initial guess of sea level pressure. We want to reset it here upon reuse
+
+    if (devices.getSensorState() == DEVICE_UNINITIALISED)
+    {
+        setAlpha(alpha_); // later calls keep the filter the settings page chose
+    }
+
+    // devices are only brought up the first time, after that this is a probe of each
+    bool ready = devices.begin();
+
+    // the base pressure is kept and tracked between runs, just check it still matches a settled chamber.
+    // Straight after a run the chamber may still be below ambient, the tracked value is newer than that anyway
+    if (ready && ambientSettled())
+    {
+        ready = pressureSensor.checkBasePressure();
+    }
+
+    return ready;
+}
+
+bool Controller::devicesReady()
+{
+    return devices.ready();
+}
+
+void Controller::serviceIdle()
+{
+    // called from every page loop: the run and calibration loops handle their own device errors
+    if (running || calibrationRunning)
+    {
+        return;
+    }
 
-    return sdInitialised && sensorInitialised;
+    devices.service();
+    trackAmbient();
 }
 
 void Controller::calibrateBasePressure()
@@ -19,139 +54,226 @@ void Controller::calibrateBasePressure()
     pressureSensor.calibrateBasePressure();
 }
 
-Controller::~Controller()
+void Controller::trackAmbient()
 {
-    // Ensure the controller is stopped
-    if (running)
+    // idle pages call this every loop, the sensor rate limits itself
+    if (devices.sensorReady() && ambientSettled())
     {
-        stop();
+        pressureSensor.trackBasePressure();
     }
 }
 
-bool Controller::initData(sim_data &data_)
+bool Controller::chamberSettled()
 {
-    // initialise gain schedules
-    initGainSchedule();
+    // back at the base pressure the leak pulls it to, no need to wait out AMBIENT_SETTLE_MS.
+    // Input is offset so the base pressure reads ABSOLUTE_BASE_PA, whatever ambient actually is
+    if (running || calibrationRunning || !devices.sensorReady() || !updateReading())
+    {
+        return false;
+    }
 
-    data = &data_;
-    dataInitialised = true;
+    return fabs(Input - ABSOLUTE_BASE_PA) <= AMBIENT_SETTLED_PA;
+}
 
-    // DBG("data: " + String(dataInitialised) + " sensor: " + String(sensorInitialised) + " sd: " + String(sdInitialised));
+bool Controller::ambientSettled()
+{
+    return !running && !calibrationRunning && (millis() - pumpActiveMillis >= AMBIENT_SETTLE_MS);
+}
 
-    return dataInitialised && sensorInitialised && gainScheduleInitialised;
+Controller::~Controller()
+{
+    // Ensure the controller is stopped
+    if (running)
+    {
+        stop();
+    }
 }
 
-bool Controller::initGainSchedule(String filePath)
+bool Controller::initGains()
 {
-    // there should be a file on the SD card that contains the gain schedules for the controller
-    // the file should be in the format:
-    // Kp, Ki, Kd, pressure
+    // gain schedule is kept in RAM between runs (and replaced from gainSelectPage()), only load it if we don't have one yet
+    if (!gainScheduleInitialised && !initGainSchedule())
+    {
+        loadDefaultGainSchedule(gainSchedule);
+        gainScheduleInitialised = true;
+        LOG_WARN("Using built-in gain schedule");
+    }
 
-    // read the file and populate the gain schedule array
+    return gainScheduleInitialised;
+}
 
-    if (sdInitialised)
+void Controller::initPumpCurve()
+{
+    // measured by the last calibration, the straight line until there is one
+    if (!pumpCurveLoaded && devices.sdReady())
     {
-        gainScheduleInitialised = sd.loadGainsFromFile(filePath.c_str(), gainSchedule);
-        if (!gainScheduleInitialised)
+        if (sd.loadPumpCurve(PUMP_CURVE_PATH, pumpCurve))
         {
-            DBG("Failed to load gain schedule from SD card");
+            LOG_INFO("Loaded pump curve: %s", PUMP_CURVE_PATH);
         }
         else
         {
-            DBG("Gain schedule initialised");
+            LOG_WARN("No pump curve, pump taken as linear");
         }
+        pumpCurveLoaded = true;
     }
-    else
-    {
-        DBG("SD card not initialised");
-        gainScheduleInitialised = false;
-    }
+}
 
-    return gainScheduleInitialised;
+void Controller::sendPumpCommand(double output)
+{
+    // the PID asks for a share of the pump's effect, the curve turns that into the duty that delivers it
+    float duty = pumpCurve.apply(fabs(output), Input);
+    pump.sendCommand((output < 0) ? -duty : duty);
 }
 
-void Controller::getFilesInFolder(String folderName, String files[], int maxFiles, int &fileCount, String extension)
+bool Controller::measureFlow(uint8_t level)
 {
-    fileCount = 0;
+    // one window per duty level: wait for the flow to settle, then the pressure slope over the rest is the flow.
+    // Returns true when the window is done and the next level can start
+    unsigned long now = millis();
 
-    File folder = SD.open(folderName);
+    if (!sweepSettled && (now - sweepStartMillis >= PUMP_CURVE_SETTLE_MS))
+    {
+        sweepSettled = true;
+        sweepSettledMillis = now;
+        sweepStartPressure = Input;
+    }
 
-    if (!folder)
+    if (now - sweepStartMillis < PUMP_CURVE_DWELL_MS)
     {
-        DBG("Failed to open folder: " + folderName);
-        return;
+        return false;
     }
 
-    // Loop through all the files in the folder
-    while (true)
+    float seconds = (now - sweepSettledMillis) / 1000.0f;
+    if (sweepSettled && (seconds > 0))
     {
-        File file = folder.openNextFile(); // Open the next file
-        if (!file)
-        {
-            // No more files
-            break;
-        }
+        pumpCurve.addMeasurement(level, 0.5f * (sweepStartPressure + Input), (sweepStartPressure - Input) / seconds);
+    }
 
-        if (file.isDirectory())
-        {
-            file.close();
-            continue;
-        }
+    sweepStartMillis = now;
+    sweepSettled = false;
+    return true;
+}
 
-        if (fileCount >= maxFiles)
-        {
-            DBG("Maximum number of files reached");
-            file.close();
-            break;
-        }
+bool Controller::initData(sim_data &data_)
+{
+    initGains();
+    initPumpCurve();
 
-        if (String(file.name()).endsWith(extension))
-        {
-            // Add the file name to the array
-            files[fileCount] = file.name();
-            fileCount++;
-        }
+    data = &data_;
+    streaming = false;
 
-        file.close();
-    }
+    // the run needs pressure, profiles drawn on the POINT page only have altitude
+    dataInitialised = (data_.num_points > 1) && ROCKET_SIM::fillColumns(data_, SIM_TIME | SIM_PRESSURE);
+
+    // DBG("data: " + String(dataInitialised) + " sensor: " + String(devices.sensorReady()) + " sd: " + String(devices.sdReady()));
 
-    folder.close();
+    return dataInitialised && devices.sensorReady() && gainScheduleInitialised;
 }
 
-bool Controller::initSensor(float alpha_)
+bool Controller::loadTrajectory(const char *filePath)
 {
-    filteredReading = 101325; // initial guess of sea level pressure. We want to reset it here upon reuse
-
-    if (sensorInitialised)
+    // opens and scans the file, the trajectory itself is streamed during the run
+    if (!devices.sdReady())
     {
-        DBG("Testing sensor connection");
-        sensorInitialised = pressureSensor.testConnection();
-        return sensorInitialised;
+        LOG_ERROR("SD card not initialised");
+        return false;
     }
 
-    // removed the check for sensorInitialised because we want to reset the sensor
+    return trajectory.open(filePath);
+}
+
+bool Controller::initStream()
+{
+    initGains();
+    initPumpCurve();
+
+    // start playback from the beginning of the file loaded with loadTrajectory()
+    streaming = trajectory.rewind();
+    dataInitialised = streaming;
 
-    setAlpha(alpha_);
-    sensorInitialised = pressureSensor.begin(I2C_SDA, I2C_SCL, 0x76); // initialise BMP280 sensor
+    return dataInitialised && devices.sensorReady() && gainScheduleInitialised;
+}
 
-    if (sensorInitialised)
+bool Controller::serviceStream()
+{
+    // refill the idle trajectory buffer, called from the UI loop between control ticks
+    return streaming && trajectory.prefetch();
+}
+
+float Controller::getTrajectoryDuration()
+{
+    return trajectory.getDuration();
+}
+
+float Controller::getTrajectoryApogee()
+{
+    // lowest pressure is the highest point
+    return ROCKET_SIM::pressureToAltitude(trajectory.getMinPressure());
+}
+
+bool Controller::initGainSchedule(const char *filePath)
+{
+    // there should be a file on the SD card that contains the gain schedules for the controller
+    // the file should be in the format:
+    // Kp, Ki, Kd, pressure
+
+    // read the file and populate the gain schedule array. The parsed rows are cached next to
+    // the file in binary form, so the CSV is only parsed again after it changes
+
+    if (devices.sdReady())
     {
-        DBG("Sensor initialised");
-        return true;
+        gainScheduleInitialised = sd.loadGainSchedule(filePath, gainSchedule);
+        if (!gainScheduleInitialised)
+        {
+            LOG_ERROR("Failed to load gain schedule from SD card");
+        }
+        else
+        {
+            LOG_INFO("Gain schedule initialised");
+        }
     }
     else
     {
-        DBG("Sensor failed to initialise");
-        return false;
+        LOG_ERROR("SD card not initialised");
+        gainScheduleInitialised = false;
     }
+
+    return gainScheduleInitialised;
 }
 
-bool Controller::run()
+bool Controller::run(const char *logPrefix)
 {
-    if (sensorInitialised && dataInitialised && gainScheduleInitialised)
+    if (devices.sensorReady() && dataInitialised && gainScheduleInitialised)
     {
         running = true;
+        completed = false;
         startMillis = millis();
+        dataCursor = 1;
+        metrics.begin();
+
+        runLogging = devices.sdReady() && sd.createIndexedFile("time, setpoint, pressure, output", logPrefix, {0, 2, 1});
+        if (!runLogging)
+        {
+            LOG_WARN("Run not logged");
+        }
+        lastLogTime = micros() - logTime; // first tick is logged
+
+        safetyMonitor.clearTrip();
+        safetyMonitor.arm(safePressureLow, safePressureHigh);
+
+        if (mode == CONTROL_MPC)
+        {
+            if (!pumpCurve.isMeasured())
+            {
+                LOG_WARN("No measured pump curve, MPC falls back to PID");
+            }
+
+            mpc.setStep(MPC_STEP_MS / 1000.0f);
+            mpc.reset();
+            lastMpcMillis = startMillis - MPC_STEP_MS; // plan on the first tick
+        }
+
         return true;
     }
     else
@@ -168,14 +290,14 @@ bool Controller::initCalibrateSystem(float setPointPressure)
 
     calibrationState = ground; // set initial state
 
-    String alpha_str = String((uint8_t)(alpha * 100)); // Convert float to String
-    alpha_str.replace('.', '_');                       // Replace '.' with '_'
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "/CALIB/a_%u", (uint8_t)(alpha * 100)); // alpha in hundredths
 
-    bool fileCreated = sd.createFile("state, time, pressure", String("/CALIB/a_" + alpha_str));
+    bool fileCreated = sd.createIndexedFile("state, time, pressure", prefix, {1, 2, LOG_NO_COLUMN});
 
-    DBG("sensor: " + String(sensorInitialised) + " sd: " + String(sdInitialised) + " file: " + String(fileCreated));
+    LOG_INFO("sensor: %d sd: %d file: %d", devices.sensorReady(), devices.sdReady(), fileCreated);
 
-    initialised = sensorInitialised && sdInitialised && fileCreated;
+    initialised = devices.sensorReady() && devices.sdReady() && fileCreated;
 
     return initialised;
 }
@@ -183,24 +305,27 @@ bool Controller::initCalibrateSystem(float setPointPressure)
 bool Controller::startCalibrateSystem()
 {
 
-    if (sensorInitialised && sdInitialised)
+    if (devices.sensorReady() && devices.sdReady())
     {
         if ((!calibrationRunning))
         {
             calibrationRunning = true;
             startMillis = millis();
             currentSeconds = 0;
+
+            safetyMonitor.clearTrip();
+            safetyMonitor.arm(safePressureLow, safePressureHigh);
         }
 
         if (!updateReading())
         {
-            DBG("Failed to get pressure reading");
+            LOG_WARN("Failed to get pressure reading");
             calibrationRunning = false;
         }
 
-        if (!LogDesiredData(String(calibrationState), true))
+        if (!LogDesiredData(calibrationState, true))
         {
-            DBG("Failed to log data to SD");
+            LOG_ERROR("Failed to log data to SD");
 
             calibrationRunning = false;
         }
@@ -208,33 +333,37 @@ bool Controller::startCalibrateSystem()
     return calibrationRunning;
 }
 
-bool Controller::LogDesiredData(String stateData, bool forceLog)
+bool Controller::LogDesiredData(int state, bool forceLog)
 {
-    if (forceLog)
-    {
-        String dataEntry = stateData + String(",") + String(currentSeconds) + String(",") + String(Input) + String("\n");
-        lastLogTime = micros();
-        return sd.writeToBuffer(dataEntry);
-    }
-    else
+    if (!forceLog)
     {
         timePassed = micros() - lastLogTime;
-        if (timePassed >= logTime)
+        if (timePassed < logTime)
         {
-            String dataEntry = stateData + String(",") + String(currentSeconds) + String(",") + String(Input) + String("\n");
-            lastLogTime = micros();
-            return sd.writeToBuffer(dataEntry);
+            return true; // will only return false if failed to write to buffer
         }
     }
-    return true; // will only return false if failed to write to buffer
+
+    char dataEntry[48];
+    snprintf(dataEntry, sizeof(dataEntry), "%d,%.2f,%.2f\n", state, currentSeconds, Input);
+    lastLogTime = micros();
+    return sd.writeSample(dataEntry, currentSeconds, Input, calibrationSetPointPressure);
 }
 
 bool Controller::calibrateIterate()
 {
     bool calibrating = true;
 
+    if (calibrationRunning && interlockTripped())
+    {
+        calibrationProgress = 0;
+        return false;
+    }
+
     if (calibrationRunning && updateReading())
     {
+        pumpActiveMillis = millis();
+
         calibrating = (Input >= (safePressureLow) && Input <= (safePressureHigh)); // check if reading is within bounds (-100m to 10,000m)
 
         if (!calibrating)
@@ -243,7 +372,7 @@ bool Controller::calibrateIterate()
             calibrationRunning = false;
             calibrationProgress = 0;
 
-            DBG("Failed to get pressure reading or out of bounds");
+            LOG_ERROR("Failed to get pressure reading or out of bounds: %f Pa", Input);
             return false;
         }
 
@@ -253,7 +382,12 @@ bool Controller::calibrateIterate()
         {
             if (currentSeconds >= 5)
             {
-                pump.sendCommand(100.0); // pump max speed
+                // step through the duty levels on the way down, the flow at each one builds the pump curve
+                pumpCurve.beginMeasurement();
+                sweepLevel = 1;
+                sweepStartMillis = millis();
+                sweepSettled = false;
+                pump.sendCommand(PumpCurve::levelDuty(sweepLevel));
                 calibrationState = pumping;
             }
         }
@@ -261,9 +395,17 @@ bool Controller::calibrateIterate()
         {
             calibrationProgress = 0.5 * (1 - ((Input - calibrationSetPointPressure) / (pressureSensor.getBasePressure() - calibrationSetPointPressure)));
 
+            if (measureFlow(sweepLevel))
+            {
+                sweepLevel = (sweepLevel % (PUMP_CURVE_COMMANDS - 1)) + 1;
+                pump.sendCommand(PumpCurve::levelDuty(sweepLevel));
+            }
+
             if (Input <= calibrationSetPointPressure)
             {
                 pump.sendCommand(0.0);
+                sweepStartMillis = millis();
+                sweepSettled = false;
                 calibrationState = leaking;
             }
         }
@@ -271,18 +413,32 @@ bool Controller::calibrateIterate()
         {
             calibrationProgress = 0.5 * (1 + max(0.0, ((Input - calibrationSetPointPressure) / (pressureSensor.getBasePressure() - calibrationSetPointPressure))));
 
+            measureFlow(0); // the leak, what the pump works against at each pressure
+
             if (Input >= (pressureSensor.getBasePressure() - 100)) // take of a little bit of pressure to account for noise and drift
             {
+                if (!pumpCurve.build())
+                {
+                    LOG_WARN("Pump curve not measured, keeping the previous one");
+                }
+                else if (!sd.savePumpCurve(PUMP_CURVE_PATH, pumpCurve))
+                {
+                    LOG_WARN("Failed to save pump curve: %s", PUMP_CURVE_PATH); // still used until the next restart
+                }
+                pumpCurveLoaded = true;
+
                 stop();
                 calibrationProgress = 1;
                 calibrationRunning = false;
                 calibrating = false;
             }
         }
+        sendTelemetry(TELEMETRY_CALIBRATE_GROUND + calibrationState);
+
         // DBG(pressureSensor.getBasePressure());
-        if (!LogDesiredData(String(calibrationState), false))
+        if (!LogDesiredData(calibrationState, false))
         {
-            DBG("Failed to log data to SD");
+            LOG_ERROR("Failed to log data to SD");
             calibrationRunning = false;
             calibrating = false;
         }
@@ -292,19 +448,21 @@ bool Controller::calibrateIterate()
 
 bool Controller::updateGains()
 {
-    // gain schedule array should be sorted from lowest to highest operating pressure
+    PROFILE_SCOPE(PROBE_UPDATE_GAINS);
+
+    // gain schedule array is sorted from lowest to highest operating pressure when it is loaded
     // for efficiency but also to ensure that the correct gains are selected
     if (!gainScheduleInitialised)
     {
-        DBG("Gain schedule not initialised");
+        LOG_ERROR("Gain schedule not initialised");
         return false;
     }
 
     // initialise gains incase we don't find a match
 
-    Kp = abs(gainSchedule.data[-1][0]);
-    Ki = abs(gainSchedule.data[-1][1]);
-    Kd = abs(gainSchedule.data[-1][2]);
+    Kp = abs(gainSchedule.data[gainSchedule.height - 1][0]);
+    Ki = abs(gainSchedule.data[gainSchedule.height - 1][1]);
+    Kd = abs(gainSchedule.data[gainSchedule.height - 1][2]);
 
     for (int i = 0; i < gainSchedule.height; i++)
     {
@@ -328,9 +486,88 @@ bool Controller::updateGains()
 
 void Controller::stop()
 {
+    if (running)
+    {
+        endRun(false);
+    }
+
     calibrationRunning = false;
     running = false;
     pump.sendCommand(0.0);
+    pumpActiveMillis = millis();
+    safetyMonitor.disarm();
+    sd.closeFile(); // finishes the calibration log and its index
+}
+
+void Controller::endRun(bool reachedEnd)
+{
+    // every way a run ends comes through here once
+    pump.sendCommand(0.0);
+    running = false;
+    completed = reachedEnd;
+
+    if (runLogging)
+    {
+        sd.closeFile();
+        runLogging = false;
+    }
+
+    if (!saveRunSummary())
+    {
+        LOG_WARN("Failed to save run summary: %s", RUN_SUMMARY_PATH);
+    }
+
+    LOG_INFO("Heap operations during the run: %lu, largest free block %u", (unsigned long)metrics.getSummary().heapOperations,
+             (unsigned)HeapStats::getLargestFreeBlock());
+}
+
+void Controller::logRunSample()
+{
+    // logFreq, into the buffer; the card is only written when the buffer fills
+    unsigned long now = micros();
+    if (now - lastLogTime < logTime)
+    {
+        return;
+    }
+    lastLogTime = now;
+
+    char line[64];
+    snprintf(line, sizeof(line), "%.3f,%.1f,%.1f,%.2f\n", currentSeconds, Setpoint, Input, Output);
+    sd.writeSample(line, currentSeconds, Input, Setpoint);
+}
+
+bool Controller::saveRunSummary()
+{
+    if (!devices.sdReady())
+    {
+        return false;
+    }
+
+    runSummary summary = metrics.getSummary();
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s,%s,%.2f,%lu,%.1f,%.1f,%.1f,%.3f,%.2f,%lu,%lu,%lu,%lu", (mode == CONTROL_MPC) ? "MPC" : "PID",
+             completed ? "completed" : "stopped", summary.duration, (unsigned long)summary.samples, summary.rmsError, summary.maxError,
+             summary.apogeeError, summary.lag, summary.saturatedTime, (unsigned long)summary.loopP50Us, (unsigned long)summary.loopP95Us,
+             (unsigned long)summary.loopP99Us, (unsigned long)summary.loopMaxUs);
+
+    return sd.appendLine(RUN_SUMMARY_PATH,
+                         "mode, result, duration, samples, rms error, max error, apogee error, lag, saturated, loop p50, loop p95, loop p99, loop max",
+                         line);
+}
+
+bool Controller::interlockTripped()
+{
+    // the pump is already off, this only ends the run
+    safetyTrip trip = safetyMonitor.getTrip();
+    if (trip == SAFETY_OK)
+    {
+        return false;
+    }
+
+    LOG_ERROR("Safety interlock tripped (%d), pump off after %lu us", trip, (unsigned long)safetyMonitor.getTripLatencyMicros());
+    stop();
+    return true;
 }
 
 float Controller::getCalibrationProgress()
@@ -345,17 +582,21 @@ void Controller::setCalibrationProgress(float calibrationProgress_)
 
 bool Controller::updateReading()
 {
+    PROFILE_SCOPE(PROBE_UPDATE_READING);
+
     float rawReading = pressureSensor.getPressure(true);
 
     if (rawReading == -1)
     {
-        DBG("Failed to get pressure reading");
+        LOG_WARN("Failed to get pressure reading");
         return false;
     }
 
     filteredReading = ((1 - alpha) * rawReading) + (alpha * filteredReading);
     Input = filteredReading;
 
+    safetyMonitor.feed(Input);
+
     return true;
 }
 
@@ -378,10 +619,16 @@ float Controller::getAlpha()
 
 bool Controller::iterate()
 {
-    int i = 1; // first value seems to always be 0 for pressure which causes issues
+    PROFILE_SCOPE(PROBE_ITERATE);
+
+    if (running && interlockTripped())
+    {
+        return false;
+    }
 
     if (running)
     {
+        pumpActiveMillis = millis();
         currentSeconds = (float(millis()) - float(startMillis)) / 1000.0f; // time since start in seconds
 
         running = updateReading();
@@ -390,46 +637,174 @@ bool Controller::iterate()
 
         if (!running)
         {
-            pump.sendCommand(0.0);
-            DBG("Failed to get pressure reading or out of bounds");
+            LOG_ERROR("Failed to get pressure reading or out of bounds: %f Pa", Input);
+            endRun(false);
             return false;
         }
 
-        // find closest time in data
-        for (i; i < data->num_points; i++)
+        if (streaming)
         {
-            if (data->time[i] >= currentSeconds)
+            float pressure;
+
+            if (!trajectory.sample(currentSeconds, pressure))
             {
-                i++;
-                break;
+                endRun(true);
+                return false;
             }
-        }
 
-        if (data->time[data->num_points] <= currentSeconds)
-        {
-            pump.sendCommand(0.0);
-            running = false;
-            return running;
+            Setpoint = pressure;
         }
+        else
+        {
+            // points aren't evenly spaced, interpolate between the two either side of now
+            float pressure;
+
+            if (!ROCKET_SIM::samplePressure(*data, currentSeconds, dataCursor, pressure))
+            {
+                endRun(true);
+                return false;
+            }
 
-        Setpoint = float(data->pressure[i]);
+            Setpoint = pressure;
+        }
 
         running = updateGains();
-        control_pid.Compute();
+
+        if ((mode == CONTROL_MPC) && pumpCurve.isMeasured())
+        {
+            computeMpc();
+        }
+        else
+        {
+            PROFILE_SCOPE(PROBE_PID_COMPUTE);
+            control_pid.Compute();
+        }
 
         // DBG("Setpoint: " + String(Setpoint) + " Input: " + String(Input) + " Output: " + String(Output));
 
-        pump.sendCommand(Output);
+        sendPumpCommand(Output);
+
+        sendTelemetry(TELEMETRY_RUN);
+
+        metrics.add(micros(), Setpoint, Input, Output);
+
+        if (runLogging)
+        {
+            logRunSample();
+        }
 
         return true;
     }
     else
     {
         pump.sendCommand(0.0);
-        DBG("Controller not running");
+        LOG_DEBUG("Controller not running");
+        return false;
+    }
+}
+
+bool Controller::computeMpc()
+{
+    // holds Output between re-plans like the PID does between samples
+    unsigned long now = millis();
+    if (now - lastMpcMillis < MPC_STEP_MS)
+    {
+        return false;
+    }
+    lastMpcMillis = now;
+
+    PROFILE_SCOPE(PROBE_MPC_SOLVE);
+
+    // setpoints over the horizon, the step after now first
+    float reference[MPC_HORIZON];
+    int cursor = dataCursor;
+    for (uint8_t k = 0; k < MPC_HORIZON; k++)
+    {
+        if (!referenceAt(currentSeconds + (k + 1) * (MPC_STEP_MS / 1000.0f), cursor, reference[k]))
+        {
+            reference[k] = (k > 0) ? reference[k - 1] : Setpoint; // past the end, hold the last one
+        }
+    }
+
+    float leakRate, pumpGain;
+    pumpCurve.model(Input, leakRate, pumpGain);
+
+    float command;
+    if (!mpc.solve(Input, reference, leakRate, pumpGain, PUMP_CURVE_AMBIENT, command))
+    {
+        LOG_DEBUG("MPC stopped after %d iterations", mpc.getIterations());
+    }
+
+    Output = -command; // same sign as the PID output, the pump only sucks
+
+    return true;
+}
+
+bool Controller::referenceAt(float time, int &cursor, float &pressure)
+{
+    // read ahead without moving the playback position
+    if (streaming)
+    {
+        return trajectory.peek(time, pressure);
+    }
+
+    return ROCKET_SIM::samplePressure(*data, time, cursor, pressure);
+}
+
+void Controller::setControlMode(controlMode mode_)
+{
+    mode = mode_;
+}
+
+controlMode Controller::getControlMode()
+{
+    return mode;
+}
+
+void Controller::sendTelemetry(uint8_t state)
+{
+#ifdef ENABLE_TELEMETRY
+    // queued for Telemetry::service() in the UI loop, never waits on the UART
+    telemetryControlSample sample;
+    sample.timeUs = micros();
+    sample.setpoint = Setpoint;
+    sample.input = Input;
+    sample.output = Output;
+    sample.kp = Kp;
+    sample.ki = Ki;
+    sample.kd = Kd;
+    sample.state = state;
+
+    telemetry.send(TELEMETRY_CONTROL, &sample, sizeof(sample));
+#endif // ENABLE_TELEMETRY
+}
+
+#ifdef ENABLE_PROFILER
+bool Controller::saveProfile()
+{
+    // one line per probe, times in microseconds
+    if (!devices.sdReady() || !sd.createFile("probe, count, min, avg, p99, max", "/PROFILE/prof"))
+    {
         return false;
     }
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        profileStats stats = profiler.getStats(i);
+
+        char line[80];
+        snprintf(line, sizeof(line), "%s,%lu,%.2f,%.2f,%.2f,%.2f\n", Profiler::getName(i), (unsigned long)stats.count,
+                 stats.minNs / 1000.0f, stats.avgNs / 1000.0f, stats.p99Ns / 1000.0f, stats.maxNs / 1000.0f);
+
+        sd.writeToBuffer(line);
+    }
+
+    // closed here, the Sd is shared and the next run's createFile() may be a long way off
+    sd.closeFile();
+
+    return true;
 }
+#endif // ENABLE_PROFILER
 
 float Controller::getLatestTime()
 {
@@ -441,7 +816,29 @@ float Controller::getLatestPressure()
     return Input;
 }
 
+void Controller::getGains(double &Kp_, double &Ki_, double &Kd_)
+{
+    Kp_ = Kp;
+    Ki_ = Ki;
+    Kd_ = Kd;
+}
+
 float Controller::getLatestSetpoint()
 {
     return float(Setpoint);
 }
+
+float Controller::getLatestOutput()
+{
+    return float(Output);
+}
+
+bool Controller::runCompleted()
+{
+    return completed;
+}
+
+runSummary Controller::getRunSummary()
+{
+    return metrics.getSummary();
+}
@@ -9,6 +9,34 @@
 #include "Debug.hpp"
 #include "SD.hpp"
 #include "gainScheduleData.h"
+#include "TrajectoryStream.h"
+#include "Telemetry.h"
+#include "Profiler.hpp"
+#include "HeapStats.hpp"
+#include "DeviceManager.h"
+#include "PumpCurve.h"
+#include "Mpc.hpp"
+#include "SafetyMonitor.h"
+#include "RunMetrics.h"
+
+// the chamber needs this long with the pump off to leak back to ambient before its readings count as base pressure
+#define AMBIENT_SETTLE_MS 10000
+// or it is back within this of the base pressure, what back to back runs wait for
+#define AMBIENT_SETTLED_PA 50
+
+// one line per run with its RunMetrics summary, kept across runs and restarts
+#define RUN_SUMMARY_PATH "/RESULTS/runs.csv"
+// every run logs time, setpoint, pressure and output at logFreq with a LogIndex sidecar, _N.csv
+#define RUN_LOG_PREFIX "/RUNS/run"
+
+// MPC re-plans at the PID sample time, so the horizon covers MPC_HORIZON * MPC_STEP_MS of the trajectory
+#define MPC_STEP_MS 100
+
+enum controlMode
+{
+    CONTROL_PID,
+    CONTROL_MPC, // needs a measured pump curve for its model, runs as PID without one
+};
 
 class Controller
 {
@@ -16,20 +44,31 @@ public:
     Controller();
     ~Controller();
     bool initData(sim_data &data_);
+    bool loadTrajectory(const char *filePath);
+    bool initStream();
+    bool serviceStream();
+    float getTrajectoryDuration();
+    float getTrajectoryApogee();
     bool initDevices(float alpha_ = 0.5);
-    bool run();
+    bool devicesReady();
+    void serviceIdle();
+    bool run(const char *logPrefix = RUN_LOG_PREFIX);
     void stop();
     bool iterate();
+    bool runCompleted();
+    runSummary getRunSummary();
+    bool chamberSettled();
     float getLatestTime();
     float getLatestPressure();
     float getLatestSetpoint();
+    float getLatestOutput();
+    void getGains(double &Kp_, double &Ki_, double &Kd_);
     bool calibrateSystem(float setPoint);
     bool initCalibrateSystem(float setPoint);
-    bool LogDesiredData(String stateData, bool forceLog);
+    bool LogDesiredData(int state, bool forceLog);
     bool startCalibrateSystem();
     bool calibrateIterate();
     bool updateReading();
-    bool initSensor(float alpha_ = 0.5);
     float getCalibrationProgress();
     void setCalibrationProgress(float calibrationProgress_);
     void calibrateBasePressure();
@@ -37,15 +76,38 @@ public:
     void initPID();
 
     bool updateGains();
-    bool initGainSchedule(String filePath = "/CONTROL/gains.csv");
-    void getFilesInFolder(String folderName, String files[], int maxFiles, int &fileCount, String extension);
+    bool initGainSchedule(const char *filePath = "/CONTROL/gains.csv");
+#ifdef ENABLE_PROFILER
+    bool saveProfile();
+#endif
     void setAlpha(float alpha_);
     float getAlpha();
+    void setControlMode(controlMode mode);
+    controlMode getControlMode();
 
 private:
     Pump pump;
     PressureSensor pressureSensor;
     sim_data *data = nullptr; // Pointer to sim_data
+    int dataCursor;           // point the setpoint lookup continues from
+    TrajectoryStream trajectory; // setpoints streamed from SD instead of data
+    bool streaming;
+
+    bool initGains();
+    void initPumpCurve();
+    bool measureFlow(uint8_t level);
+    void sendPumpCommand(double output);
+    bool computeMpc();
+    bool referenceAt(float time, int &cursor, float &pressure);
+    void sendTelemetry(uint8_t state);
+    bool ambientSettled();
+    bool interlockTripped();
+    void endRun(bool reachedEnd);
+    void logRunSample();
+    bool saveRunSummary();
+    void trackAmbient();
+
+    unsigned long pumpActiveMillis = 0; // last time a run or calibration had the pump going
 
     float filteredReading; // initial guess of sea level pressure
     float alpha;           // high alpha means more weight to new data
@@ -63,13 +125,19 @@ private:
 
     PID control_pid = PID(&Input, &Output, &Setpoint, Kp, Ki, Kd, DIRECT);
 
+    controlMode mode = CONTROL_PID;
+    Mpc mpc;
+    unsigned long lastMpcMillis = 0;
+
     bool running;
+    bool completed = false; // the last run reached the end of its trajectory
+    RunMetrics metrics;     // of the current or last run, added to every control tick
+    bool runLogging = false;
 
     bool calibrationRunning;
     float calibrationProgress = 0; // fraction between 0 and 1
 
     bool initialised;
-    bool sensorInitialised;
     bool dataInitialised;
 
     enum calibrationStates
@@ -83,7 +151,15 @@ private:
 
     float calibrationSetPointPressure;
 
-    bool sdInitialised;
+    PumpCurve pumpCurve;
+    bool pumpCurveLoaded = false;
+
+    // duty level held during calibration and the window its flow is measured over
+    uint8_t sweepLevel;
+    unsigned long sweepStartMillis;
+    unsigned long sweepSettledMillis;
+    float sweepStartPressure;
+    bool sweepSettled;
 
     bool gainScheduleInitialised;
 
@@ -92,6 +168,7 @@ private:
     unsigned long startMillis;
 
     Sd sd;
+    DeviceManager devices = DeviceManager(sd, pressureSensor); // SD card and sensor state, see serviceIdle()
 
     unsigned long timePassed;  // microseconds
     unsigned long lastLogTime; // microseconds
@@ -0,0 +1,156 @@
+#include "DeviceManager.h"
+
+DeviceManager::DeviceManager(Sd &sd_, PressureSensor &sensor_) : sd(sd_), sensor(sensor_)
+{
+    sdHealth = {DEVICE_UNINITIALISED, 0, DEVICE_RETRY_MS, 0};
+    sensorHealth = {DEVICE_UNINITIALISED, 0, DEVICE_RETRY_MS, 0};
+}
+
+bool DeviceManager::begin()
+{
+    // first call brings everything up, later ones only probe: a failed device is left to service()
+    if (sdHealth.state == DEVICE_UNINITIALISED)
+    {
+        setState(sdHealth, initSd(), "SD card");
+    }
+    else if (sdHealth.state == DEVICE_OK)
+    {
+        setState(sdHealth, probeSd(), "SD card");
+    }
+
+    if (sensorHealth.state == DEVICE_UNINITIALISED)
+    {
+        setState(sensorHealth, initSensor(), "Pressure sensor");
+    }
+    else if (sensorHealth.state == DEVICE_OK)
+    {
+        setState(sensorHealth, probeSensor(), "Pressure sensor");
+    }
+
+    return ready();
+}
+
+void DeviceManager::service()
+{
+    check(sdHealth, &DeviceManager::initSd, &DeviceManager::probeSd, "SD card");
+    check(sensorHealth, &DeviceManager::initSensor, &DeviceManager::probeSensor, "Pressure sensor");
+}
+
+void DeviceManager::check(deviceHealth &health, bool (DeviceManager::*init)(), bool (DeviceManager::*probe)(), const char *name)
+{
+    if ((health.state == DEVICE_UNINITIALISED) || ((long)(millis() - health.nextCheckMillis) < 0))
+    {
+        return;
+    }
+
+    if (health.state == DEVICE_OK)
+    {
+        setState(health, (this->*probe)(), name);
+    }
+    else
+    {
+        setState(health, (this->*init)(), name);
+    }
+}
+
+void DeviceManager::setState(deviceHealth &health, bool ok, const char *name)
+{
+    if (ok)
+    {
+        if (health.state != DEVICE_OK)
+        {
+            LOG_INFO("%s ready", name);
+        }
+
+        health.state = DEVICE_OK;
+        health.retryMillis = DEVICE_RETRY_MS;
+        health.failures = 0;
+        health.nextCheckMillis = millis() + DEVICE_PROBE_MS;
+        return;
+    }
+
+    if (health.state == DEVICE_FAILED)
+    {
+        // still gone, wait longer before the next attempt
+        health.failures++;
+        health.retryMillis = min(health.retryMillis * 2, (unsigned long)DEVICE_RETRY_MAX_MS);
+    }
+    else
+    {
+        LOG_WARN("%s not responding", name);
+    }
+
+    health.state = DEVICE_FAILED;
+    health.nextCheckMillis = millis() + health.retryMillis;
+}
+
+bool DeviceManager::initSd()
+{
+    return sd.init(SD_CS);
+}
+
+bool DeviceManager::initSensor()
+{
+    // the first successful begin() calibrates the base pressure, later ones keep it
+#ifdef ANALOG_PRESSURE_PIN
+    bool initialised = sensor.beginContinuous(ANALOG_PRESSURE_PIN); // timer paced, decimated in the ISR
+
+    if (initialised)
+    {
+        LOG_INFO("Sensor initialised, analog pin sampled continuously");
+    }
+#else
+    bool initialised = sensor.begin(I2C_SDA, I2C_SCL, 0x76, 0x77); // initialise BMP280 sensors, one is enough
+
+    if (initialised)
+    {
+        LOG_INFO("Sensor initialised, %d BMP280 active", sensor.getActiveSensors());
+    }
+#endif
+    else
+    {
+        LOG_ERROR("Sensor failed to initialise");
+    }
+    return initialised;
+}
+
+bool DeviceManager::probeSd()
+{
+    return sd.checkDevice();
+}
+
+bool DeviceManager::probeSensor()
+{
+    // one status register read per sensor, a dropped BMP280 of a pair is brought back without touching the other
+    if (!sensor.testConnection())
+    {
+        return false;
+    }
+    sensor.reconnect();
+    return true;
+}
+
+bool DeviceManager::sdReady()
+{
+    return sdHealth.state == DEVICE_OK;
+}
+
+bool DeviceManager::sensorReady()
+{
+    return sensorHealth.state == DEVICE_OK;
+}
+
+bool DeviceManager::ready()
+{
+    return sdReady() && sensorReady();
+}
+
+deviceState DeviceManager::getSdState()
+{
+    return sdHealth.state;
+}
+
+deviceState DeviceManager::getSensorState()
+{
+    return sensorHealth.state;
+}
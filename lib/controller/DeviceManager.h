@@ -0,0 +1,61 @@
+#ifndef DEVICE_MANAGER_H
+#define DEVICE_MANAGER_H
+
+#include "Arduino.h"
+#include "pressureSensor.h"
+#include "SD.hpp"
+#include "Debug.hpp"
+
+#define DEVICE_PROBE_MS 1000     // between liveness probes of a healthy device
+#define DEVICE_RETRY_MS 500      // first re-initialisation attempt after a failure
+#define DEVICE_RETRY_MAX_MS 8000 // retries back off up to this
+
+enum deviceState
+{
+    DEVICE_UNINITIALISED,
+    DEVICE_OK,
+    DEVICE_FAILED
+};
+
+struct deviceHealth
+{
+    deviceState state;
+    unsigned long nextCheckMillis; // next probe, or next retry when failed
+    unsigned long retryMillis;     // current retry interval
+    uint16_t failures;             // re-initialisations that didn't bring it back
+};
+
+// Owns bring up of the SD card and the pressure sensor. Each device is initialised once; after that it is only
+// probed (BMP280 status register, SD root lookup) and a device that stops answering is re-initialised on its own,
+// from service(), with backoff. Nothing here blocks for long once the devices are up.
+class DeviceManager
+{
+public:
+    DeviceManager(Sd &sd_, PressureSensor &sensor_);
+
+    bool begin();
+    void service();
+
+    bool sdReady();
+    bool sensorReady();
+    bool ready();
+    deviceState getSdState();
+    deviceState getSensorState();
+
+private:
+    bool initSd();
+    bool initSensor();
+    bool probeSd();
+    bool probeSensor();
+
+    void check(deviceHealth &health, bool (DeviceManager::*init)(), bool (DeviceManager::*probe)(), const char *name);
+    void setState(deviceHealth &health, bool ok, const char *name);
+
+    Sd &sd;
+    PressureSensor &sensor;
+
+    deviceHealth sdHealth;
+    deviceHealth sensorHealth;
+};
+
+#endif // DEVICE_MANAGER_H
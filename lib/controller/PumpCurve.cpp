@@ -0,0 +1,200 @@
+#include "PumpCurve.h"
+
+PumpCurve::PumpCurve()
+{
+    reset();
+    beginMeasurement();
+}
+
+void PumpCurve::reset()
+{
+    // straight line, the duty is the command
+    for (uint8_t row = 0; row < PUMP_CURVE_PRESSURES; row++)
+    {
+        for (uint8_t col = 0; col < PUMP_CURVE_COMMANDS; col++)
+        {
+            table.duty[row][col] = levelDuty(col);
+        }
+        table.leakRate[row] = 0;
+        table.pumpGain[row] = 0; // unknown
+    }
+    measured = false;
+}
+
+float PumpCurve::apply(float command, float pressure)
+{
+    // off stays off, anything above it starts at the edge of the dead band
+    if (command <= 0)
+    {
+        return 0;
+    }
+
+    float x = min(command, 100.0f) * ((PUMP_CURVE_COMMANDS - 1) / 100.0f);
+    int col = min((int)x, PUMP_CURVE_COMMANDS - 2);
+    float fx = x - col;
+
+    float y = rowPosition(pressure);
+    int row = min((int)y, PUMP_CURVE_PRESSURES - 2);
+    float fy = y - row;
+
+    const float *low = table.duty[row];
+    const float *high = table.duty[row + 1];
+    float a = low[col] + fx * (low[col + 1] - low[col]);
+    float b = high[col] + fx * (high[col + 1] - high[col]);
+
+    return a + fy * (b - a);
+}
+
+void PumpCurve::model(float pressure, float &leakRate, float &pumpGain)
+{
+    float y = rowPosition(pressure);
+    int row = min((int)y, PUMP_CURVE_PRESSURES - 2);
+    float fy = y - row;
+
+    leakRate = table.leakRate[row] + fy * (table.leakRate[row + 1] - table.leakRate[row]);
+    pumpGain = table.pumpGain[row] + fy * (table.pumpGain[row + 1] - table.pumpGain[row]);
+}
+
+bool PumpCurve::isMeasured()
+{
+    return measured;
+}
+
+void PumpCurve::beginMeasurement()
+{
+    memset(flowSum, 0, sizeof(flowSum));
+    memset(flowCount, 0, sizeof(flowCount));
+}
+
+void PumpCurve::addMeasurement(uint8_t level, float pressure, float flow)
+{
+    if (level >= PUMP_CURVE_COMMANDS)
+    {
+        return;
+    }
+
+    uint8_t row = (uint8_t)(rowPosition(pressure) + 0.5f); // nearest row
+
+    flowSum[row][level] += flow;
+    flowCount[row][level]++;
+}
+
+bool PumpCurve::build()
+{
+    bool valid[PUMP_CURVE_PRESSURES];
+    int validRows = 0;
+
+    for (uint8_t row = 0; row < PUMP_CURVE_PRESSURES; row++)
+    {
+        valid[row] = buildRow(row);
+        validRows += valid[row];
+    }
+
+    // nothing measured, the table in use stays
+    if (validRows == 0)
+    {
+        return false;
+    }
+
+    // rows the calibration never reached copy the nearest measured one
+    for (uint8_t row = 0; row < PUMP_CURVE_PRESSURES; row++)
+    {
+        if (valid[row])
+        {
+            continue;
+        }
+
+        for (uint8_t distance = 1; distance < PUMP_CURVE_PRESSURES; distance++)
+        {
+            int source = -1;
+            if ((row + distance < PUMP_CURVE_PRESSURES) && valid[row + distance])
+            {
+                source = row + distance;
+            }
+            else if ((row >= distance) && valid[row - distance])
+            {
+                source = row - distance;
+            }
+
+            if (source >= 0)
+            {
+                memcpy(table.duty[row], table.duty[source], sizeof(table.duty[row]));
+                table.leakRate[row] = table.leakRate[source];
+                table.pumpGain[row] = table.pumpGain[source];
+                break;
+            }
+        }
+    }
+
+    measured = true;
+    return true;
+}
+
+bool PumpCurve::buildRow(uint8_t row)
+{
+    // every duty level above zero is needed, level zero is the leak and reads as no measured leak if missing
+    for (uint8_t level = 1; level < PUMP_CURVE_COMMANDS; level++)
+    {
+        if (flowCount[row][level] == 0)
+        {
+            return false;
+        }
+    }
+
+    float leak = flowCount[row][0] ? flowSum[row][0] / flowCount[row][0] : 0;
+
+    // what the pump adds over the leak at each duty, forced monotonic so it can be inverted
+    float effect[PUMP_CURVE_COMMANDS];
+    effect[0] = 0;
+    for (uint8_t level = 1; level < PUMP_CURVE_COMMANDS; level++)
+    {
+        effect[level] = max(effect[level - 1], flowSum[row][level] / flowCount[row][level] - leak);
+    }
+
+    float full = effect[PUMP_CURVE_COMMANDS - 1];
+    if (full <= 0)
+    {
+        return false;
+    }
+
+    // once linearised a command of c percent gives c percent of the full effect; the leak is what pushes the
+    // pressure back up with the pump off, taken as proportional to how far below ambient the row is
+    float deficit = PUMP_CURVE_AMBIENT - rowPressure(row);
+    table.pumpGain[row] = full / 100.0f;
+    table.leakRate[row] = (deficit > 1000) ? max(0.0f, -leak) / deficit : 0;
+
+    // invert: the duty giving each equal share of the full effect, piecewise linear between measured levels
+    for (uint8_t col = 0; col < PUMP_CURVE_COMMANDS; col++)
+    {
+        float target = full * col / (PUMP_CURVE_COMMANDS - 1);
+        uint8_t level = 1;
+
+        while ((level < PUMP_CURVE_COMMANDS - 1) && (effect[level] <= target))
+        {
+            level++;
+        }
+
+        // column zero lands on the last duty that does nothing, the edge of the dead band
+        float span = effect[level] - effect[level - 1];
+        float fraction = (span > 0) ? (target - effect[level - 1]) / span : 0;
+        table.duty[row][col] = levelDuty(level - 1) + constrain(fraction, 0.0f, 1.0f) * (levelDuty(level) - levelDuty(level - 1));
+    }
+
+    return true;
+}
+
+float PumpCurve::levelDuty(uint8_t level)
+{
+    return level * (100.0f / (PUMP_CURVE_COMMANDS - 1));
+}
+
+float PumpCurve::rowPosition(float pressure)
+{
+    // fractional row index, clamped to the table
+    return (constrain(pressure, PUMP_CURVE_P_MIN, PUMP_CURVE_P_MAX) - PUMP_CURVE_P_MIN) * ((PUMP_CURVE_PRESSURES - 1) / (PUMP_CURVE_P_MAX - PUMP_CURVE_P_MIN));
+}
+
+float PumpCurve::rowPressure(uint8_t row)
+{
+    return PUMP_CURVE_P_MIN + row * ((PUMP_CURVE_P_MAX - PUMP_CURVE_P_MIN) / (PUMP_CURVE_PRESSURES - 1));
+}
@@ -0,0 +1,74 @@
+#ifndef PUMP_CURVE_H
+#define PUMP_CURVE_H
+
+#include "Arduino.h"
+
+// Linearises the pump: maps the PID output (percent of full effect) to the duty that gives that share of the
+// flow at the current chamber pressure, so the loop sees a roughly linear plant. Both axes are uniform grids and
+// apply() is a bilinear lookup with no search.
+#define PUMP_CURVE_COMMANDS 9    // command columns, 0 to 100 % in 12.5 % steps, also the duty levels measured
+#define PUMP_CURVE_PRESSURES 6   // pressure rows
+#define PUMP_CURVE_P_MIN 25000.0f
+#define PUMP_CURVE_P_MAX 105000.0f
+
+// measured during calibration: each duty level is held this long, the first part is left out while the flow settles
+#define PUMP_CURVE_DWELL_MS 600
+#define PUMP_CURVE_SETTLE_MS 150
+
+// stored on the SD card as pumpCurveHeader followed by pumpCurveTable, little-endian floats
+#define PUMP_CURVE_PATH "/CONTROL/pump.pcb"
+#define PUMP_CURVE_MAGIC 0x31425350 // "PSB1"
+#define PUMP_CURVE_VERSION 2
+
+// chamber pressure the leak pulls towards, readings are relative to the calibrated base plus this
+#define PUMP_CURVE_AMBIENT 101325.0f
+
+struct pumpCurveHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t commands;
+    uint8_t pressures;
+    uint32_t dataCrc; // CRC-32 of the table that follows
+};
+
+struct pumpCurveTable
+{
+    float duty[PUMP_CURVE_PRESSURES][PUMP_CURVE_COMMANDS]; // percent, [pressure row][command column]
+
+    // first order chamber model per row, linear in the command once it has gone through duty[]:
+    // dP/dt = leakRate * (ambient - P) - pumpGain * command
+    float leakRate[PUMP_CURVE_PRESSURES]; // 1/s
+    float pumpGain[PUMP_CURVE_PRESSURES]; // Pa/s per percent
+};
+
+class PumpCurve
+{
+public:
+    PumpCurve();
+
+    void reset();
+    float apply(float command, float pressure);
+    void model(float pressure, float &leakRate, float &pumpGain);
+    bool isMeasured();
+
+    void beginMeasurement();
+    void addMeasurement(uint8_t level, float pressure, float flow);
+    bool build();
+
+    static float levelDuty(uint8_t level);
+    static float rowPressure(uint8_t row);
+
+    pumpCurveTable table;
+    bool measured; // table came from a calibration, not the straight line
+
+private:
+    bool buildRow(uint8_t row);
+    static float rowPosition(float pressure);
+
+    // flow (Pa/s pumped out) summed per pressure row and duty level while calibrating
+    float flowSum[PUMP_CURVE_PRESSURES][PUMP_CURVE_COMMANDS];
+    uint16_t flowCount[PUMP_CURVE_PRESSURES][PUMP_CURVE_COMMANDS];
+};
+
+#endif // PUMP_CURVE_H
@@ -0,0 +1,122 @@
+#include "RunMetrics.h"
+#include "Profiler.hpp"
+#include "HeapStats.hpp"
+#include "ROCKET_SIM.h"
+
+RunMetrics::RunMetrics()
+{
+    begin();
+}
+
+void RunMetrics::begin()
+{
+    samples = 0;
+    startMicros = 0;
+    lastMicros = 0;
+    lastSetpoint = 0;
+    lastSaturated = false;
+    errorSquares = 0;
+    maxError = 0;
+    lagNumerator = 0;
+    lagDenominator = 0;
+    minSetpoint = 1e9;
+    minPressure = 1e9;
+    saturatedMicros = 0;
+    heapStart = 0;
+    heapOperations = 0;
+    loopCount = 0;
+    loopMax = 0;
+    memset(loopBuckets, 0, sizeof(loopBuckets));
+}
+
+void RunMetrics::add(uint32_t timeMicros, float setpoint, float pressure, float output)
+{
+    float error = pressure - setpoint;
+
+    if (samples == 0)
+    {
+        startMicros = timeMicros;
+        heapStart = HeapStats::getOperations(); // opening the log and the trajectory is setup, not the loop
+    }
+    else
+    {
+        uint32_t loop = timeMicros - lastMicros;
+        float dt = loop * 1e-6f;
+
+        loopCount++;
+        loopMax = max(loopMax, loop);
+        loopBuckets[min(Profiler::bucketOf(loop), (uint8_t)(RUN_METRICS_BUCKETS - 1))]++;
+
+        // the command held since the last tick
+        if (lastSaturated)
+        {
+            saturatedMicros += loop;
+        }
+
+        if (dt > 0)
+        {
+            float rate = (setpoint - lastSetpoint) / dt;
+            lagNumerator += (double)error * rate * dt;
+            lagDenominator += (double)rate * rate * dt;
+        }
+    }
+
+    heapOperations = HeapStats::getOperations() - heapStart;
+
+    samples++;
+    lastMicros = timeMicros;
+    lastSetpoint = setpoint;
+    lastSaturated = fabs(output) >= RUN_SATURATED_PERCENT;
+
+    errorSquares += (double)error * error;
+    maxError = max(maxError, (float)fabs(error));
+
+    minSetpoint = min(minSetpoint, setpoint);
+    minPressure = min(minPressure, pressure);
+}
+
+runSummary RunMetrics::getSummary()
+{
+    runSummary summary;
+    memset(&summary, 0, sizeof(summary));
+
+    if (samples == 0)
+    {
+        return summary;
+    }
+
+    summary.samples = samples;
+    summary.duration = (lastMicros - startMicros) * 1e-6f;
+    summary.rmsError = sqrt(errorSquares / samples);
+    summary.maxError = maxError;
+    summary.apogeeError = ROCKET_SIM::pressureToAltitude(minPressure) - ROCKET_SIM::pressureToAltitude(minSetpoint);
+    summary.lag = (lagDenominator > 0) ? -lagNumerator / lagDenominator : 0;
+    summary.saturatedTime = saturatedMicros * 1e-6f;
+
+    summary.loopP50Us = loopPercentile(loopCount - loopCount / 2);
+    summary.loopP95Us = loopPercentile(loopCount - loopCount / 20);
+    summary.loopP99Us = loopPercentile(loopCount - loopCount / 100);
+    summary.loopMaxUs = loopMax;
+    summary.heapOperations = heapOperations;
+
+    return summary;
+}
+
+uint32_t RunMetrics::loopPercentile(uint32_t rank)
+{
+    // walk the histogram to the bucket holding the sample of that rank, same as the Profiler's p99
+    uint32_t seen = 0;
+
+    for (uint8_t bucket = 0; bucket < RUN_METRICS_BUCKETS; bucket++)
+    {
+        seen += loopBuckets[bucket];
+
+        if (seen >= rank && seen > 0)
+        {
+            uint64_t upper = Profiler::bucketUpper(bucket);
+            return (upper < loopMax) ? upper : loopMax;
+        }
+    }
+
+    return loopMax;
+}
@@ -0,0 +1,65 @@
+#ifndef RUN_METRICS_H
+#define RUN_METRICS_H
+
+#include "Arduino.h"
+
+#define RUN_METRICS_BUCKETS 40      // loop times in microseconds, the Profiler's log buckets up to about a second
+#define RUN_SATURATED_PERCENT 99.5f // pump command counted as flat out
+
+struct runSummary
+{
+    uint32_t samples;
+    float duration;      // s
+    float rmsError;      // Pa, pressure minus setpoint
+    float maxError;      // Pa, largest absolute error
+    float apogeeError;   // m, highest altitude reached minus the trajectory's
+    float lag;           // s, how far the chamber runs behind the setpoint, negative when ahead
+    float saturatedTime; // s with the pump flat out
+    uint32_t loopP50Us;  // time between control ticks, upper edge of the percentile's bucket
+    uint32_t loopP95Us;
+    uint32_t loopP99Us;
+    uint32_t loopMaxUs;
+    uint32_t heapOperations; // HeapStats operations from the first tick to the last, the loop should make none
+};
+
+// Statistics of a run accumulated tick by tick in constant memory: sums for the errors and the lag fit, running
+// extremes for the apogee, and a log histogram for the loop time percentiles.
+class RunMetrics
+{
+public:
+    RunMetrics();
+
+    void begin();
+    void add(uint32_t timeMicros, float setpoint, float pressure, float output);
+    runSummary getSummary();
+
+private:
+    uint32_t loopPercentile(uint32_t rank);
+
+    uint32_t samples;
+    uint32_t startMicros;
+    uint32_t lastMicros;
+    float lastSetpoint;
+    bool lastSaturated;
+
+    double errorSquares;
+    float maxError;
+
+    // least squares fit of error = -lag * dSetpoint/dt, weighted by time
+    double lagNumerator;
+    double lagDenominator;
+
+    float minSetpoint;
+    float minPressure;
+
+    uint32_t saturatedMicros;
+
+    uint32_t heapStart;
+    uint32_t heapOperations;
+
+    uint32_t loopCount;
+    uint32_t loopMax;
+    uint32_t loopBuckets[RUN_METRICS_BUCKETS];
+};
+
+#endif // RUN_METRICS_H
@@ -0,0 +1,158 @@
+#include "SafetyMonitor.h"
+#include <IWatchdog.h>
+
+SafetyMonitor safetyMonitor;
+
+SafetyMonitor::SafetyMonitor() : timer(nullptr), pump(nullptr), low(0), high(0), lastPressure(0), lastSampleMicros(0),
+                                 armed(false), trip(SAFETY_OK), tripLatencyMicros(0), maxCheckGapMicros(0), checks(0),
+                                 lastCheckMicros(0)
+{
+}
+
+bool SafetyMonitor::begin(Pump &pump_)
+{
+    noInterrupts();
+    pump = &pump_;
+    interrupts();
+
+    // started once and left running, the watchdog can't be stopped again
+    if (timer)
+    {
+        return true;
+    }
+
+    if (IWatchdog.isReset(true))
+    {
+        LOG_WARN("Restarted by the watchdog");
+    }
+
+    timer = new HardwareTimer(SAFETY_TIMER);
+    timer->setOverflow(SAFETY_CHECK_HZ, HERTZ_FORMAT);
+    timer->attachInterrupt([]() { safetyMonitor.isr(); });
+
+    IWatchdog.begin(SAFETY_WATCHDOG_US);
+    timer->resume();
+
+    return true;
+}
+
+void SafetyMonitor::arm(float low_, float high_)
+{
+    noInterrupts();
+    low = low_;
+    high = high_;
+    lastSampleMicros = micros(); // the first reading has the full timeout to arrive
+    lastCheckMicros = micros();
+    maxCheckGapMicros = 0;
+    armed = true;
+    interrupts();
+}
+
+void SafetyMonitor::disarm()
+{
+    armed = false;
+}
+
+bool SafetyMonitor::isArmed()
+{
+    return armed;
+}
+
+void SafetyMonitor::feed(float pressure)
+{
+    // both together, the interrupt must not pair a new reading with an old time
+    noInterrupts();
+    lastPressure = pressure;
+    lastSampleMicros = micros();
+    interrupts();
+}
+
+safetyTrip SafetyMonitor::getTrip()
+{
+    return trip;
+}
+
+void SafetyMonitor::clearTrip()
+{
+    noInterrupts();
+    trip = SAFETY_OK;
+    tripLatencyMicros = 0;
+    if (pump)
+    {
+        pump->releaseInterlock();
+    }
+    interrupts();
+}
+
+uint32_t SafetyMonitor::getTripLatencyMicros()
+{
+    return tripLatencyMicros;
+}
+
+uint32_t SafetyMonitor::getMaxCheckGapMicros()
+{
+    return maxCheckGapMicros;
+}
+
+uint32_t SafetyMonitor::getChecks()
+{
+    return checks;
+}
+
+void SafetyMonitor::isr()
+{
+    IWatchdog.reload();
+
+    if (!armed || !pump)
+    {
+        return;
+    }
+
+    uint32_t now = micros();
+    uint32_t gap = now - lastCheckMicros;
+    lastCheckMicros = now;
+    if (gap > maxCheckGapMicros)
+    {
+        maxCheckGapMicros = gap;
+    }
+    checks++;
+
+    if (trip != SAFETY_OK)
+    {
+        pump->forceOff(); // keep it off, covers a command written while this interrupt was tripping
+        return;
+    }
+
+    // nothing to protect while the pump is idle
+    if (!pump->isDriving())
+    {
+        return;
+    }
+
+    uint32_t age = now - lastSampleMicros;
+    safetyTrip found = SAFETY_OK;
+    uint32_t since = 0; // how long ago the problem became visible
+
+    if (age > SAFETY_SAMPLE_TIMEOUT_MS * 1000UL)
+    {
+        found = SAFETY_STALE;
+        since = age - SAFETY_SAMPLE_TIMEOUT_MS * 1000UL;
+    }
+    else if (lastPressure < low)
+    {
+        found = SAFETY_LOW;
+        since = age;
+    }
+    else if (lastPressure > high)
+    {
+        found = SAFETY_HIGH;
+        since = age;
+    }
+
+    if (found != SAFETY_OK)
+    {
+        pump->forceOff();
+        trip = found;
+        tripLatencyMicros = since + (micros() - now);
+    }
+}
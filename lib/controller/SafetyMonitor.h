@@ -0,0 +1,67 @@
+#ifndef SAFETY_MONITOR_H
+#define SAFETY_MONITOR_H
+
+#include "Arduino.h"
+#include "Debug.hpp"
+#include "Pump.h"
+
+#define SAFETY_TIMER TIM6            // basic timer, no pins, not used by PWM or the analog sampler
+#define SAFETY_CHECK_HZ 1000         // one check per millisecond, the worst case reaction is one period plus the check
+#define SAFETY_SAMPLE_TIMEOUT_MS 250 // longest the pump may run on a pressure reading, a few slow SD flushes
+#define SAFETY_WATCHDOG_US 100000    // the MCU resets if the check interrupt itself stops for this long
+
+enum safetyTrip : uint8_t
+{
+    SAFETY_OK,
+    SAFETY_LOW,   // pressure below the low limit
+    SAFETY_HIGH,  // pressure above the high limit
+    SAFETY_STALE, // no new reading within SAFETY_SAMPLE_TIMEOUT_MS
+};
+
+// Pump interlock that doesn't depend on the UI loop. A timer interrupt checks the latest reading the control loop
+// fed in, its age and its bounds, and forces the pump off the moment either fails; the pump stays off until the
+// trip is cleared. The same interrupt reloads the hardware watchdog, so a hang that stops interrupts resets the MCU
+// with the pump's PWM pin back at its reset state.
+class SafetyMonitor
+{
+public:
+    SafetyMonitor();
+
+    bool begin(Pump &pump_);
+
+    void arm(float low_, float high_);
+    void disarm();
+    bool isArmed();
+    void feed(float pressure);
+
+    safetyTrip getTrip();
+    void clearTrip();
+
+    uint32_t getTripLatencyMicros(); // from the reading going bad or stale to the pump being off
+    uint32_t getMaxCheckGapMicros(); // longest time between two checks while armed, what the latency is bounded by
+    uint32_t getChecks();
+
+    void isr();
+
+private:
+    HardwareTimer *timer;
+    Pump *pump;
+
+    float low;
+    float high;
+
+    // written by the control loop, read by the interrupt
+    volatile float lastPressure;
+    volatile uint32_t lastSampleMicros;
+    volatile bool armed;
+
+    volatile safetyTrip trip;
+    volatile uint32_t tripLatencyMicros;
+    volatile uint32_t maxCheckGapMicros;
+    volatile uint32_t checks;
+    uint32_t lastCheckMicros;
+};
+
+extern SafetyMonitor safetyMonitor;
+
+#endif // SAFETY_MONITOR_H
@@ -0,0 +1,341 @@
+#include "TrajectoryStream.h"
+#include "ROCKET_SIM.h"
+
+TrajectoryStream::TrajectoryStream() : fileOpen(false), altitudeColumn(false), endOfFile(true), dataStart(0), active(0), cursor(0),
+                                       prevTime(0), prevPressure(0), duration(0), minPressure(0), maxPressure(0), numPoints(0), underruns(0)
+{
+    chunks[0].count = chunks[1].count = 0;
+    chunks[0].filled = chunks[1].filled = false;
+}
+
+TrajectoryStream::~TrajectoryStream()
+{
+    close();
+}
+
+bool TrajectoryStream::open(const char *filename)
+{
+    close();
+
+    file = SD.open(filename, FILE_READ);
+    if (!file)
+    {
+        LOG_ERROR("Failed to open file: %s", filename);
+        return false;
+    }
+
+    fileOpen = true;
+    altitudeColumn = false;
+    dataStart = 0;
+
+    // optional header line, tells us whether the second column is altitude or pressure
+    char line[64];
+    size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[len] = '\0';
+
+    char *endPtr;
+    strtof(line, &endPtr);
+
+    if (endPtr == line)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            line[i] = tolower(line[i]);
+        }
+
+        altitudeColumn = (strstr(line, "alt") != nullptr);
+        dataStart = file.position();
+    }
+
+    // one pass over the file for the numbers the UI needs to scale the graph, nothing is kept
+    file.seek(dataStart);
+    endOfFile = false;
+
+    numPoints = 0;
+    minPressure = 1e9;
+    maxPressure = -1e9;
+
+    float time, pressure;
+    float lastTime = -1e9;
+
+    while (readPoint(time, pressure))
+    {
+        if (time < lastTime)
+        {
+            DBG("Trajectory time must be ascending");
+            close();
+            return false;
+        }
+
+        lastTime = time;
+        minPressure = min(minPressure, pressure);
+        maxPressure = max(maxPressure, pressure);
+        numPoints++;
+    }
+
+    if (numPoints < 2)
+    {
+        DBG("Trajectory has too few points");
+        close();
+        return false;
+    }
+
+    duration = lastTime;
+
+    LOG_INFO("Trajectory points: %d duration: %f", numPoints, duration);
+
+    return rewind();
+}
+
+void TrajectoryStream::close()
+{
+    if (fileOpen)
+    {
+        file.close();
+        fileOpen = false;
+    }
+
+    endOfFile = true;
+    chunks[0].filled = chunks[1].filled = false;
+}
+
+bool TrajectoryStream::rewind()
+{
+    if (!fileOpen)
+    {
+        return false;
+    }
+
+    file.seek(dataStart);
+    endOfFile = false;
+
+    chunks[0].filled = chunks[1].filled = false;
+
+    active = 0;
+    cursor = 0;
+    underruns = 0;
+
+    if (!fillChunk(chunks[0]))
+    {
+        return false;
+    }
+
+    fillChunk(chunks[1]); // may be empty for short files
+
+    prevTime = chunks[0].time[0];
+    prevPressure = chunks[0].pressure[0];
+
+    return true;
+}
+
+bool TrajectoryStream::prefetch()
+{
+    // refill the buffer the cursor isn't in, call this outside of the control tick
+    trajectoryChunk &idle = chunks[active ^ 1];
+
+    if (!fileOpen || idle.filled || endOfFile)
+    {
+        return false;
+    }
+
+    return fillChunk(idle);
+}
+
+bool TrajectoryStream::sample(float time, float &pressure)
+{
+    if (!fileOpen)
+    {
+        return false;
+    }
+
+    // move the cursor to the first point at or after `time`
+    while (true)
+    {
+        trajectoryChunk &chunk = chunks[active];
+
+        while (cursor < chunk.count && chunk.time[cursor] < time)
+        {
+            prevTime = chunk.time[cursor];
+            prevPressure = chunk.pressure[cursor];
+            cursor++;
+        }
+
+        if (cursor < chunk.count)
+        {
+            break;
+        }
+
+        // active chunk used up, continue in the prefetched one
+        chunk.filled = false;
+        active ^= 1;
+        cursor = 0;
+
+        if (!chunks[active].filled)
+        {
+            // prefetch() didn't keep up, read the card here rather than lose our place
+            if (endOfFile || !fillChunk(chunks[active]))
+            {
+                pressure = prevPressure;
+                return false; // past the end of the trajectory
+            }
+
+            underruns++;
+        }
+    }
+
+    float nextTime = chunks[active].time[cursor];
+    float nextPressure = chunks[active].pressure[cursor];
+
+    // resample to the control tick by linear interpolation
+    if (nextTime <= prevTime || time <= prevTime)
+    {
+        pressure = (time <= prevTime) ? prevPressure : nextPressure;
+    }
+    else
+    {
+        pressure = prevPressure + (nextPressure - prevPressure) * ((time - prevTime) / (nextTime - prevTime));
+    }
+
+    return true;
+}
+
+bool TrajectoryStream::peek(float time, float &pressure)
+{
+    // look ahead of the cursor without moving it, only as far as the buffered chunks reach
+    if (!fileOpen)
+    {
+        return false;
+    }
+
+    float lastTime = prevTime;
+    float lastPressure = prevPressure;
+    uint8_t index = active;
+    uint16_t point = cursor;
+
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        trajectoryChunk &chunk = chunks[index];
+        if (pass > 0 && !chunk.filled)
+        {
+            break;
+        }
+
+        for (; point < chunk.count; point++)
+        {
+            float nextTime = chunk.time[point];
+            float nextPressure = chunk.pressure[point];
+
+            if (nextTime >= time)
+            {
+                if (nextTime <= lastTime || time <= lastTime)
+                {
+                    pressure = (time <= lastTime) ? lastPressure : nextPressure;
+                }
+                else
+                {
+                    pressure = lastPressure + (nextPressure - lastPressure) * ((time - lastTime) / (nextTime - lastTime));
+                }
+                return true;
+            }
+
+            lastTime = nextTime;
+            lastPressure = nextPressure;
+        }
+
+        index ^= 1;
+        point = 0;
+    }
+
+    // beyond what is buffered, hold the last known point
+    pressure = lastPressure;
+    return false;
+}
+
+bool TrajectoryStream::fillChunk(trajectoryChunk &chunk)
+{
+    chunk.count = 0;
+
+    while (chunk.count < TRAJ_CHUNK_POINTS && readPoint(chunk.time[chunk.count], chunk.pressure[chunk.count]))
+    {
+        chunk.count++;
+    }
+
+    chunk.filled = (chunk.count > 0);
+
+    return chunk.filled;
+}
+
+bool TrajectoryStream::readPoint(float &time, float &pressure)
+{
+    char line[64];
+
+    while (!endOfFile)
+    {
+        if (!file.available())
+        {
+            endOfFile = true;
+            break;
+        }
+
+        size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+
+        char *ptr = line;
+        char *endPtr;
+
+        float t = strtof(ptr, &endPtr);
+        if (endPtr == ptr)
+        {
+            continue; // empty line or comment
+        }
+
+        ptr = endPtr;
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == ',')
+        {
+            ++ptr;
+        }
+
+        float value = strtof(ptr, &endPtr);
+        if (endPtr == ptr)
+        {
+            continue;
+        }
+
+        time = t;
+        pressure = altitudeColumn ? ROCKET_SIM::altitudeToPressure(value) : value;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool TrajectoryStream::isOpen()
+{
+    return fileOpen;
+}
+
+float TrajectoryStream::getDuration()
+{
+    return duration;
+}
+
+float TrajectoryStream::getMinPressure()
+{
+    return minPressure;
+}
+
+float TrajectoryStream::getMaxPressure()
+{
+    return maxPressure;
+}
+
+uint32_t TrajectoryStream::getNumPoints()
+{
+    return numPoints;
+}
+
+uint16_t TrajectoryStream::getUnderruns()
+{
+    return underruns;
+}
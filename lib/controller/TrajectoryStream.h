@@ -0,0 +1,72 @@
+#ifndef TRAJECTORY_STREAM_H
+#define TRAJECTORY_STREAM_H
+
+#include "Arduino.h"
+#include <SD.h>
+#include "Debug.hpp"
+
+#define TRAJ_CHUNK_POINTS 64 // points per buffer, two buffers are kept in RAM
+
+struct trajectoryChunk
+{
+    float time[TRAJ_CHUNK_POINTS];     // seconds
+    float pressure[TRAJ_CHUNK_POINTS]; // Pa
+    uint16_t count;                    // number of valid points
+    bool filled;                       // holds data that hasn't been consumed yet
+};
+
+// Plays back a time/pressure profile of any length from the SD card.
+// The file is read in chunks into two buffers: the control tick reads from one while
+// prefetch() refills the other from the UI loop, so the tick never waits on the card.
+//
+// File format (CSV, one point per line, time ascending):
+//   time, pressure        seconds, Pa
+//   time, altitude        seconds, m (if the header line mentions "alt")
+class TrajectoryStream
+{
+public:
+    TrajectoryStream();
+    ~TrajectoryStream();
+
+    bool open(const char *filename);
+    void close();
+    bool rewind();
+    bool prefetch();
+
+    bool sample(float time, float &pressure);
+    bool peek(float time, float &pressure);
+
+    bool isOpen();
+    float getDuration();
+    float getMinPressure();
+    float getMaxPressure();
+    uint32_t getNumPoints();
+    uint16_t getUnderruns();
+
+private:
+    bool fillChunk(trajectoryChunk &chunk);
+    bool readPoint(float &time, float &pressure);
+
+    File file;
+    bool fileOpen;
+    bool altitudeColumn;
+    bool endOfFile;
+
+    uint32_t dataStart; // file offset of the first data line
+
+    trajectoryChunk chunks[2];
+    uint8_t active;  // chunk the cursor is in
+    uint16_t cursor; // next point in the active chunk that is ahead of the playback time
+
+    // point just before the cursor, used to interpolate across chunk boundaries
+    float prevTime;
+    float prevPressure;
+
+    float duration;
+    float minPressure;
+    float maxPressure;
+    uint32_t numPoints;
+    uint16_t underruns; // times the control tick had to read the card itself
+};
+
+#endif // TRAJECTORY_STREAM_H
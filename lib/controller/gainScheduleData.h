@@ -7,9 +7,40 @@
 
 struct gainScheduleData
 {
-    uint8_t height;                    // Number of rows read from the file
-    static const uint8_t width = 4;    // Number of columns (fixed at 4)
-    double data[MAX_GAIN_ROWS][width]; // array to store the data. [P, I, D, pressure]
+    uint8_t height;                   // Number of rows read from the file
+    static const uint8_t width = 4;   // Number of columns (fixed at 4)
+    float data[MAX_GAIN_ROWS][width]; // array to store the data. [P, I, D, pressure], sorted by pressure
 };
 
+// Compiled gain schedule (.GSB) stored next to the source CSV, e.g. /CONTROL/gains.csv -> /CONTROL/gains.gsb
+// Layout: gainScheduleHeader followed by `height` rows of `width` little-endian floats
+#define GAIN_SCHEDULE_MAGIC 0x31425347 // "GSB1"
+#define GAIN_SCHEDULE_VERSION 1
+
+struct gainScheduleHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t height;
+    uint8_t width;
+    uint32_t sourceSize; // size of the CSV the rows were compiled from
+    uint32_t sourceCrc;  // CRC-32 of the CSV, a mismatch means the source has changed
+    uint32_t dataCrc;    // CRC-32 of the rows that follow
+};
+
+// Built-in schedule used when no file can be loaded, lives in flash
+static const float defaultGainRows[][gainScheduleData::width] = {
+    // Kp, Ki, Kd, pressure (Pa)
+    {0.010f, 0.0f, 0.0f, 30000.0f},
+    {0.010f, 0.0f, 0.0f, 60000.0f},
+    {0.010f, 0.0f, 0.0f, 90000.0f},
+    {0.010f, 0.0f, 0.0f, 110000.0f},
+};
+
+inline void loadDefaultGainSchedule(gainScheduleData &gainSchedule)
+{
+    gainSchedule.height = sizeof(defaultGainRows) / sizeof(defaultGainRows[0]);
+    memcpy(gainSchedule.data, defaultGainRows, sizeof(defaultGainRows));
+}
+
 #endif // GAIN_SCHEDULE_DATA_H
@@ -1,11 +1,42 @@
 #ifndef DEBUG_HPP
 #define DEBUG_HPP
 
+// Levels for LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG.
+// LOG_LEVEL (build flag) sets the default, a module can override it by defining
+// LOG_MODULE_LEVEL before its first #include, e.g. `#define LOG_MODULE_LEVEL WARN`
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Compiled out LOG_* still name their arguments inside an unevaluated sizeof, so parameters that only feed a log
+// line don't turn into unused parameter warnings. Nothing is evaluated or emitted.
+template <typename... Args>
+inline int logDiscard(Args...)
+{
+  return 0;
+}
+
+#define LOG_DISCARD(...)                    \
+  do                                        \
+  {                                         \
+    (void)sizeof(logDiscard(__VA_ARGS__));  \
+  } while (0)
+
 #ifndef TARGET_ENV_NATIVE
 
 #include <Arduino.h>
 
-#ifdef ENABLE_DEBUG
+// CSV lines and page text are formatted with snprintf("%f"), which newlib-nano leaves empty unless float support
+// is linked in
+#if defined(ARDUINO_ARCH_STM32) && !defined(PIO_FRAMEWORK_ARDUINO_NANOLIB_FLOAT_PRINTF)
+#error "build with -D PIO_FRAMEWORK_ARDUINO_NANOLIB_FLOAT_PRINTF, floats are formatted with %f"
+#endif
+
+// telemetry frames go out on Serial, raw DBG() text in between them would break the frames. DBG() only stays on
+// with USE_USBSERIAL, use LOG_* for anything that should reach the host alongside telemetry
+#if defined(ENABLE_DEBUG) && (!defined(ENABLE_TELEMETRY) || defined(USE_USBSERIAL))
 
 #ifdef USE_USBSERIAL
 #define _SERIAL USBSerial
@@ -30,18 +61,133 @@
     _SERIAL.begin(__VA_ARGS__); \
   } while (0)
 
-#else // ENABLE_DEBUG
+#else // ENABLE_DEBUG && (!ENABLE_TELEMETRY || USE_USBSERIAL)
 
 #define DBG(...)
 #define INITIALISE_DBG(...)
 
-#endif // ENABLE_DEBUG
+#endif // ENABLE_DEBUG && (!ENABLE_TELEMETRY || USE_USBSERIAL)
+
+#if defined(ENABLE_TELEMETRY) && defined(LOG_LEVEL)
+
+// Tokenized logging: the format string never reaches the target's UART. It is replaced at compile
+// time by its FNV-1a hash and only the raw arguments are queued as a telemetry frame, formatting
+// happens on the host (lib/debug/log_decode.py). Disabled levels compile to nothing and their
+// arguments are never evaluated.
+//
+// Arguments: integers and bools (%d %i %u %x %c), float/double (%f %e %g), const char * (%s)
+
+#include "Telemetry.h"
+
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL
+#endif
+
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_ENABLED(level) (LOG_LEVEL_##level <= LOG_CAT(LOG_LEVEL_, LOG_MODULE_LEVEL))
+
+constexpr uint32_t logToken(const char *fmt, uint32_t hash = 2166136261u)
+{
+  return (*fmt == '\0') ? hash : logToken(fmt + 1, (hash ^ (uint8_t)*fmt) * 16777619u);
+}
+
+template <typename T>
+inline void logPack(uint8_t *payload, uint8_t &len, T value)
+{
+  // integers and enums, sent as 32 bits
+  int32_t raw = (int32_t)value;
+  if (len + sizeof(raw) <= TELEMETRY_MAX_PAYLOAD)
+  {
+    memcpy(&payload[len], &raw, sizeof(raw));
+    len += sizeof(raw);
+  }
+}
+
+inline void logPack(uint8_t *payload, uint8_t &len, double value)
+{
+  float raw = value;
+  if (len + sizeof(raw) <= TELEMETRY_MAX_PAYLOAD)
+  {
+    memcpy(&payload[len], &raw, sizeof(raw));
+    len += sizeof(raw);
+  }
+}
+
+inline void logPack(uint8_t *payload, uint8_t &len, const char *value)
+{
+  // length prefixed, truncated to whatever space is left in the frame
+  if (len + 1 > TELEMETRY_MAX_PAYLOAD)
+  {
+    return;
+  }
+
+  uint8_t strLen = min(strlen(value), (size_t)(TELEMETRY_MAX_PAYLOAD - len - 1));
+  payload[len++] = strLen;
+  memcpy(&payload[len], value, strLen);
+  len += strLen;
+}
+
+inline void logPack(uint8_t *payload, uint8_t &len, char *value)
+{
+  logPack(payload, len, (const char *)value);
+}
+
+inline void logPack(uint8_t *payload, uint8_t &len, float value)
+{
+  logPack(payload, len, (double)value);
+}
+
+template <typename... Args>
+inline void logWrite(uint8_t level, uint32_t token, Args... args)
+{
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+  uint8_t len = 0;
+
+  payload[len++] = level;
+  memcpy(&payload[len], &token, sizeof(token));
+  len += sizeof(token);
+
+  int unpack[] = {0, (logPack(payload, len, args), 0)...};
+  (void)unpack;
+
+  telemetry.send(TELEMETRY_LOG, payload, len);
+}
+
+#define LOG_AT(level, fmt, ...)                                   \
+  do                                                              \
+  {                                                               \
+    if (LOG_ENABLED(level))                                       \
+    {                                                             \
+      constexpr uint32_t token = logToken(fmt);                   \
+      logWrite(LOG_LEVEL_##level, token, ##__VA_ARGS__);          \
+    }                                                             \
+  } while (0)
+
+#define LOG_ERROR(fmt, ...) LOG_AT(ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...) LOG_AT(WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...) LOG_AT(INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) LOG_AT(DEBUG, fmt, ##__VA_ARGS__)
+
+#else // ENABLE_TELEMETRY && LOG_LEVEL
+
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_WARN(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+
+#endif // ENABLE_TELEMETRY && LOG_LEVEL
 
 #else // TARGET_ENV_NATIVE
 
 #define DBG(...)
 #define INITIALISE_DBG(...)
 
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_WARN(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+
 #endif // TARGET_ENV_NATIVE
 
-#endif // DEBUG_HPP
\ No newline at end of file
+#endif // DEBUG_HPP
@@ -0,0 +1,146 @@
+#include "HeapStats.hpp"
+#include <stdlib.h>
+
+static uint32_t allocations = 0;
+static uint32_t frees = 0;
+static uint32_t reallocations = 0;
+
+#if defined(ENABLE_HEAP_STATS) && !defined(TARGET_ENV_NATIVE)
+
+// newlib's reentrant entry points: malloc(), new, strdup() and the stdio internals all end up in these. Calls
+// inside the object that defines one (realloc growing in place) aren't seen by --wrap
+struct _reent;
+
+extern "C"
+{
+    void *__real__malloc_r(struct _reent *reent, size_t size);
+    void __real__free_r(struct _reent *reent, void *ptr);
+    void *__real__realloc_r(struct _reent *reent, void *ptr, size_t size);
+    void *__real__calloc_r(struct _reent *reent, size_t count, size_t size);
+
+    void *__wrap__malloc_r(struct _reent *reent, size_t size)
+    {
+        allocations++;
+        return __real__malloc_r(reent, size);
+    }
+
+    void __wrap__free_r(struct _reent *reent, void *ptr)
+    {
+        if (ptr)
+        {
+            frees++;
+        }
+        __real__free_r(reent, ptr);
+    }
+
+    void *__wrap__realloc_r(struct _reent *reent, void *ptr, size_t size)
+    {
+        reallocations++;
+        return __real__realloc_r(reent, ptr, size);
+    }
+
+    void *__wrap__calloc_r(struct _reent *reent, size_t count, size_t size)
+    {
+        allocations++;
+        return __real__calloc_r(reent, count, size);
+    }
+}
+
+#elif defined(ENABLE_HEAP_STATS)
+
+#include <new>
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr)
+    {
+        frees++;
+    }
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+#endif
+
+#ifndef TARGET_ENV_NATIVE
+
+// newlib-nano's free list, weak so a build against the full newlib still links and only sees the untouched heap
+struct mallocChunk
+{
+    long size; // bytes including this header
+    mallocChunk *next;
+};
+
+extern "C" mallocChunk *__malloc_free_list __attribute__((weak));
+extern "C" void *_sbrk(ptrdiff_t increment);
+
+// linker script symbols, _sbrk() keeps _Min_Stack_Size below the top of RAM for the stack
+extern "C" char _estack;
+extern "C" char _Min_Stack_Size;
+
+#endif
+
+heapCounts HeapStats::getCounts()
+{
+    return {allocations, frees, reallocations};
+}
+
+uint32_t HeapStats::getOperations()
+{
+    return allocations + frees + reallocations;
+}
+
+size_t HeapStats::getLargestFreeBlock()
+{
+#ifdef TARGET_ENV_NATIVE
+    return 0;
+#else
+    char *heapEnd = (char *)_sbrk(0);
+    char *heapLimit = &_estack - (size_t)&_Min_Stack_Size;
+    size_t largest = (heapLimit > heapEnd) ? (size_t)(heapLimit - heapEnd) : 0;
+
+    if (&__malloc_free_list)
+    {
+        for (mallocChunk *chunk = __malloc_free_list; chunk; chunk = chunk->next)
+        {
+            size_t usable = (size_t)chunk->size - sizeof(long);
+            if (usable > largest)
+            {
+                largest = usable;
+            }
+        }
+    }
+
+    return largest;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef HEAP_STATS_HPP
+#define HEAP_STATS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Counts heap operations so a run can show whether it made any once it was going. Built with ENABLE_HEAP_STATS the
+// target wraps newlib's _malloc_r, _free_r, _realloc_r and _calloc_r at link time (-Wl,--wrap=..., malloc, new and
+// the library's own allocations go through them; calls inside newlib's allocator itself aren't seen) and the host
+// replaces operator new and delete. Without it every count stays 0.
+struct heapCounts
+{
+    uint32_t allocations; // malloc, calloc, new
+    uint32_t frees;       // free, delete
+    uint32_t reallocations;
+};
+
+class HeapStats
+{
+public:
+    static heapCounts getCounts();
+    static uint32_t getOperations(); // all of the above together
+
+    // largest single allocation that would succeed now, free list and the untouched heap above it. 0 on the host
+    static size_t getLargestFreeBlock();
+};
+
+#endif // HEAP_STATS_HPP
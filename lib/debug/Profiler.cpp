@@ -0,0 +1,131 @@
+#include "Profiler.hpp"
+#include <string.h>
+
+#ifdef ENABLE_PROFILER
+Profiler profiler;
+#endif
+
+static const char *probeNames[PROBE_COUNT] = {
+    "iterate",
+    "updateReading",
+    "updateGains",
+    "PID compute",
+    "SD flush",
+    "drawLine",
+    "MPC solve",
+};
+
+Profiler::Profiler()
+{
+    reset();
+}
+
+void Profiler::begin()
+{
+#if !defined(TARGET_ENV_NATIVE) && defined(DWT)
+    // enable the Cortex-M cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void Profiler::reset()
+{
+    memset(probes, 0, sizeof(probes));
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        probes[i].min = UINT32_MAX;
+    }
+}
+
+void Profiler::record(uint8_t probe, uint32_t ticks)
+{
+    if (probe >= PROBE_COUNT)
+    {
+        return;
+    }
+
+    probeData &data = probes[probe];
+
+    data.count++;
+    data.total += ticks;
+    data.min = (ticks < data.min) ? ticks : data.min;
+    data.max = (ticks > data.max) ? ticks : data.max;
+
+    data.buckets[bucketOf(ticks)]++;
+}
+
+uint8_t Profiler::bucketOf(uint32_t value)
+{
+    // bucket = 2 * msb + the bit below it
+    if (value < 2)
+    {
+        return value;
+    }
+
+    uint8_t msb = 31 - __builtin_clz(value);
+    return 2 * msb + ((value >> (msb - 1)) & 1);
+}
+
+uint64_t Profiler::bucketUpper(uint8_t bucket)
+{
+    // largest value that lands in the bucket
+    if (bucket < 2)
+    {
+        return bucket;
+    }
+
+    uint8_t msb = bucket / 2;
+    return (1ULL << msb) + (uint64_t)(bucket & 1) * (1ULL << (msb - 1)) + (1ULL << (msb - 1)) - 1;
+}
+
+profileStats Profiler::getStats(uint8_t probe)
+{
+    profileStats stats = {0, 0, 0, 0, 0};
+
+    if (probe >= PROBE_COUNT || probes[probe].count == 0)
+    {
+        return stats;
+    }
+
+    probeData &data = probes[probe];
+
+    stats.count = data.count;
+    stats.minNs = ticksToNs(data.min);
+    stats.avgNs = ticksToNs(data.total / data.count);
+    stats.maxNs = ticksToNs(data.max);
+
+    // walk the histogram to the bucket that holds the 99th percentile sample
+    uint32_t target = data.count - data.count / 100;
+    uint32_t seen = 0;
+
+    for (uint8_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++)
+    {
+        seen += data.buckets[bucket];
+
+        if (seen >= target)
+        {
+            uint64_t upper = bucketUpper(bucket);
+            stats.p99Ns = ticksToNs(upper < data.max ? upper : data.max);
+            break;
+        }
+    }
+
+    return stats;
+}
+
+const char *Profiler::getName(uint8_t probe)
+{
+    return (probe < PROBE_COUNT) ? probeNames[probe] : "";
+}
+
+uint32_t Profiler::ticksToNs(uint64_t ticks)
+{
+#if !defined(TARGET_ENV_NATIVE) && defined(DWT)
+    return (ticks * 1000000000ULL) / SystemCoreClock;
+#else
+    return ticks;
+#endif
+}
@@ -0,0 +1,105 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef TARGET_ENV_NATIVE
+#include <chrono>
+#else
+#include <Arduino.h>
+#endif
+
+// Probes timed with PROFILE_SCOPE(), add new ones before PROBE_COUNT and name them in Profiler.cpp
+enum profileProbe : uint8_t
+{
+    PROBE_ITERATE,        // whole control tick, Controller::iterate()
+    PROBE_UPDATE_READING, // Controller::updateReading()
+    PROBE_UPDATE_GAINS,   // Controller::updateGains()
+    PROBE_PID_COMPUTE,    // PID::Compute()
+    PROBE_SD_FLUSH,       // Sd::flushBuffer()
+    PROBE_DRAW_LINE,      // live graph drawLine() calls in UI::runPage()
+    PROBE_MPC_SOLVE,      // Mpc::solve() in Controller::iterate()
+    PROBE_COUNT
+};
+
+// Two buckets per power of two, 64 buckets covers the whole 32 bit tick range
+#define PROFILE_BUCKETS 64
+
+struct profileStats
+{
+    uint32_t count;
+    uint32_t minNs;
+    uint32_t avgNs;
+    uint32_t p99Ns; // upper edge of the bucket holding the 99th percentile, so within ~50%
+    uint32_t maxNs;
+};
+
+class Profiler
+{
+public:
+    Profiler();
+
+    void begin();
+    void reset();
+
+    // ticks are CPU cycles on target and nanoseconds on host
+    static inline uint32_t now()
+    {
+#if defined(TARGET_ENV_NATIVE)
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif defined(DWT)
+        return DWT->CYCCNT;
+#else
+        return micros() * 1000;
+#endif
+    }
+
+    void record(uint8_t probe, uint32_t ticks);
+    profileStats getStats(uint8_t probe);
+
+    static const char *getName(uint8_t probe);
+
+    // the histogram's log buckets, also used for the run loop times in RunMetrics
+    static uint8_t bucketOf(uint32_t value);
+    static uint64_t bucketUpper(uint8_t bucket);
+
+private:
+    uint32_t ticksToNs(uint64_t ticks);
+
+    struct probeData
+    {
+        uint32_t count;
+        uint64_t total;
+        uint32_t min;
+        uint32_t max;
+        uint32_t buckets[PROFILE_BUCKETS];
+    };
+
+    probeData probes[PROBE_COUNT];
+};
+
+// Without ENABLE_PROFILER there is no profiler object, only the static helpers RunMetrics and the benchmarks use
+#ifdef ENABLE_PROFILER
+extern Profiler profiler;
+
+// Times the rest of the enclosing scope
+class ScopedProbe
+{
+public:
+    explicit ScopedProbe(uint8_t probe_) : probe(probe_), start(Profiler::now()) {}
+    ~ScopedProbe() { profiler.record(probe, Profiler::now() - start); }
+
+private:
+    uint8_t probe;
+    uint32_t start;
+};
+
+#define PROFILE_CAT_(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT_(a, b)
+#define PROFILE_SCOPE(probe) ScopedProbe PROFILE_CAT(scopedProbe_, __LINE__)(probe)
+#else
+#define PROFILE_SCOPE(probe)
+#endif // ENABLE_PROFILER
+
+#endif // PROFILER_HPP
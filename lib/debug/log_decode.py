@@ -0,0 +1,113 @@
+"""
+Expand tokenized LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG records from the telemetry stream
+
+The target only sends a 32-bit hash of each format string plus the raw arguments. This script
+rebuilds the hash -> format string table by scanning the sources, then formats each record.
+
+usage:
+    python log_decode.py /dev/ttyACM0                   # live from the board (needs pyserial)
+    python log_decode.py capture.bin --src ../..        # from a raw capture
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "telemetry"))
+from telemetry_decode import frames, read_source  # noqa: E402
+
+TELEMETRY_LOG = 2
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+
+LOG_CALL = re.compile(r'LOG_(?:ERROR|WARN|INFO|DEBUG)\(\s*"((?:[^"\\]|\\.)*)"')
+SPECIFIER = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[hlLzjt]*([diuxXcfFeEgGs%])")
+
+
+def log_token(fmt):
+    # FNV-1a, same as logToken() in Debug.hpp
+    h = 2166136261
+    for byte in fmt.encode():
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def scan_tokens(root):
+    tokens = {}
+    for folder in ("lib", "src"):
+        for dirpath, _, filenames in os.walk(os.path.join(root, folder)):
+            for name in filenames:
+                if not name.endswith((".cpp", ".h", ".hpp")):
+                    continue
+                path = os.path.join(dirpath, name)
+                with open(path, encoding="utf-8", errors="replace") as f:
+                    for line_no, line in enumerate(f, 1):
+                        for match in LOG_CALL.finditer(line):
+                            fmt = bytes(match.group(1), "utf-8").decode("unicode_escape")
+                            token = log_token(fmt)
+                            where = f"{os.path.relpath(path, root)}:{line_no}"
+                            if token in tokens and tokens[token][0] != fmt:
+                                print(f"token collision: {where} and {tokens[token][1]}", file=sys.stderr)
+                            tokens.setdefault(token, (fmt, where))
+    return tokens
+
+
+def expand(fmt, payload):
+    args = []
+    offset = 0
+    for spec in SPECIFIER.finditer(fmt):
+        kind = spec.group(1)
+        if kind == "%":
+            continue
+        if kind == "s":
+            length = payload[offset]
+            args.append(payload[offset + 1 : offset + 1 + length].decode(errors="replace"))
+            offset += 1 + length
+        elif kind in "fFeEgG":
+            args.append(struct.unpack_from("<f", payload, offset)[0])
+            offset += 4
+        else:
+            value = struct.unpack_from("<i", payload, offset)[0]
+            args.append(value & 0xFFFFFFFF if kind in "uxX" else value)
+            offset += 4
+
+    # drop C length modifiers python doesn't understand
+    return re.sub(r"%([-+ #0]*\d*(?:\.\d+)?)[hlLzjt]+", r"%\1", fmt) % tuple(args)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="serial port or raw capture file")
+    parser.add_argument("--src", default=os.path.join(here, "..", ".."), help="project root to scan for format strings")
+    parser.add_argument("--baud", type=int, default=921600)
+    args = parser.parse_args()
+
+    tokens = scan_tokens(args.src)
+
+    try:
+        for frame_type, seq, payload in frames(read_source(args.source, args.baud)):
+            if frame_type != TELEMETRY_LOG or len(payload) < 5:
+                continue
+
+            level = LEVELS.get(payload[0], str(payload[0]))
+            token = struct.unpack_from("<I", payload, 1)[0]
+
+            if token not in tokens:
+                print(f"{seq:5d} [{level}] <unknown token {token:08x}>")
+                continue
+
+            fmt, where = tokens[token]
+            try:
+                message = expand(fmt, payload[5:])
+            except (struct.error, IndexError, TypeError):
+                message = fmt + " <bad arguments>"
+
+            print(f"{seq:5d} [{level}] {where}: {message}")
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,239 @@
+"""
+Static RAM budget of the firmware, run by PlatformIO after every link (extra_scripts in platformio.ini)
+
+Reports .data + .bss per subsystem (the lib/ folder, src, framework or external library each variable was compiled
+in), the deepest stack from main plus the deepest interrupt on top of it, worked out from the call graph gcc writes
+with -fcallgraph-info=su, and the arena buffers. The build fails when anything is over its custom_ram_budget.
+
+usage:
+    pio run -e nucleo_f446re                                  # as a post action
+    python ram_budget.py .pio/build/nucleo_f446re             # by hand, needs arm-none-eabi-nm on the path
+    python ram_budget.py build/ --nm nm --ini ../../platformio.ini --env nucleo_f446re
+"""
+
+import argparse
+import configparser
+import os
+import re
+import subprocess
+import sys
+from collections import defaultdict
+
+# an indirect call (virtual Adafruit_GFX drawing, HardwareTimer callbacks) can't be followed through the graph,
+# this much is allowed for whatever it reaches
+INDIRECT_CALL_BYTES = 512
+# Cortex-M4F exception entry with the FPU context stacked
+EXCEPTION_FRAME_BYTES = 104
+# interrupt entry points, besides the vector table's *_IRQHandler / *_Handler
+ISR_LABEL = re.compile(r"::isr\(\)")
+
+NODE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+STACK = re.compile(r"(\d+) bytes \(([\w,]+)\)")
+
+
+def subsystem_of(build_dir, path):
+    # .pio/build/<env>/lib<hash>/<library>/..., src/..., FrameworkArduino/...
+    parts = os.path.relpath(path, build_dir).split(os.sep)
+    if parts[0].startswith("lib") and len(parts) > 2:
+        return parts[1]
+    if parts[0].startswith("Framework"):
+        return "framework"
+    return parts[0]
+
+
+def files_under(build_dir, extension):
+    for root, _, names in os.walk(build_dir):
+        for name in names:
+            if name.endswith(extension):
+                yield os.path.join(root, name)
+
+
+def nm_symbols(nm, path):
+    # (name, size, type) of every sized symbol
+    out = subprocess.run([nm, "-S", "--defined-only", path], capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            yield fields[3], int(fields[1], 16), fields[2]
+
+
+def static_ram(nm, build_dir, elf):
+    # owner of each variable from the objects, sizes from the linked image so discarded sections don't count
+    owners = {}
+    for obj in files_under(build_dir, ".o"):
+        subsystem = subsystem_of(build_dir, obj)
+        for name, _, kind in nm_symbols(nm, obj):
+            if kind in "bBdD":
+                owners.setdefault(name, subsystem)
+
+    per_subsystem = defaultdict(int)
+    largest = defaultdict(list)
+    for name, size, kind in nm_symbols(nm, elf):
+        if kind in "bBdD" and size:
+            subsystem = owners.get(name, "other")
+            per_subsystem[subsystem] += size
+            largest[subsystem].append((size, name))
+
+    return per_subsystem, {s: sorted(v, reverse=True)[:3] for s, v in largest.items()}
+
+
+def call_graph(build_dir):
+    frames = {}  # title -> (bytes, label)
+    calls = defaultdict(set)
+    unbounded = set()
+
+    for path in files_under(build_dir, ".ci"):
+        with open(path) as f:
+            for line in f:
+                node = NODE.search(line)
+                if node:
+                    title, label = node.groups()
+                    stack = STACK.search(label)
+                    if stack:
+                        frames[title] = (int(stack.group(1)), label.split("\\n")[0])
+                        if stack.group(2) == "dynamic":  # alloca or a VLA, not "dynamic,bounded"
+                            unbounded.add(title)
+                    elif title not in frames:
+                        frames[title] = (0, label)
+                    continue
+
+                edge = EDGE.search(line)
+                if edge:
+                    calls[edge.group(1)].add(edge.group(2))
+
+    return frames, calls, unbounded
+
+
+def deepest(frames, calls, root):
+    # worst case stack from root and the chain that reaches it, recursion is cut and reported
+    memo = {}
+    recursive = set()
+
+    def walk(title, active):
+        if title == "__indirect_call":
+            return INDIRECT_CALL_BYTES, [title]
+        if title in memo:
+            return memo[title]
+        if title in active:
+            recursive.add(title)
+            return 0, []
+
+        active.add(title)
+        worst, chain = 0, []
+        for callee in calls.get(title, ()):
+            depth, path = walk(callee, active)
+            if depth > worst:
+                worst, chain = depth, path
+        active.discard(title)
+
+        result = (frames.get(title, (0, title))[0] + worst, [title] + chain)
+        memo[title] = result
+        return result
+
+    return walk(root, set()), recursive
+
+
+def read_budget(ini, env_name):
+    parser = configparser.ConfigParser(inline_comment_prefixes=(";",))
+    parser.read(ini)
+    section = "env:" + env_name
+    ram_size = int(parser.get(section, "custom_ram_size", fallback="0"))
+
+    budget = {}
+    for line in parser.get(section, "custom_ram_budget", fallback="").splitlines():
+        fields = line.split()
+        if len(fields) == 2:
+            budget[fields[0]] = int(fields[1])
+    return ram_size, budget
+
+
+def report(nm, build_dir, elf, ram_size, budget):
+    per_subsystem, largest = static_ram(nm, build_dir, elf)
+    frames, calls, unbounded = call_graph(build_dir)
+    failed = []
+
+    def check(name, used):
+        limit = budget.get(name)
+        status = ""
+        if limit is not None:
+            status = "%6.1f%% of %d" % (100.0 * used / limit, limit)
+            if used > limit:
+                status += "  OVER"
+                failed.append(name)
+        return status
+
+    print("\nStatic RAM (.data + .bss)")
+    for subsystem, used in sorted(per_subsystem.items(), key=lambda item: -item[1]):
+        biggest = ", ".join("%s %d" % (name, size) for size, name in largest[subsystem])
+        print("  %-22s %7d  %-26s %s" % (subsystem, used, check(subsystem, used), biggest))
+    static_total = sum(per_subsystem.values())
+
+    arenas = [(name, size) for name, size, kind in nm_symbols(nm, elf) if "ArenaBuffer" in name]
+    for name, size in arenas:
+        print("  arena %-16s %7d  (high water is logged by the firmware at run time)" % (name, size))
+
+    stack = 0
+    if frames:
+        (main_depth, main_chain), recursive = deepest(frames, calls, "main")
+
+        isr_depth, isr_chain = 0, []
+        for title, (_, label) in frames.items():
+            if title.endswith("Handler") or ISR_LABEL.search(label):
+                (depth, chain), more = deepest(frames, calls, title)
+                recursive |= more
+                if depth > isr_depth:
+                    isr_depth, isr_chain = depth, chain
+
+        stack = main_depth + isr_depth + (EXCEPTION_FRAME_BYTES if isr_chain else 0)
+        print("\nPeak stack %d  %s" % (stack, check("stack", stack)))
+        print("  main %d: %s" % (main_depth, " > ".join(frames.get(t, (0, t))[1] for t in main_chain)))
+        if isr_chain:
+            print("  interrupt %d: %s" % (isr_depth, " > ".join(frames.get(t, (0, t))[1] for t in isr_chain)))
+        for title in sorted(recursive):
+            print("  recursion not counted: %s" % frames.get(title, (0, title))[1])
+        for title in sorted(unbounded):
+            print("  unbounded frame, only its fixed part counted: %s" % frames[title][1])
+    else:
+        print("\nPeak stack unknown, build with -fcallgraph-info=su")
+
+    total = static_total + stack
+    print("\nTotal %d static + %d stack = %d  %s" % (static_total, stack, total, check("total", total)))
+    if ram_size and total > ram_size:
+        failed.append("RAM size %d" % ram_size)
+
+    if failed:
+        print("RAM budget exceeded: %s" % ", ".join(failed))
+    return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("build_dir")
+    parser.add_argument("--elf", help="default firmware.elf in build_dir")
+    parser.add_argument("--nm", default="arm-none-eabi-nm")
+    parser.add_argument("--ini", default="platformio.ini")
+    parser.add_argument("--env", default="nucleo_f446re")
+    args = parser.parse_args()
+
+    ram_size, budget = read_budget(args.ini, args.env)
+    elf = args.elf or os.path.join(args.build_dir, "firmware.elf")
+    return 0 if report(args.nm, args.build_dir, elf, ram_size, budget) else 1
+
+
+try:
+    Import("env")  # noqa: F821, only defined when SCons runs this as an extra script
+except NameError:
+    env = None
+
+if env is None:
+    if __name__ == "__main__":
+        sys.exit(main())
+else:
+
+    def ram_budget_action(target, source, env):
+        ram_size, budget = read_budget(env.subst("$PROJECT_CONFIG"), env.subst("$PIOENV"))
+        nm = env.subst("$CC").replace("gcc", "nm")
+        return 0 if report(nm, env.subst("$BUILD_DIR"), str(target[0]), ram_size, budget) else 1
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", ram_budget_action)
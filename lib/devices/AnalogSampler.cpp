@@ -0,0 +1,230 @@
+#include "AnalogSampler.h"
+
+AnalogSampler analogSampler;
+
+volatile bool AnalogSampler::adcLocked = false;
+
+AnalogSampler::AnalogSampler() : timer(nullptr), pin(0), decimation(1), resolutionBits(12), sum(0), count(0),
+                                 blockStartMicros(0), head(0), tail(0), overruns(0), skipped(0)
+{
+}
+
+bool AnalogSampler::begin(uint32_t pin_, uint32_t rateHz, uint16_t decimation_, uint8_t resolutionBits_)
+{
+    // the F4 ADC converts at 12, 10, 8 or 6 bits
+    if ((rateHz == 0) || (decimation_ == 0) || (resolutionBits_ < 6) || (resolutionBits_ > 12) || (resolutionBits_ & 1))
+    {
+        return false;
+    }
+
+    end();
+
+    pin = pin_;
+    decimation = decimation_;
+    resolutionBits = resolutionBits_;
+    sum = 0;
+    count = 0;
+    head = 0;
+    tail = 0;
+    overruns = 0;
+    skipped = 0;
+
+    if (!startAdc())
+    {
+        LOG_ERROR("Analog sampler: pin %d has no ADC channel", pin);
+        return false;
+    }
+
+    if (!timer)
+    {
+        timer = new HardwareTimer(ANALOG_SAMPLER_TIMER);
+    }
+
+    timer->setOverflow(rateHz, HERTZ_FORMAT);
+    timer->attachInterrupt([]() { analogSampler.isr(); });
+    timer->resume();
+
+    LOG_INFO("Analog sampler: %d Hz, decimation %d", rateHz, decimation);
+
+    return true;
+}
+
+void AnalogSampler::end()
+{
+    if (timer)
+    {
+        timer->pause();
+        timer->detachInterrupt();
+    }
+    stopAdc();
+}
+
+bool AnalogSampler::startAdc()
+{
+#ifdef TARGET_ENV_NATIVE
+    pinMode(pin, INPUT);
+    return true;
+#else
+    // analogRead() would initialise the ADC, convert once and shut it down again on every call. Instead the pin's
+    // channel converts over and over on ADC2 and the interrupt only reads the data register
+    PinName pinName = analogInputToPinName(pin);
+    if (pinName == NC)
+    {
+        return false;
+    }
+    uint32_t function = pinmap_function(pinName, PinMap_ADC);
+    if (function == (uint32_t)NC)
+    {
+        return false;
+    }
+    uint32_t channel = STM_PIN_CHANNEL(function);
+    pinmap_pinout(pinName, PinMap_ADC); // analog mode
+
+    __HAL_RCC_ADC2_CLK_ENABLE();
+    ADC->CCR = (ADC->CCR & ~ADC_CCR_ADCPRE) | ADC_CCR_ADCPRE_0; // PCLK2 / 4, inside the 36 MHz limit
+
+    ANALOG_SAMPLER_ADC->CR2 = 0;
+    ANALOG_SAMPLER_ADC->CR1 = ((12 - resolutionBits) / 2) << ADC_CR1_RES_Pos;
+
+    // longest sample time, 480 cycles: the source has time to settle and it still converts ~10x the tick rate
+    if (channel < 10)
+    {
+        ANALOG_SAMPLER_ADC->SMPR2 |= 0x7UL << (3 * channel);
+    }
+    else
+    {
+        ANALOG_SAMPLER_ADC->SMPR1 |= 0x7UL << (3 * (channel - 10));
+    }
+
+    ANALOG_SAMPLER_ADC->SQR1 = 0; // one conversion in the sequence
+    ANALOG_SAMPLER_ADC->SQR3 = channel;
+    ANALOG_SAMPLER_ADC->CR2 = ADC_CR2_ADON | ADC_CR2_CONT;
+    delayMicroseconds(3); // tSTAB
+    ANALOG_SAMPLER_ADC->CR2 |= ADC_CR2_SWSTART;
+
+    // DR reads 0 until the first conversion lands, ~25 us at 480 cycles. Wait it out so a restart between ticks
+    // never hands the interrupt a zero
+    uint32_t startMicros = micros();
+    while (!(ANALOG_SAMPLER_ADC->SR & ADC_SR_EOC) && (micros() - startMicros < 100))
+    {
+    }
+
+    return true;
+#endif
+}
+
+void AnalogSampler::stopAdc()
+{
+#ifndef TARGET_ENV_NATIVE
+    ANALOG_SAMPLER_ADC->CR2 &= ~(ADC_CR2_ADON | ADC_CR2_CONT);
+#endif
+}
+
+uint32_t AnalogSampler::readAdc()
+{
+#ifdef TARGET_ENV_NATIVE
+    return analogRead(pin);
+#else
+    return ANALOG_SAMPLER_ADC->DR; // the newest conversion
+#endif
+}
+
+bool AnalogSampler::isRunning()
+{
+    return timer && timer->isRunning();
+}
+
+void AnalogSampler::isr()
+{
+    // the touch panel is mid read, converting now would disturb both
+    if (adcLocked)
+    {
+        skipped++;
+        return;
+    }
+
+    if (count == 0)
+    {
+        blockStartMicros = micros();
+    }
+
+    sum += readAdc();
+
+    if (++count < decimation)
+    {
+        return;
+    }
+
+    uint8_t next = (head + 1) & (ANALOG_SAMPLER_RING - 1);
+
+    // full: drop the oldest, after an idle spell the main loop should get what the pin reads now.
+    // read() masks this interrupt while it copies, so the slot it is reading is never the one moved past
+    if (next == tail)
+    {
+        tail = (tail + 1) & (ANALOG_SAMPLER_RING - 1);
+        overruns++;
+    }
+
+    analogSample &sample = ring[head];
+    sample.timeMicros = blockStartMicros + (micros() - blockStartMicros) / 2;
+    sample.counts = (float)sum / decimation;
+    __asm__ __volatile__("" ::: "memory"); // sample is written before it's published
+    head = next;
+
+    sum = 0;
+    count = 0;
+}
+
+uint8_t AnalogSampler::available()
+{
+    return (head - tail) & (ANALOG_SAMPLER_RING - 1);
+}
+
+bool AnalogSampler::read(analogSample &sample)
+{
+    // the interrupt moves tail too when the ring is full
+    noInterrupts();
+
+    if (head == tail)
+    {
+        interrupts();
+        return false;
+    }
+
+    sample = ring[tail];
+    tail = (tail + 1) & (ANALOG_SAMPLER_RING - 1);
+
+    interrupts();
+    return true;
+}
+
+uint32_t AnalogSampler::getOverruns()
+{
+    return overruns;
+}
+
+uint32_t AnalogSampler::getSkipped()
+{
+    return skipped;
+}
+
+uint8_t AnalogSampler::getResolution()
+{
+    return resolutionBits;
+}
+
+void AnalogSampler::lockAdc()
+{
+    adcLocked = true;
+}
+
+void AnalogSampler::unlockAdc()
+{
+    // analogRead() de-initialises its ADC when it's done, and on the F4 that pulses the reset shared by all three.
+    // Start ADC2 again before the next tick reads it
+    if (analogSampler.isRunning())
+    {
+        analogSampler.startAdc();
+    }
+    adcLocked = false;
+}
@@ -0,0 +1,72 @@
+#ifndef ANALOG_SAMPLER_H
+#define ANALOG_SAMPLER_H
+
+#include <Arduino.h>
+#include "Debug.hpp"
+
+#define ANALOG_SAMPLER_RING 32 // decimated samples, a power of two
+#define ANALOG_SAMPLER_TIMER TIM7 // basic timer, no pins, not used by PWM
+#define ANALOG_SAMPLER_ADC ADC2   // free running, analogRead() and with it the touch panel have ADC1
+
+struct analogSample
+{
+    uint32_t timeMicros; // middle of the averaged block
+    float counts;        // mean ADC reading over the block
+};
+
+// Continuous acquisition of one analog pin. ADC2 is started once in continuous mode, a timer interrupt takes its
+// latest result at a fixed rate (one register read, no HAL) and a boxcar (first order CIC) stage averages every
+// `decimation` of them into one timestamped sample, which goes into a ring buffer the main loop reads from. The
+// touch panel switches its drive pins around its analogRead()s, wrap them in lockAdc()/unlockAdc() and the sampler
+// skips those ticks instead of picking up the disturbance. analogRead() resets every ADC on its way out, so
+// unlockAdc() also restarts ADC2. A full ring drops its oldest sample, reads always start from recent ones.
+class AnalogSampler
+{
+public:
+    AnalogSampler();
+
+    bool begin(uint32_t pin_, uint32_t rateHz, uint16_t decimation_, uint8_t resolutionBits_ = 12);
+    void end();
+    bool isRunning();
+
+    uint8_t available();
+    bool read(analogSample &sample);
+
+    uint32_t getOverruns(); // oldest decimated samples dropped because the ring was full
+    uint32_t getSkipped();  // conversions skipped while the ADC was locked
+    uint8_t getResolution();
+
+    static void lockAdc();
+    static void unlockAdc();
+
+    void isr();
+
+private:
+    bool startAdc();
+    void stopAdc();
+    uint32_t readAdc();
+
+    HardwareTimer *timer;
+    uint32_t pin;
+    uint16_t decimation;
+    uint8_t resolutionBits;
+
+    // accumulator, interrupt only
+    uint32_t sum;
+    uint16_t count;
+    uint32_t blockStartMicros;
+
+    // single producer (interrupt) single consumer ring
+    analogSample ring[ANALOG_SAMPLER_RING];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+
+    volatile uint32_t overruns;
+    volatile uint32_t skipped;
+
+    static volatile bool adcLocked;
+};
+
+extern AnalogSampler analogSampler;
+
+#endif // ANALOG_SAMPLER_H
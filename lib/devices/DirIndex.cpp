@@ -0,0 +1,227 @@
+#include "DirIndex.h"
+
+DirIndex dirIndex;
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+DirIndex::DirIndex() : current(-1), matchCount(0), stamp(0), scans(0)
+{
+    invalidate();
+}
+
+bool DirIndex::select(const char *folder, const char *extension)
+{
+    char key[DIR_INDEX_PATH_LEN];
+    normalise(folder, key, sizeof(key));
+
+    int8_t slot = findFolder(key);
+
+    if (slot < 0 || listings[slot].stale)
+    {
+        if (slot < 0)
+        {
+            // a free slot, otherwise the least recently used
+            slot = 0;
+            for (int8_t i = 1; i < DIR_INDEX_FOLDERS; i++)
+            {
+                if (listings[i].lastUsed < listings[slot].lastUsed)
+                {
+                    slot = i;
+                }
+            }
+        }
+
+        dirListing &listing = listings[slot];
+        strncpy(listing.folder, key, sizeof(listing.folder));
+        listing.folder[sizeof(listing.folder) - 1] = '\0';
+
+        if (!scan(listing))
+        {
+            listing.folder[0] = '\0';
+            listing.lastUsed = 0;
+            current = -1;
+            matchCount = 0;
+            return false;
+        }
+    }
+
+    dirListing &listing = listings[slot];
+    listing.lastUsed = ++stamp;
+    current = slot;
+
+    matchCount = 0;
+    for (uint16_t i = 0; i < listing.count; i++)
+    {
+        if (endsWith(listing.names[i], extension))
+        {
+            matches[matchCount++] = i;
+        }
+    }
+
+    return true;
+}
+
+uint16_t DirIndex::getCount()
+{
+    return matchCount;
+}
+
+const char *DirIndex::getName(uint16_t i)
+{
+    return (current >= 0 && i < matchCount) ? listings[current].names[matches[i]] : "";
+}
+
+bool DirIndex::contains(const char *name)
+{
+    if (current < 0)
+    {
+        return false;
+    }
+
+    char key[DIR_INDEX_NAME_LEN + 1];
+    normalise(name, key, sizeof(key));
+
+    // normalise() added a leading slash, names are stored without
+    const dirListing &listing = listings[current];
+    return bsearch(key + 1, listing.names, listing.count, DIR_INDEX_NAME_LEN, compareNames) != nullptr;
+}
+
+void DirIndex::touch(const char *path)
+{
+    char key[DIR_INDEX_PATH_LEN];
+    normalise(path, key, sizeof(key));
+
+    char *slash = strrchr(key, '/');
+    if (slash == key)
+    {
+        slash++; // a file in the root
+    }
+    *slash = '\0';
+
+    int8_t slot = findFolder(key);
+    if (slot >= 0)
+    {
+        listings[slot].stale = true;
+    }
+}
+
+void DirIndex::invalidate()
+{
+    for (uint8_t i = 0; i < DIR_INDEX_FOLDERS; i++)
+    {
+        listings[i].folder[0] = '\0';
+        listings[i].lastUsed = 0;
+        listings[i].count = 0;
+    }
+    current = -1;
+    matchCount = 0;
+}
+
+uint32_t DirIndex::getScans()
+{
+    return scans;
+}
+
+int8_t DirIndex::findFolder(const char *folder)
+{
+    for (int8_t i = 0; i < DIR_INDEX_FOLDERS; i++)
+    {
+        if (listings[i].folder[0] && strcmp(listings[i].folder, folder) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool DirIndex::scan(dirListing &listing)
+{
+    File folder = SD.open(listing.folder);
+    if (!folder || !folder.isDirectory())
+    {
+        LOG_WARN("Failed to open folder: %s", listing.folder);
+        return false;
+    }
+
+    scans++;
+    listing.count = 0;
+    listing.stale = false;
+
+    while (true)
+    {
+        File file = folder.openNextFile();
+        if (!file)
+        {
+            break;
+        }
+
+        if (!file.isDirectory())
+        {
+            if (listing.count >= DIR_INDEX_MAX_FILES)
+            {
+                LOG_WARN("%s has more than %d files", listing.folder, DIR_INDEX_MAX_FILES);
+                file.close();
+                break;
+            }
+
+            strncpy(listing.names[listing.count], file.name(), DIR_INDEX_NAME_LEN);
+            listing.names[listing.count][DIR_INDEX_NAME_LEN - 1] = '\0';
+            listing.count++;
+        }
+
+        file.close();
+    }
+
+    folder.close();
+
+    // the card returns entries in the order they were created
+    qsort(listing.names, listing.count, DIR_INDEX_NAME_LEN, compareNames);
+
+    return true;
+}
+
+void DirIndex::normalise(const char *path, char *out, size_t size)
+{
+    // upper case like the 8.3 names the card returns, one leading slash and no trailing one
+    size_t length = 0;
+    out[length++] = '/';
+
+    for (const char *c = path; *c && length < size - 1; c++)
+    {
+        if (*c == '/' && out[length - 1] == '/')
+        {
+            continue;
+        }
+        out[length++] = toupper(*c);
+    }
+
+    if (length > 1 && out[length - 1] == '/')
+    {
+        length--;
+    }
+    out[length] = '\0';
+}
+
+bool DirIndex::endsWith(const char *name, const char *suffix)
+{
+    size_t nameLength = strlen(name);
+    size_t suffixLength = strlen(suffix);
+
+    if (suffixLength > nameLength)
+    {
+        return false;
+    }
+
+    const char *tail = name + nameLength - suffixLength;
+    for (size_t i = 0; i < suffixLength; i++)
+    {
+        if (toupper(tail[i]) != toupper(suffix[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
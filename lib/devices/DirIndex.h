@@ -0,0 +1,57 @@
+#ifndef DIR_INDEX_H
+#define DIR_INDEX_H
+
+#include "Arduino.h"
+#include <SD.h>
+#include "Debug.hpp"
+
+// Sorted listings of card folders kept in RAM. A folder is read from the card by the first listing after it changed
+// instead of every entry being reopened each time a page lists it. Everything in the firmware that creates or
+// removes a file calls touch() with its path, and a remount drops every listing, so a listing is current as long as
+// the card isn't written by anything else while it is mounted.
+#define DIR_INDEX_FOLDERS 3     // listings kept, the least recently used is replaced
+#define DIR_INDEX_MAX_FILES 256 // per folder, the rest are left out
+#define DIR_INDEX_NAME_LEN 13   // 8.3 name and terminator
+#define DIR_INDEX_PATH_LEN 24
+
+struct dirListing
+{
+    char folder[DIR_INDEX_PATH_LEN]; // upper case with a leading slash, empty when the slot is free
+    bool stale;
+    uint32_t lastUsed;
+    uint16_t count;
+    char names[DIR_INDEX_MAX_FILES][DIR_INDEX_NAME_LEN]; // files only, sorted
+};
+
+class DirIndex
+{
+public:
+    DirIndex();
+
+    // the files in folder ending in extension ("" for all) become getCount()/getName(), sorted by name
+    bool select(const char *folder, const char *extension);
+    uint16_t getCount();
+    const char *getName(uint16_t i);
+    bool contains(const char *name); // any file in the selected folder, whatever the extension
+
+    void touch(const char *path); // a file at path was created or removed
+    void invalidate();            // card removed or remounted
+    uint32_t getScans();          // folders read from the card
+
+private:
+    int8_t findFolder(const char *folder);
+    bool scan(dirListing &listing);
+    static void normalise(const char *path, char *out, size_t size);
+    static bool endsWith(const char *name, const char *suffix);
+
+    dirListing listings[DIR_INDEX_FOLDERS];
+    int8_t current; // listing of the selection, -1 for none
+    uint16_t matches[DIR_INDEX_MAX_FILES]; // names of the selected listing with the extension
+    uint16_t matchCount;
+    uint32_t stamp;
+    uint32_t scans;
+};
+
+extern DirIndex dirIndex;
+
+#endif // DIR_INDEX_H
@@ -0,0 +1,281 @@
+#include "LogIndex.h"
+
+LogIndex::LogIndex() : fileOpen(false), blocks(0), startTime(0), endTime(0), minPressure(0), linesRead(0)
+{
+    reset();
+}
+
+LogIndex::~LogIndex()
+{
+    close();
+}
+
+void LogIndex::reset()
+{
+    block.lines = 0;
+}
+
+bool LogIndex::add(uint32_t offset, float time, float pressure, float setpoint)
+{
+    if (block.lines == 0)
+    {
+        block.offset = offset;
+        block.startTime = time;
+        block.minPressure = block.maxPressure = pressure;
+        block.minSetpoint = block.maxSetpoint = setpoint;
+    }
+
+    block.endTime = time;
+    block.minPressure = min(block.minPressure, pressure);
+    block.maxPressure = max(block.maxPressure, pressure);
+    block.minSetpoint = min(block.minSetpoint, setpoint);
+    block.maxSetpoint = max(block.maxSetpoint, setpoint);
+    block.lines++;
+
+    return block.lines >= LOG_INDEX_BLOCK;
+}
+
+bool LogIndex::finishBlock(logIndexEntry &entry)
+{
+    if (block.lines == 0)
+    {
+        return false;
+    }
+
+    entry = block;
+    block.lines = 0;
+    return true;
+}
+
+bool LogIndex::open(const char *logPath)
+{
+    close();
+
+    indexFile = SD.open(indexPath(logPath).c_str(), FILE_READ);
+    if (!indexFile)
+    {
+        return false;
+    }
+
+    bool valid = (indexFile.read(&header, sizeof(header)) == sizeof(header));
+    valid = valid && (header.magic == LOG_INDEX_MAGIC) && (header.version == LOG_INDEX_VERSION) && (header.columns.time != LOG_NO_COLUMN);
+
+    blocks = valid ? (indexFile.size() - sizeof(header)) / sizeof(logIndexEntry) : 0;
+
+    logFile = SD.open(logPath, FILE_READ);
+    fileOpen = true;
+
+    if (!valid || (blocks == 0) || !logFile)
+    {
+        close();
+        return false;
+    }
+
+    // span and depth of the whole run, one pass over the index
+    logIndexEntry entry;
+    minPressure = 1e9;
+    for (uint32_t i = 0; i < blocks && readEntry(i, entry); i++)
+    {
+        if (i == 0)
+        {
+            startTime = entry.startTime;
+        }
+        endTime = entry.endTime;
+        minPressure = min(minPressure, entry.minPressure);
+    }
+
+    return true;
+}
+
+void LogIndex::close()
+{
+    if (fileOpen)
+    {
+        indexFile.close();
+        logFile.close();
+        fileOpen = false;
+    }
+    blocks = 0;
+}
+
+uint32_t LogIndex::getBlocks()
+{
+    return blocks;
+}
+
+float LogIndex::getStartTime()
+{
+    return startTime;
+}
+
+float LogIndex::getEndTime()
+{
+    return endTime;
+}
+
+float LogIndex::getMinPressure()
+{
+    return minPressure;
+}
+
+uint32_t LogIndex::getLinesRead()
+{
+    return linesRead;
+}
+
+bool LogIndex::plot(float startTime_, float endTime_, logPlotColumn *columns, uint16_t count)
+{
+    linesRead = 0;
+
+    if (!fileOpen || (endTime_ <= startTime_) || (count == 0))
+    {
+        return false;
+    }
+
+    for (uint16_t c = 0; c < count; c++)
+    {
+        columns[c] = {1e9f, -1e9f, 1e9f, -1e9f};
+    }
+
+    // the whole run always comes from the index. A zoom where each block is wider than a couple of columns would
+    // smear its min/max, so the blocks in view are read line by line
+    logIndexEntry entry;
+    bool detail = false;
+    if ((startTime_ > startTime) || (endTime_ < endTime))
+    {
+        uint32_t inView = 0;
+        for (uint32_t i = 0; i < blocks && readEntry(i, entry); i++)
+        {
+            if ((entry.endTime >= startTime_) && (entry.startTime <= endTime_))
+            {
+                inView++;
+            }
+        }
+        detail = (inView * 2 < count);
+    }
+
+    float scale = count / (endTime_ - startTime_);
+
+    for (uint32_t i = 0; i < blocks && readEntry(i, entry); i++)
+    {
+        if ((entry.endTime < startTime_) || (entry.startTime > endTime_))
+        {
+            continue;
+        }
+
+        if (detail)
+        {
+            readBlockLines(entry, startTime_, endTime_, columns, count);
+            continue;
+        }
+
+        int first = constrain((int)((max(entry.startTime, startTime_) - startTime_) * scale), 0, count - 1);
+        int last = constrain((int)((min(entry.endTime, endTime_) - startTime_) * scale), 0, count - 1);
+
+        for (int c = first; c <= last; c++)
+        {
+            merge(columns[c], entry.minPressure, entry.maxPressure, entry.minSetpoint, entry.maxSetpoint);
+        }
+    }
+
+    return true;
+}
+
+bool LogIndex::readEntry(uint32_t index, logIndexEntry &entry)
+{
+    // sequential indices stay in the sector the library already has cached
+    return indexFile.seek(sizeof(header) + index * sizeof(logIndexEntry)) &&
+           (indexFile.read(&entry, sizeof(entry)) == sizeof(entry));
+}
+
+bool LogIndex::readBlockLines(const logIndexEntry &entry, float startTime_, float endTime_, logPlotColumn *columns, uint16_t count)
+{
+    if (!logFile.seek(entry.offset))
+    {
+        return false;
+    }
+
+    float scale = count / (endTime_ - startTime_);
+    int8_t lastColumn = max(header.columns.time, max(header.columns.pressure, header.columns.setpoint));
+
+    for (uint32_t n = 0; n < entry.lines; n++)
+    {
+        char line[96];
+        size_t len = logFile.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+        linesRead++;
+
+        // the columns this log has, the setpoint falls back to the block's range
+        float time = 0;
+        float pressure = entry.minPressure;
+        float minSetpoint = entry.minSetpoint;
+        float maxSetpoint = entry.maxSetpoint;
+
+        // a line with an empty or missing column is left out, reading it as 0 would put a spike in the plot
+        bool valid = true;
+        int8_t column = 0;
+        char *ptr = line;
+        for (; column <= lastColumn; column++)
+        {
+            char *end;
+            float value = strtof(ptr, &end);
+            if (end == ptr)
+            {
+                valid = (column != header.columns.time) && (column != header.columns.pressure) &&
+                        (column != header.columns.setpoint);
+                if (!valid)
+                {
+                    break;
+                }
+            }
+
+            if (column == header.columns.time)
+            {
+                time = value;
+            }
+            else if (column == header.columns.pressure)
+            {
+                pressure = value;
+            }
+            else if (column == header.columns.setpoint)
+            {
+                minSetpoint = maxSetpoint = value;
+            }
+
+            ptr = strchr(end, ',');
+            if (!ptr)
+            {
+                break;
+            }
+            ptr++;
+        }
+
+        if (!valid || (column < lastColumn))
+        {
+            continue;
+        }
+
+        if ((time < startTime_) || (time > endTime_))
+        {
+            continue;
+        }
+
+        int c = constrain((int)((time - startTime_) * scale), 0, count - 1);
+        merge(columns[c], pressure, pressure, minSetpoint, maxSetpoint);
+    }
+
+    return true;
+}
+
+void LogIndex::merge(logPlotColumn &column, float minPressure_, float maxPressure_, float minSetpoint, float maxSetpoint)
+{
+    column.minPressure = min(column.minPressure, minPressure_);
+    column.maxPressure = max(column.maxPressure, maxPressure_);
+    column.minSetpoint = min(column.minSetpoint, minSetpoint);
+    column.maxSetpoint = max(column.maxSetpoint, maxSetpoint);
+}
+
+pathString LogIndex::indexPath(const char *logPath)
+{
+    return withExtension(logPath, ".IDX");
+}
@@ -0,0 +1,94 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include "Arduino.h"
+#include <SD.h>
+#include "FixedString.hpp"
+
+// Sidecar index of a CSV log, written next to it with the extension .IDX. Every LOG_INDEX_BLOCK lines of the log
+// get one fixed size entry with the block's file offset, time span and min/max of pressure and setpoint, so a
+// plot of a whole run only reads the index (16 entries a sector) and a zoomed plot only the log blocks it shows.
+#define LOG_INDEX_BLOCK 32 // log lines per entry
+#define LOG_INDEX_MAGIC 0x3158494C // "LIX1"
+#define LOG_INDEX_VERSION 1
+#define LOG_NO_COLUMN -1
+
+struct logColumns
+{
+    int8_t time; // CSV column of each value, LOG_NO_COLUMN if the log doesn't have it
+    int8_t pressure;
+    int8_t setpoint;
+};
+
+struct logIndexHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t blockLines;
+    logColumns columns;
+    uint8_t reserved;
+};
+
+struct logIndexEntry
+{
+    uint32_t offset; // of the block's first line in the log
+    uint32_t lines;
+    float startTime; // s
+    float endTime;
+    float minPressure; // Pa
+    float maxPressure;
+    float minSetpoint;
+    float maxSetpoint;
+};
+
+// one screen column of a plot, min > max when nothing falls in it
+struct logPlotColumn
+{
+    float minPressure;
+    float maxPressure;
+    float minSetpoint;
+    float maxSetpoint;
+};
+
+class LogIndex
+{
+public:
+    LogIndex();
+    ~LogIndex();
+
+    // writing: Sd passes every indexed line through add()
+    void reset();
+    bool add(uint32_t offset, float time, float pressure, float setpoint);
+    bool finishBlock(logIndexEntry &entry);
+
+    // reading
+    bool open(const char *logPath);
+    void close();
+    uint32_t getBlocks();
+    float getStartTime();
+    float getEndTime();
+    float getMinPressure();
+    bool plot(float startTime, float endTime, logPlotColumn *columns, uint16_t count);
+    uint32_t getLinesRead(); // log lines parsed by plot(), the rest came from the index
+
+    static pathString indexPath(const char *logPath);
+
+private:
+    bool readEntry(uint32_t block, logIndexEntry &entry);
+    bool readBlockLines(const logIndexEntry &entry, float startTime, float endTime, logPlotColumn *columns, uint16_t count);
+    static void merge(logPlotColumn &column, float minPressure, float maxPressure, float minSetpoint, float maxSetpoint);
+
+    logIndexEntry block; // being filled while writing
+
+    File indexFile;
+    File logFile;
+    bool fileOpen;
+    logIndexHeader header;
+    uint32_t blocks;
+    float startTime;
+    float endTime;
+    float minPressure;
+    uint32_t linesRead;
+};
+
+#endif // LOG_INDEX_H
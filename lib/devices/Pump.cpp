@@ -1,34 +1,115 @@
 #include "Pump.h"
 
-Pump::Pump() : minSpeed(0), maxSpeed(255), pwmPin(MOTOR_PWM), dirPin(MOTOR_DIR)
+Pump::Pump() : timer(nullptr), channel(0), periodTicks(0), slewRate(PUMP_SLEW_RATE), lastCommandMicros(0), writes(0),
+               interlocked(false), pwmPin(MOTOR_PWM), dirPin(MOTOR_DIR)
 {
-    pinMode(pwmPin, OUTPUT);
+    command = {0, 0, BLOW};
+
     pinMode(dirPin, OUTPUT);
+    digitalWrite(dirPin, command.direction);
+
+    begin();
+}
+
+void Pump::begin()
+{
+    // the timer and channel that drive the PWM pin, analogWrite() would pick the same one at 8 bits and 1 kHz
+    PinName pin = digitalPinToPinName(pwmPin);
+    TIM_TypeDef *instance = (TIM_TypeDef *)pinmap_peripheral(pin, PinMap_PWM);
+    channel = STM_PIN_CHANNEL(pinmap_function(pin, PinMap_PWM));
 
-    sendCommand(0); // default to off
+    timer = new HardwareTimer(instance);
+    timer->setMode(channel, TIMER_OUTPUT_COMPARE_PWM1, pwmPin);
+    timer->setOverflow(PUMP_PWM_FREQ, HERTZ_FORMAT);
+    periodTicks = timer->getOverflow(TICK_FORMAT);
+    timer->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT); // default to off
+    timer->resume();
 }
 
 // speed is a percentage, -100 to 100
 void Pump::sendCommand(double speed)
 {
-    if (speed >= 0)
+    uint8_t direction = (speed >= 0) ? BLOW : SUCK;
+    float target = interlocked ? 0 : constrain(fabs(speed), 0, 100);
+
+    // ramp towards the target, a stop goes straight through
+    unsigned long now = micros();
+    if ((slewRate > 0) && (target > 0))
+    {
+        // a reversal ramps down through zero first
+        float current = (direction == command.direction) ? command.speed : -command.speed;
+        float step = slewRate * (now - lastCommandMicros) * 1e-6f;
+        target = constrain(target, current - step, current + step);
+
+        if (target < 0)
+        {
+            direction = command.direction;
+            target = -target;
+        }
+    }
+    lastCommandMicros = now;
+
+    command.speed = target;
+    write((uint32_t)(target * ((1 << PUMP_PWM_BITS) - 1) / 100.0f + 0.5f), direction);
+}
+
+void Pump::write(uint32_t duty, uint8_t direction)
+{
+    // control ticks mostly repeat the last command near equilibrium, only touch the hardware on a change
+    if (direction != command.direction)
     {
-        command.direction = BLOW;
+        digitalWrite(dirPin, direction); // need to find which direction is suck and blow
+        command.direction = direction;
     }
-    else
+
+    if (duty != command.duty)
     {
-        command.direction = SUCK;
-        speed = -speed;
+        uint32_t compare = (uint32_t)((uint64_t)duty * periodTicks / ((1 << PUMP_PWM_BITS) - 1));
+        timer->setCaptureCompare(channel, compare, TICK_COMPARE_FORMAT);
+        command.duty = duty;
+        writes++;
+
+        // the interlock tripped between the check in sendCommand() and the write above
+        if (interlocked)
+        {
+            timer->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT);
+        }
     }
+}
 
-    speed = (uint8_t)round(constrain(speed, 0, 100));       // make sure it's in the range 0-100 and an integer
-    command.speed = map(speed, 0, 100, minSpeed, maxSpeed); // map to 0-255
+void Pump::forceOff()
+{
+    // straight to the compare register, command is left for sendCommand() to catch up with
+    interlocked = true;
+    timer->setCaptureCompare(channel, 0, TICK_COMPARE_FORMAT);
+}
+
+void Pump::releaseInterlock()
+{
+    interlocked = false;
+}
+
+bool Pump::isInterlocked()
+{
+    return interlocked;
+}
 
-    digitalWrite(dirPin, command.direction); // need to find which direction is suck and blow
-    analogWrite(pwmPin, command.speed);      // range is 0-255
+bool Pump::isDriving()
+{
+    return !interlocked && (command.duty != 0);
 }
 
 PumpCommand Pump::getCommand()
 {
     return command;
-}
\ No newline at end of file
+}
+
+void Pump::setSlewRate(float percentPerSecond)
+{
+    slewRate = percentPerSecond;
+}
+
+uint32_t Pump::getWrites()
+{
+    return writes;
+}
@@ -4,9 +4,29 @@
 #include "Arduino.h"
 #include "Debug.hpp"
 
+// PWM carrier, above hearing. Duty resolution is PUMP_PWM_BITS but never more than the timer has ticks per period:
+// 90 MHz / 20 kHz is 4500 ticks, a little over 12 bits, 16 bits needs 1.4 kHz or lower
+#ifndef PUMP_PWM_FREQ
+#define PUMP_PWM_FREQ 20000
+#endif
+
+#ifndef PUMP_PWM_BITS
+#define PUMP_PWM_BITS 12
+#endif
+
+#if (PUMP_PWM_BITS < 8) || (PUMP_PWM_BITS > 16)
+#error "PUMP_PWM_BITS must be between 8 and 16"
+#endif
+
+// largest change of the command in percent per second, 0 turns the limit off. Stopping is never limited
+#ifndef PUMP_SLEW_RATE
+#define PUMP_SLEW_RATE 0
+#endif
+
 struct PumpCommand
 {
-    uint8_t speed;
+    float speed;       // percent actually applied after slew limiting, 0 to 100
+    uint32_t duty;     // 0 to (1 << PUMP_PWM_BITS) - 1
     uint8_t direction;
 };
 
@@ -17,11 +37,28 @@ public:
     void sendCommand(double speed);
     PumpCommand getCommand();
 
+    void setSlewRate(float percentPerSecond);
+    uint32_t getWrites(); // compare register writes, unchanged commands don't add any
+
+    // safety interlock: forceOff() is safe from an interrupt, after it every command is 0 until releaseInterlock()
+    void forceOff();
+    void releaseInterlock();
+    bool isInterlocked();
+    bool isDriving();
+
 private:
-    int maxSpeed;
-    int minSpeed;
+    void begin();
+    void write(uint32_t duty, uint8_t direction);
+
+    HardwareTimer *timer;
+    uint32_t channel;
+    uint32_t periodTicks;
 
     PumpCommand command;
+    float slewRate;
+    unsigned long lastCommandMicros;
+    uint32_t writes;
+    volatile bool interlocked;
 
     int pwmPin;
     int dirPin;
@@ -31,4 +68,4 @@ private:
     const uint8_t BLOW = HIGH;
 };
 
-#endif // PUMP_H
\ No newline at end of file
+#endif // PUMP_H
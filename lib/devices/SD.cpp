@@ -1,85 +1,78 @@
-#include "Sd.hpp"
+#define LOG_MODULE_LEVEL WARN // card and folder messages are only needed when debugging the card
 
-Sd::Sd(size_t bufferSize) : isFileOpen(false), initialised(false), maxBufferSize(bufferSize) {}
+#include "SD.hpp"
+
+Sd::Sd(size_t bufferSize) : isFileOpen(false), indexed(false), fileBytes(0), pendingCount(0), bufferLength(0),
+                             bufferCapacity(bufferSize + SD_LINE_MAX), maxBufferSize(bufferSize), initialised(false)
+{
+    // the only allocation, logging never grows it
+    buffer = new char[bufferCapacity];
+}
 
 Sd::~Sd()
 {
     // Ensure the file is closed and buffer is flushed upon object destruction
-    flushBuffer();
-    if (isFileOpen)
-    {
-        dataFile.close();
-    }
+    closeFile();
+    delete[] buffer;
 }
 
-bool Sd::createNestedDirectories(String prefix)
+bool Sd::createNestedDirectories(const char *prefix)
 {
     bool success = true;
 
-    // Count how many slashes are in the prefix
-    uint8_t count = 0;
-    for (int i = 0; i < prefix.length(); i++)
-    {
-        if (prefix.charAt(i) == '/')
-        {
-            count++;
-        }
-    }
+    // every folder up to the last slash, "/A/B/log" makes A then A/B
+    const char *start = (prefix[0] == '/') ? prefix + 1 : prefix;
+    char folder[PATH_MAX_LENGTH + 1];
 
-    if (count > 0)
+    for (const char *slash = strchr(start, '/'); slash != nullptr; slash = strchr(slash + 1, '/'))
     {
-        int start = 0;
-        if (prefix.charAt(0) == '/')
-        {
-            start = 1; // Skip the leading slash
-        }
+        size_t length = min((size_t)(slash - start), sizeof(folder) - 1);
+        memcpy(folder, start, length);
+        folder[length] = '\0';
 
-        // Start from 'start' instead of 0 when taking the substring
-        int pos = prefix.indexOf('/', start);
-        while (pos != -1)
-        {
-            String folder = prefix.substring(start, pos);
-
-            DBG("Creating folder: " + folder);
+        LOG_DEBUG("Creating folder: %s", folder);
 
-            if (!SD.exists(folder))
+        if (!SD.exists(folder))
+        {
+            if (!SD.mkdir(folder))
             {
-                if (!SD.mkdir(folder))
-                {
-                    DBG("Failed to create folder: " + folder);
-                    success = false;
-                    break;
-                }
-                else
-                {
-                    DBG("Folder created: " + folder);
-                }
+                LOG_ERROR("Failed to create folder: %s", folder);
+                success = false;
+                break;
             }
             else
             {
-                DBG("Folder exists: " + folder);
+                LOG_INFO("Folder created: %s", folder);
             }
-            pos = prefix.indexOf('/', pos + 1);
+        }
+        else
+        {
+            LOG_DEBUG("Folder exists: %s", folder);
         }
     }
 
     return success;
 }
 
-bool Sd::createFile(String StartMsg, String prefix)
+bool Sd::createFile(const char *StartMsg, const char *prefix)
 {
     bool success = false;
 
+    // finish the previous log before starting a new one
+    closeFile();
+
     // first lets make sure we have the correct folder
     createNestedDirectories(prefix);
 
     fileName = createUniqueLogFile(prefix);
-    DBG("File name: " + fileName);
+    LOG_INFO("File name: %s", fileName.c_str());
     dataFile = SD.open(fileName.c_str(), FILE_WRITE);
+    dirIndex.touch(fileName.c_str());
     if (dataFile)
     {
         dataFile.println(StartMsg);
         dataFile.flush();
+        fileBytes = dataFile.position();
         isFileOpen = true;
         success = true;
     }
@@ -91,6 +84,68 @@ bool Sd::createFile(String StartMsg, String prefix)
     return success;
 }
 
+bool Sd::createIndexedFile(const char *StartMsg, const char *prefix, logColumns columns)
+{
+    if (!createFile(StartMsg, prefix))
+    {
+        return false;
+    }
+
+    // the index sits next to the log and is written block by block as the log grows
+    pathString path = LogIndex::indexPath(fileName.c_str());
+    if (SD.exists(path.c_str()))
+    {
+        SD.remove(path.c_str());
+    }
+
+    indexFile = SD.open(path.c_str(), FILE_WRITE);
+    dirIndex.touch(path.c_str());
+    if (!indexFile)
+    {
+        LOG_WARN("No index for %s", fileName.c_str());
+        return true; // the log itself is fine
+    }
+
+    logIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = LOG_INDEX_MAGIC;
+    header.version = LOG_INDEX_VERSION;
+    header.blockLines = LOG_INDEX_BLOCK;
+    header.columns = columns;
+
+    indexFile.write((const uint8_t *)&header, sizeof(header));
+    indexFile.flush();
+
+    index.reset();
+    pendingCount = 0;
+    indexed = true;
+
+    return true;
+}
+
+void Sd::closeFile()
+{
+    flushBuffer();
+
+    if (indexed)
+    {
+        // the last, partly filled block
+        if (index.finishBlock(pendingBlocks[pendingCount]))
+        {
+            pendingCount++;
+        }
+        writePendingBlocks();
+        indexFile.close();
+        indexed = false;
+    }
+
+    if (isFileOpen)
+    {
+        dataFile.close();
+        isFileOpen = false;
+    }
+}
+
 bool Sd::init(int CS)
 {
     // got rid of a condition to only initialise if not already initialised
@@ -98,23 +153,55 @@ bool Sd::init(int CS)
     // See if the card is present and can be initialized:
     if (!SD.begin(CS))
     {
-        DBG("Card failed, or not present");
+        LOG_ERROR("Card failed, or not present");
         initialised = false;
     }
     else
     {
-        DBG("Card initialised.");
+        LOG_INFO("Card initialised.");
         initialised = true;
+        dirIndex.invalidate(); // may be a different card
+
+#ifdef SD_DETECT
+        pinMode(SD_DETECT, INPUT_PULLUP);
+#else
+        if (!SD.exists(SD_PROBE_FILE))
+        {
+            File probe = SD.open(SD_PROBE_FILE, FILE_WRITE);
+            probe.write((uint8_t)0);
+            probe.close();
+        }
+#endif
     }
     return initialised;
 }
 
-bool Sd::writeToBuffer(String dataString)
+bool Sd::writeToBuffer(const char *data)
 {
-    buffer += dataString; // Add newline for each entry
+    size_t length = strlen(data);
+
+    if (bufferLength + length > bufferCapacity)
+    {
+        flushBuffer();
+    }
+
+    if (bufferLength + length > bufferCapacity)
+    {
+        // no file to flush to, or longer than the whole buffer
+        if (!isFileOpen)
+        {
+            return false;
+        }
+        dataFile.write((const uint8_t *)data, length);
+        fileBytes += length;
+        return true;
+    }
+
+    memcpy(buffer + bufferLength, data, length);
+    bufferLength += length;
 
     // Check if buffer size exceeds the maximum size
-    if (buffer.length() >= maxBufferSize)
+    if (bufferLength >= maxBufferSize)
     {
         flushBuffer(); // Write to SD card if buffer is full
     }
@@ -122,28 +209,60 @@ bool Sd::writeToBuffer(String dataString)
     return true;
 }
 
+bool Sd::writeSample(const char *line, float time, float pressure, float setpoint)
+{
+    // the line starts where the buffer ends, once everything before it is on the card
+    if (indexed && index.add(fileBytes + bufferLength, time, pressure, setpoint))
+    {
+        index.finishBlock(pendingBlocks[pendingCount++]);
+
+        if (pendingCount == sizeof(pendingBlocks) / sizeof(pendingBlocks[0]))
+        {
+            writePendingBlocks();
+        }
+    }
+
+    return writeToBuffer(line);
+}
+
 void Sd::flushBuffer()
 {
-    if (isFileOpen && buffer.length() > 0)
+    PROFILE_SCOPE(PROBE_SD_FLUSH);
+
+    if (isFileOpen && bufferLength > 0)
+    {
+        dataFile.write((const uint8_t *)buffer, bufferLength); // Write buffer content to file
+        fileBytes += bufferLength;
+        bufferLength = 0;                                      // Clear the buffer
+        dataFile.flush();                                      // Ensure data is written to the card
+    }
+
+    writePendingBlocks();
+}
+
+void Sd::writePendingBlocks()
+{
+    // entries go out with the log writes, an entry never points past what is on the card for long
+    if (indexed && pendingCount > 0)
     {
-        dataFile.print(buffer); // Write buffer content to file
-        buffer = "";            // Clear the buffer
-        dataFile.flush();       // Ensure data is written to the card
+        indexFile.write((const uint8_t *)pendingBlocks, pendingCount * sizeof(logIndexEntry));
+        indexFile.flush();
     }
+    pendingCount = 0;
 }
 
-String Sd::createUniqueLogFile(String prefix)
+pathString Sd::createUniqueLogFile(const char *prefix)
 {
-    String uniqueFileName;
+    char uniqueFileName[PATH_MAX_LENGTH + 1];
     uint32_t currentLogIndex = 0;
 
     // Generate a unique file name
     do
     {
-        uniqueFileName = String(prefix) + "_" + String(currentLogIndex++) + ".csv";
-    } while (SD.exists(uniqueFileName.c_str())); // Check if the file already exists
+        snprintf(uniqueFileName, sizeof(uniqueFileName), "%s_%lu.csv", prefix, (unsigned long)currentLogIndex++);
+    } while (SD.exists(uniqueFileName)); // Check if the file already exists
 
-    return uniqueFileName;
+    return pathString(uniqueFileName);
 }
 
 bool Sd::isInitialized()
@@ -151,6 +270,39 @@ bool Sd::isInitialized()
     return isFileOpen;
 }
 
+bool Sd::checkDevice()
+{
+    if (!initialised)
+    {
+        return false;
+    }
+
+#ifdef SD_DETECT
+    bool present = (digitalRead(SD_DETECT) == LOW);
+#else
+    // the library has no card status call and serves the root and the one block it caches from RAM. Opening the
+    // probe file leaves its directory block in the cache, so reading its data always has to go to the card
+    File probe = SD.open(SD_PROBE_FILE, FILE_READ);
+    bool present = probe && (probe.read() >= 0);
+    probe.close();
+#endif
+
+    if (!present)
+    {
+        // the card was pulled: the log file went with it, and the library needs a reset before begin() works again
+        LOG_ERROR("Card removed");
+        dirIndex.invalidate();
+        isFileOpen = false;
+        indexed = false;
+        pendingCount = 0;
+        bufferLength = 0;
+        SD.end();
+        initialised = false;
+    }
+
+    return present;
+}
+
 bool Sd::loadGainsFromFile(const char *filename, gainScheduleData &gainSchedule)
 {
     bool gainsLoaded = false;
@@ -158,7 +310,8 @@ bool Sd::loadGainsFromFile(const char *filename, gainScheduleData &gainSchedule)
     File file = SD.open(filename, FILE_READ);
     if (!file)
     {
-        DBG("Failed to open file: " + String(filename));
+        LOG_ERROR("Failed to open file: %s", filename);
+        return false;
     }
 
     gainSchedule.height = 0;
@@ -187,18 +340,18 @@ bool Sd::loadGainsFromFile(const char *filename, gainScheduleData &gainSchedule)
 
             if (*ptr == '\0')
             {
-                DBG("Incomplete data in line");
+                LOG_ERROR("Incomplete data in line: %s", line);
+                file.close();
                 return false;
             }
 
             // Parse the float value
             char *endPtr;
-            double value = strtof(ptr, &endPtr);
+            float value = strtof(ptr, &endPtr);
 
             if (ptr == endPtr)
             {
-                Serial.print("Failed to parse float in line: ");
-                DBG(line);
+                LOG_ERROR("Failed to parse float in line: %s", line);
                 break;
             }
 
@@ -226,5 +379,233 @@ bool Sd::loadGainsFromFile(const char *filename, gainScheduleData &gainSchedule)
 
     file.close();
 
+    // sort rows by operating pressure (insertion sort, files are short and usually already sorted)
+    for (uint8_t i = 1; i < gainSchedule.height; i++)
+    {
+        float row[gainScheduleData::width];
+        memcpy(row, gainSchedule.data[i], sizeof(row));
+
+        int8_t j = i - 1;
+        while (j >= 0 && gainSchedule.data[j][3] > row[3])
+        {
+            memcpy(gainSchedule.data[j + 1], gainSchedule.data[j], sizeof(row));
+            j--;
+        }
+        memcpy(gainSchedule.data[j + 1], row, sizeof(row));
+    }
+
     return gainsLoaded;
-}
\ No newline at end of file
+}
+
+bool Sd::loadGainSchedule(const char *filename, gainScheduleData &gainSchedule)
+{
+    // the CSV is only parsed when its compiled copy is missing or stale, otherwise the
+    // rows are read straight out of the binary file
+    uint32_t sourceSize = 0;
+    uint32_t sourceCrc = 0;
+
+    if (!checksumFile(filename, sourceSize, sourceCrc))
+    {
+        LOG_ERROR("Failed to open file: %s", filename);
+        return false;
+    }
+
+    pathString compiledPath = withExtension(filename, ".gsb");
+
+    if (readCompiledGains(compiledPath.c_str(), sourceSize, sourceCrc, gainSchedule))
+    {
+        LOG_INFO("Loaded compiled gains: %s", compiledPath.c_str());
+        return true;
+    }
+
+    if (!loadGainsFromFile(filename, gainSchedule))
+    {
+        return false;
+    }
+
+    if (!writeCompiledGains(compiledPath.c_str(), sourceSize, sourceCrc, gainSchedule))
+    {
+        LOG_WARN("Failed to write compiled gains: %s", compiledPath.c_str()); // not fatal, will parse again next time
+    }
+
+    return true;
+}
+
+bool Sd::checksumFile(const char *filename, uint32_t &size, uint32_t &crc)
+{
+    File file = SD.open(filename, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+
+    size = file.size();
+    crc = 0;
+
+    uint8_t chunk[64];
+    int len;
+    while ((len = file.read(chunk, sizeof(chunk))) > 0)
+    {
+        crc = crc32Update(crc, chunk, len);
+    }
+
+    file.close();
+
+    return true;
+}
+
+bool Sd::readCompiledGains(const char *path, uint32_t sourceSize, uint32_t sourceCrc, gainScheduleData &gainSchedule)
+{
+    File file = SD.open(path, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+
+    gainScheduleHeader header;
+    bool valid = (file.read(&header, sizeof(header)) == sizeof(header));
+
+    valid = valid && (header.magic == GAIN_SCHEDULE_MAGIC) && (header.version == GAIN_SCHEDULE_VERSION);
+    valid = valid && (header.width == gainScheduleData::width) && (header.height > 0) && (header.height <= MAX_GAIN_ROWS);
+    valid = valid && (header.sourceSize == sourceSize) && (header.sourceCrc == sourceCrc);
+
+    if (valid)
+    {
+        size_t rowsSize = header.height * sizeof(gainSchedule.data[0]);
+        valid = (file.read(gainSchedule.data, rowsSize) == (int)rowsSize) && (crc32(gainSchedule.data, rowsSize) == header.dataCrc);
+    }
+
+    file.close();
+
+    gainSchedule.height = valid ? header.height : 0;
+
+    return valid;
+}
+
+bool Sd::writeCompiledGains(const char *path, uint32_t sourceSize, uint32_t sourceCrc, const gainScheduleData &gainSchedule)
+{
+    size_t rowsSize = gainSchedule.height * sizeof(gainSchedule.data[0]);
+
+    gainScheduleHeader header;
+    header.magic = GAIN_SCHEDULE_MAGIC;
+    header.version = GAIN_SCHEDULE_VERSION;
+    header.height = gainSchedule.height;
+    header.width = gainScheduleData::width;
+    header.sourceSize = sourceSize;
+    header.sourceCrc = sourceCrc;
+    header.dataCrc = crc32(gainSchedule.data, rowsSize);
+
+    // FILE_WRITE appends, start from an empty file
+    if (SD.exists(path))
+    {
+        SD.remove(path);
+    }
+
+    File file = SD.open(path, FILE_WRITE);
+    dirIndex.touch(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    bool success = (file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header));
+    success = success && (file.write((const uint8_t *)gainSchedule.data, rowsSize) == rowsSize);
+
+    file.close();
+
+    if (!success)
+    {
+        SD.remove(path); // don't leave a truncated file behind
+    }
+
+    return success;
+}
+
+bool Sd::loadPumpCurve(const char *filename, PumpCurve &curve)
+{
+    File file = SD.open(filename, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+
+    pumpCurveHeader header;
+    bool valid = (file.read(&header, sizeof(header)) == sizeof(header));
+
+    valid = valid && (header.magic == PUMP_CURVE_MAGIC) && (header.version == PUMP_CURVE_VERSION);
+    valid = valid && (header.commands == PUMP_CURVE_COMMANDS) && (header.pressures == PUMP_CURVE_PRESSURES);
+
+    // read into a copy, a bad file leaves the curve in use alone
+    pumpCurveTable table;
+    valid = valid && (file.read(&table, sizeof(table)) == (int)sizeof(table)) && (crc32(&table, sizeof(table)) == header.dataCrc);
+
+    file.close();
+
+    if (valid)
+    {
+        curve.table = table;
+        curve.measured = true;
+    }
+
+    return valid;
+}
+
+bool Sd::savePumpCurve(const char *filename, const PumpCurve &curve)
+{
+    pumpCurveHeader header;
+    header.magic = PUMP_CURVE_MAGIC;
+    header.version = PUMP_CURVE_VERSION;
+    header.commands = PUMP_CURVE_COMMANDS;
+    header.pressures = PUMP_CURVE_PRESSURES;
+    header.dataCrc = crc32(&curve.table, sizeof(curve.table));
+
+    // FILE_WRITE appends, start from an empty file
+    if (SD.exists(filename))
+    {
+        SD.remove(filename);
+    }
+
+    File file = SD.open(filename, FILE_WRITE);
+    dirIndex.touch(filename);
+    if (!file)
+    {
+        return false;
+    }
+
+    bool success = (file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header));
+    success = success && (file.write((const uint8_t *)&curve.table, sizeof(curve.table)) == sizeof(curve.table));
+
+    file.close();
+
+    if (!success)
+    {
+        SD.remove(filename); // don't leave a truncated file behind
+    }
+
+    return success;
+}
+
+bool Sd::appendLine(const char *filename, const char *header, const char *line)
+{
+    // one line added to a table that grows across power cycles, the header goes in when the file is new
+    createNestedDirectories(filename);
+
+    bool isNew = !SD.exists(filename);
+
+    File file = SD.open(filename, FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+
+    if (isNew)
+    {
+        dirIndex.touch(filename);
+        file.println(header);
+    }
+
+    bool success = file.println(line) > 0;
+    file.close();
+
+    return success;
+}
@@ -6,30 +6,66 @@
 #include "Arduino.h"
 #include "Debug.hpp"
 #include "gainScheduleData.h"
+#include "PumpCurve.h"
+#include "LogIndex.h"
+#include "DirIndex.h"
+#include "FixedString.hpp"
+#include "Checksum.hpp"
+#include "Profiler.hpp"
+
+#define SD_LINE_MAX 128 // longest write that always fits in the buffer, longer ones may go straight to the card
+
+// One byte file checkDevice() reads back when the socket has no card detect switch. Build with SD_DETECT=<pin> to
+// read the switch instead, LOW with a card in
+#define SD_PROBE_FILE "/PROBE.BIN"
 
 class Sd
 {
 public:
     Sd(size_t bufferSize = 512);
     ~Sd();
+    Sd(const Sd &) = delete;
+    Sd &operator=(const Sd &) = delete;
 
     bool init(int CS);
-    bool createFile(String StartMsg, String prefix);
+    bool createFile(const char *StartMsg, const char *prefix);
+    bool createIndexedFile(const char *StartMsg, const char *prefix, logColumns columns);
+    void closeFile();
 
-    bool writeToBuffer(String dataString);
+    bool writeToBuffer(const char *data);
+    bool writeSample(const char *line, float time, float pressure, float setpoint);
     void flushBuffer();
     bool isInitialized();
     bool checkDevice();
     bool loadGainsFromFile(const char *filename, gainScheduleData &gainSchedule);
+    bool loadGainSchedule(const char *filename, gainScheduleData &gainSchedule);
+    bool loadPumpCurve(const char *filename, PumpCurve &curve);
+    bool savePumpCurve(const char *filename, const PumpCurve &curve);
+    bool appendLine(const char *filename, const char *header, const char *line);
 
-    String createUniqueLogFile(String prefix);
-    bool createNestedDirectories(String prefix);
+    pathString createUniqueLogFile(const char *prefix);
+    bool createNestedDirectories(const char *prefix);
 
 private:
+    bool checksumFile(const char *filename, uint32_t &size, uint32_t &crc);
+    bool readCompiledGains(const char *path, uint32_t sourceSize, uint32_t sourceCrc, gainScheduleData &gainSchedule);
+    bool writeCompiledGains(const char *path, uint32_t sourceSize, uint32_t sourceCrc, const gainScheduleData &gainSchedule);
+
     File dataFile;
-    String fileName;
+    pathString fileName;
     bool isFileOpen;
-    String buffer;
+
+    // sidecar index of an indexed log, finished blocks wait here for the next flush
+    File indexFile;
+    bool indexed;
+    uint32_t fileBytes; // log size once the buffer is written, the offset of the next line
+    LogIndex index;
+    logIndexEntry pendingBlocks[4];
+    uint8_t pendingCount;
+    void writePendingBlocks();
+    char *buffer; // allocated once, flushed when maxBufferSize is reached
+    size_t bufferLength;
+    size_t bufferCapacity;
     size_t maxBufferSize;
     bool initialised;
 };
@@ -1,6 +1,8 @@
-#include "PressureSensor.h"
+#include "pressureSensor.h"
 
-PressureSensor::PressureSensor() : basePressure(0), ADC_RES(12)
+PressureSensor::PressureSensor() : basePressure(0), baseValid(false), lastTrackMillis(0), trackCount(0),
+                                   channels{{Adafruit_BMP280(&wire)}, {Adafruit_BMP280(&wire)}}, numChannels(0), nextChannel(0),
+                                   ADC_RES(12), continuous(false), lastCounts(0), lastSampleMicros(0)
 {
     // from datasheet: 0psi = 0.5V, 75psi = 2.5V, 150psi = 4.5V
     scaleFactor = 75.0 / (2.5 - 0.5);
@@ -10,13 +12,40 @@ PressureSensor::PressureSensor() : basePressure(0), ADC_RES(12)
 bool PressureSensor::begin(u_int8_t sensorPin_)
 {
     sensorType = analog;
+    continuous = false;
     // ensure sensorPin is an analog pin
     sensorPin = sensorPin_;
     pinMode(sensorPin, INPUT);
     delay(50);
 
-    calibrateBasePressure();
-    return true;
+    return checkBasePressure(); // only the first begin() calibrates
+}
+
+bool PressureSensor::beginContinuous(uint8_t sensorPin_, uint32_t rateHz, uint16_t decimation)
+{
+    sensorType = analog;
+    sensorPin = sensorPin_;
+
+    continuous = analogSampler.begin(sensorPin, rateHz, decimation, ADC_RES);
+    if (!continuous)
+    {
+        return false;
+    }
+
+    // wait for the first decimated sample, calibration starts from it
+    uint32_t start = millis();
+    while (!analogSampler.available())
+    {
+        if (millis() - start > 100)
+        {
+            analogSampler.end();
+            continuous = false;
+            return false;
+        }
+        delay(1);
+    }
+
+    return checkBasePressure(); // only the first begin() calibrates
 }
 
 void PressureSensor::calibrateBasePressure()
@@ -24,106 +53,428 @@ void PressureSensor::calibrateBasePressure()
     int numReadingsAvg = 20; // this will take 1 second to calibrate
     float avgPressure = 0;
 
+    if (sensorType == BMP280)
+    {
+        // average each sensor on its own, the offsets line every sensor up with the mean of all of them
+        float sum[MAX_BMP280_SENSORS] = {0};
+        int count[MAX_BMP280_SENSORS] = {0};
+
+        for (int i = 0; i < numReadingsAvg * numChannels; i++)
+        {
+            uint8_t index;
+            float reading;
+
+            if (readNext(index, reading))
+            {
+                sum[index] += reading + channels[index].offset; // the sensor's own reading, a kept offset is replaced
+                count[index]++;
+            }
+        }
+
+        int sensors = 0;
+        for (uint8_t i = 0; i < numChannels; i++)
+        {
+            if (count[i] > 0)
+            {
+                avgPressure += sum[i] / count[i];
+                sensors++;
+            }
+        }
+
+        if (sensors == 0)
+        {
+            return;
+        }
+
+        basePressure = avgPressure / sensors;
+
+        for (uint8_t i = 0; i < numChannels; i++)
+        {
+            channels[i].offset = (count[i] > 0) ? (sum[i] / count[i]) - basePressure : 0;
+        }
+
+        baseValid = true;
+        trackCount = 0;
+        DBG(basePressure);
+        return;
+    }
+
     for (int i = 0; i < numReadingsAvg; i++)
     {
-        avgPressure += getPressure(false);
+        float reading;
+        readRaw(reading);
+        avgPressure += reading;
         delay(50);
     }
 
     basePressure = avgPressure / numReadingsAvg;
+    baseValid = true;
+    trackCount = 0;
     DBG(basePressure);
 }
 
+bool PressureSensor::trackBasePressure()
+{
+    // called from idle loops while the pump is off, refines the estimate instead of recalibrating before every run
+    if (!baseValid || (millis() - lastTrackMillis < BASE_TRACK_INTERVAL_MS))
+    {
+        return false;
+    }
+    lastTrackMillis = millis();
+
+    float reading;
+    if (!readRaw(reading))
+    {
+        trackCount = 0;
+        return false;
+    }
+
+    if (trackCount == 0)
+    {
+        trackSum = 0;
+        trackMin = reading;
+        trackMax = reading;
+    }
+
+    trackSum += reading;
+    trackMin = min(trackMin, reading);
+    trackMax = max(trackMax, reading);
+
+    if (++trackCount < BASE_TRACK_BLOCK)
+    {
+        return false;
+    }
+    trackCount = 0;
+
+    // a moving block means the chamber is still leaking back, one far from the estimate means it isn't open to ambient
+    float mean = trackSum / BASE_TRACK_BLOCK;
+    if (((trackMax - trackMin) > tolerance(BASE_STABLE_PA, 4)) || (fabs(mean - basePressure) > tolerance(BASE_WINDOW_PA, 8)))
+    {
+        return false;
+    }
+
+    basePressure += BASE_TRACK_ALPHA * (mean - basePressure);
+    return true;
+}
+
+bool PressureSensor::checkBasePressure()
+{
+    // one reading at run start, the full calibration only runs when there is no estimate or it looks wrong
+    float reading;
+
+    if (baseValid && readRaw(reading))
+    {
+        float error = reading - basePressure;
+        if (fabs(error) <= tolerance(BASE_SANITY_PA, 8))
+        {
+            return true;
+        }
+
+        LOG_WARN("Base pressure off by %f Pa, recalibrating", error);
+    }
+
+    calibrateBasePressure();
+    return baseValid;
+}
+
+float PressureSensor::tolerance(float pascals, float counts)
+{
+    // one ADC count of the analog sensor is ~200 Pa at 12 bit, far coarser than the BMP280
+    if (sensorType == analog)
+    {
+        return max(pascals, counts * (countsToPressure(1) - countsToPressure(0)));
+    }
+    return pascals;
+}
+
 bool PressureSensor::begin(uint8_t SDA_, uint8_t SCL_, uint8_t addr_)
 {
     sensorType = BMP280;
 
     wire.begin(SDA_, SCL_);
-    bmp = Adafruit_BMP280(&wire);
-    addr = addr_;
+    numChannels = 1;
+    nextChannel = 0;
 
-    if (!bmp.begin(addr))
+    if (!beginChannel(channels[0], addr_))
     {
         return false;
     }
 
-    /* Default settings from datasheet. */
-    bmp.setSampling(Adafruit_BMP280::MODE_FORCED,   /* Operating Mode. */
-                    Adafruit_BMP280::SAMPLING_NONE, /* Temp. oversampling */
-                    Adafruit_BMP280::SAMPLING_X16,  /* Pressure oversampling */
-                    Adafruit_BMP280::FILTER_X16,    /* Filtering. */
-                    Adafruit_BMP280::STANDBY_MS_1); /* Standby time. */
+    triggerConversion(channels[0]);
 
-    delay(20);
+    return checkBasePressure(); // only the first begin() calibrates
+}
 
-    calibrateBasePressure();
+bool PressureSensor::begin(uint8_t SDA_, uint8_t SCL_, uint8_t addrA, uint8_t addrB)
+{
+    sensorType = BMP280;
 
-    // DBG(basePressure);
+    wire.begin(SDA_, SCL_);
+    numChannels = 2;
+    nextChannel = 0;
 
-    return true;
+    // either sensor is enough to run, a missing one is just left out
+    bool activeA = beginChannel(channels[0], addrA);
+    bool activeB = beginChannel(channels[1], addrB);
+
+    if (!activeA && !activeB)
+    {
+        return false;
+    }
+
+    // stagger the conversions by half a conversion time
+    if (activeA)
+    {
+        triggerConversion(channels[0]);
+    }
+    if (activeA && activeB)
+    {
+        delayMicroseconds(BMP280_CONVERSION_US / 2);
+    }
+    if (activeB)
+    {
+        triggerConversion(channels[1]);
+    }
+
+    LOG_INFO("BMP280 0x%x: %d, 0x%x: %d", addrA, activeA, addrB, activeB);
+
+    return checkBasePressure(); // only the first begin() calibrates
 }
 
-float PressureSensor::getBasePressure()
+bool PressureSensor::beginChannel(bmpChannel &channel, uint8_t addr_)
 {
-    return basePressure;
+    // a sensor coming back keeps the offset it was calibrated with
+    if (!baseValid || (channel.addr != addr_))
+    {
+        channel.offset = 0;
+    }
+
+    // the driver is built once in the constructor, begin() replaces the I2C device it allocated last time
+    channel.addr = addr_;
+    channel.failures = 0;
+    channel.triggerMicros = micros();
+    channel.active = channel.bmp.begin(addr_);
+
+    if (channel.active)
+    {
+        channel.retryMillis = BMP280_RETRY_MS;
+    }
+    else
+    {
+        uint32_t interval = max(channel.retryMillis, (uint32_t)BMP280_RETRY_MS);
+        channel.nextRetryMillis = millis() + interval;
+        channel.retryMillis = min(interval * 2, (uint32_t)BMP280_RETRY_MAX_MS);
+    }
+
+    return channel.active;
 }
 
-bool PressureSensor::testConnection()
+void PressureSensor::triggerConversion(bmpChannel &channel)
 {
-    if (sensorType == BMP280)
+    // writing the control register in forced mode starts one conversion, takeForcedMeasurement() would also wait for it
+    channel.bmp.setSampling(Adafruit_BMP280::MODE_FORCED,   /* Operating Mode. */
+                            Adafruit_BMP280::SAMPLING_NONE, /* Temp. oversampling */
+                            Adafruit_BMP280::SAMPLING_X16,  /* Pressure oversampling */
+                            Adafruit_BMP280::FILTER_X16,    /* Filtering. */
+                            Adafruit_BMP280::STANDBY_MS_1); /* Standby time. */
+
+    channel.triggerMicros = micros();
+}
+
+bool PressureSensor::readNext(uint8_t &index, float &reading)
+{
+    // next active sensor in turn, a bad reading moves on to the other one so a dropout doesn't cost a sample
+    for (uint8_t attempt = 0; attempt < numChannels * BMP280_MAX_FAILURES; attempt++)
     {
-        uint8_t status = bmp.getStatus();
+        index = nextChannel;
+        nextChannel = (nextChannel + 1) % numChannels;
 
-        if (status == 243) // BMP280_REGISTER_STATUS, apparently this is what happens when we have error
+        bmpChannel &channel = channels[index];
+
+        if (!channel.active)
         {
-            return false;
+            continue;
         }
-        else
+
+        // only waits for what's left of the conversion
+        uint32_t elapsed = micros() - channel.triggerMicros;
+        if (elapsed < BMP280_CONVERSION_US)
         {
+            delayMicroseconds(BMP280_CONVERSION_US - elapsed);
+        }
+
+        reading = channel.bmp.readPressure();
+        triggerConversion(channel);
+
+        // NaN or far outside what the sensor can measure means it isn't answering properly
+        if ((reading > 10000) && (reading < 120000))
+        {
+            channel.failures = 0;
+            reading -= channel.offset;
             return true;
         }
+
+        if (++channel.failures >= BMP280_MAX_FAILURES)
+        {
+            channel.active = false;
+            LOG_WARN("BMP280 0x%x stopped responding, dropped", channel.addr);
+        }
     }
-    else if (sensorType == analog)
+
+    return false;
+}
+
+float PressureSensor::getBasePressure()
+{
+    return basePressure;
+}
+
+uint8_t PressureSensor::getActiveSensors()
+{
+    uint8_t active = 0;
+    for (uint8_t i = 0; i < numChannels; i++)
     {
-        return true;
+        active += channels[i].active;
     }
-    return false;
+    return active;
 }
 
-float PressureSensor::getPressure(bool absolute)
+float PressureSensor::getSensorOffset(uint8_t index)
+{
+    return (index < numChannels) ? channels[index].offset : 0;
+}
+
+bool PressureSensor::testConnection()
 {
     if (sensorType == BMP280)
     {
-        if (bmp.takeForcedMeasurement())
+        for (uint8_t i = 0; i < numChannels; i++)
         {
-            pressure = (bmp.readPressure()) - basePressure; // subtract atmospheric pressure
+            if (!channels[i].active)
+            {
+                continue;
+            }
 
-            if (absolute)
+            // only the measuring (bit 3) and im_update (bit 0) bits are ever set, anything else is a bus error:
+            // 243 echoes the register address, 0xFF is nothing on the bus
+            uint8_t status = channels[i].bmp.getStatus();
+
+            if (status & ~0x09)
             {
-                pressure += 101325; // convert to absolute pressure
-                // DBG(pressure);
+                channels[i].active = false;
+                LOG_WARN("BMP280 0x%x status 0x%x, dropped", channels[i].addr, status);
             }
         }
-        else
+
+        return getActiveSensors() > 0;
+    }
+    else if (sensorType == analog)
+    {
+        return true;
+    }
+    return false;
+}
+
+uint8_t PressureSensor::reconnect()
+{
+    // brings back BMP280s that were dropped, the ones still running aren't touched
+    uint8_t revived = 0;
+
+    if (sensorType != BMP280)
+    {
+        return revived;
+    }
+
+    for (uint8_t i = 0; i < numChannels; i++)
+    {
+        if (channels[i].active || ((long)(millis() - channels[i].nextRetryMillis) < 0))
+        {
+            continue;
+        }
+
+        if (beginChannel(channels[i], channels[i].addr))
         {
-            return -1;
+            triggerConversion(channels[i]);
+            LOG_INFO("BMP280 0x%x back", channels[i].addr);
+            revived++;
         }
     }
+
+    return revived;
+}
+
+float PressureSensor::getPressure(bool absolute)
+{
+    float reading;
+
+    if (!readRaw(reading))
+    {
+        return -1;
+    }
+
+    pressure = reading - basePressure; // subtract atmospheric pressure
+
+    if (absolute)
+    {
+        pressure += ABSOLUTE_BASE_PA; // convert to absolute pressure
+        // DBG(pressure);
+    }
+
+    return pressure; // units should be in Pa
+}
+
+bool PressureSensor::readRaw(float &reading)
+{
+    if (sensorType == BMP280)
+    {
+        // offset corrected reading from whichever sensor is due, sensors alternate
+        uint8_t index;
+        return readNext(index, reading);
+    }
     else if (sensorType == analog)
     {
-        analogReadResolution(ADC_RES);
-        uint16_t rawReading = analogRead(sensorPin);
-        analogReadResolution(10);                                    // need to switch back to 10-bit for the LCD display :(
-        float voltage = (rawReading * 3.3f) / (float)(1 << ADC_RES); // bit shifting is faster than power function
-        // DBG(voltage);
-        pressure = ((voltage - 0.5) * scaleFactor) - basePressure; // -0.5V offset from sensor datasheet
+        if (continuous)
+        {
+            // mean of every decimated sample since the last call, the newest one again if there are none yet
+            analogSample sample;
+            float sum = 0;
+            int samples = 0;
+
+            while (analogSampler.read(sample))
+            {
+                sum += sample.counts;
+                lastSampleMicros = sample.timeMicros;
+                samples++;
+            }
 
-        if (absolute)
+            if (samples > 0)
+            {
+                lastCounts = sum / samples;
+            }
+
+            reading = countsToPressure(lastCounts);
+        }
+        else
         {
-            pressure += 101325; // convert to absolute pressure
-            // DBG(pressure);
+            analogReadResolution(ADC_RES);
+            uint16_t rawReading = analogRead(sensorPin);
+            analogReadResolution(10); // need to switch back to 10-bit for the LCD display :(
+            lastSampleMicros = micros();
+            reading = countsToPressure(rawReading);
         }
+        return true;
     }
+    return false;
+}
 
-    return pressure; // units should be in Pa
+float PressureSensor::countsToPressure(float counts)
+{
+    float voltage = (counts * 3.3f) / (float)(1 << ADC_RES); // bit shifting is faster than power function
+    // DBG(voltage);
+    return (voltage - 0.5) * scaleFactor; // -0.5V offset from sensor datasheet
+}
+
+uint32_t PressureSensor::getLastSampleMicros()
+{
+    return lastSampleMicros;
 }
@@ -1,7 +1,37 @@
+#ifndef PRESSURE_SENSOR_H
+#define PRESSURE_SENSOR_H
+
 #include <Arduino.h>
 #include <Wire.h>
 #include <Adafruit_BMP280.h>
 #include "Debug.hpp"
+#include "AnalogSampler.h"
+
+#define MAX_BMP280_SENSORS 2
+
+// BMP280 forced conversion with x16 pressure oversampling and temperature skipped, datasheet max:
+// 1.25 ms + 2.3 ms * 16 + 0.575 ms
+#define BMP280_CONVERSION_US 38625
+
+// consecutive bad readings before a sensor is dropped
+#define BMP280_MAX_FAILURES 3
+
+// reconnect() tries a dropped sensor again after this, doubling on every miss so one that isn't fitted at all
+// (0x77 on a single sensor rig) is soon only tried once a minute
+#define BMP280_RETRY_MS 1000
+#define BMP280_RETRY_MAX_MS 60000
+
+// Base pressure is calibrated once and then followed while the chamber sits at ambient. Limits are in Pa for the
+// BMP280, the analog sensor widens them to a number of ADC counts when that is coarser
+#define BASE_TRACK_INTERVAL_MS 100 // between the readings taken for tracking
+#define BASE_TRACK_BLOCK 10        // readings averaged into one update
+#define BASE_TRACK_ALPHA 0.2f      // weight of each accepted update
+#define BASE_STABLE_PA 15          // max spread of a block that counts as settled, or 4 counts
+#define BASE_WINDOW_PA 300         // blocks further than this from the estimate aren't ambient, or 8 counts
+#define BASE_SANITY_PA 300         // run start check, recalibrates past this, or 8 counts
+
+// getPressure(true) reports readings relative to the base pressure, offset so the base reads as sea level
+#define ABSOLUTE_BASE_PA 101325.0f
 
 class PressureSensor
 {
@@ -9,18 +39,55 @@ class PressureSensor
 public:
     PressureSensor();
     bool begin(uint8_t sensorPin_);
+    bool beginContinuous(uint8_t sensorPin_, uint32_t rateHz = 4000, uint16_t decimation = 16);
     bool begin(uint8_t SDA_, uint8_t SCL_, uint8_t addr_);
+    bool begin(uint8_t SDA_, uint8_t SCL_, uint8_t addrA, uint8_t addrB);
 
     float getPressure(bool absolute);
     bool testConnection();
+    uint8_t reconnect();
 
     float getBasePressure();
+    uint8_t getActiveSensors();
+    float getSensorOffset(uint8_t index);
+    uint32_t getLastSampleMicros();
 
     void calibrateBasePressure();
+    bool trackBasePressure();
+    bool checkBasePressure();
 
 private:
+    // One BMP280 on the bus. Conversions are started without waiting and read once they're done, with two sensors
+    // they run half a conversion apart so a fresh reading is ready twice per conversion time
+    struct bmpChannel
+    {
+        Adafruit_BMP280 bmp;
+        uint8_t addr = 0;
+        bool active = false;        // responding, readings are used
+        uint32_t triggerMicros = 0; // start of the conversion in progress
+        float offset = 0;           // this sensor's reading minus the mean of all sensors, Pa
+        uint8_t failures = 0;       // consecutive bad readings
+        uint32_t retryMillis = 0;   // current reconnect interval
+        uint32_t nextRetryMillis = 0;
+    };
+
+    bool beginChannel(bmpChannel &channel, uint8_t addr_);
+    void triggerConversion(bmpChannel &channel);
+    bool readNext(uint8_t &index, float &reading);
+    float countsToPressure(float counts);
+    bool readRaw(float &reading);
+    float tolerance(float pascals, float counts);
+
     float pressure;
     float basePressure; // might be useful for calibration
+    bool baseValid;     // calibrated at least once, kept across begin() calls
+
+    // tracking block in progress
+    uint32_t lastTrackMillis;
+    uint8_t trackCount;
+    float trackSum;
+    float trackMin;
+    float trackMax;
 
     int sensorPin;
     float scaleFactor;
@@ -33,13 +100,16 @@ private:
 
     sensorTypes sensorType;
 
-    Adafruit_BMP280 bmp;
-    sensors_event_t pressure_event;
-    Adafruit_Sensor *bmp_pressure = bmp.getPressureSensor();
+    bmpChannel channels[MAX_BMP280_SENSORS];
+    uint8_t numChannels;
+    uint8_t nextChannel; // read next, round robin
 
     TwoWire wire;
 
-    uint8_t addr;
-
     int ADC_RES;
-};
\ No newline at end of file
+    bool continuous;      // analog pin read by analogSampler instead of one analogRead() per call
+    float lastCounts;     // latest decimated reading, reused when nothing new has arrived
+    uint32_t lastSampleMicros;
+};
+
+#endif // PRESSURE_SENSOR_H
@@ -0,0 +1,84 @@
+#include "Adafruit_BMP280.h"
+
+TwoWire Wire;
+
+static NativeBmp280Device devices[2]; // 0x76, 0x77
+
+NativeBmp280Device &nativeBmp280(uint8_t addr)
+{
+    return devices[addr & 0x01];
+}
+
+Adafruit_BMP280::~Adafruit_BMP280()
+{
+    delete i2c_dev;
+}
+
+bool Adafruit_BMP280::begin(uint8_t addr_, uint8_t chipid)
+{
+    (void)chipid;
+    addr = addr_;
+
+    delete i2c_dev;
+    i2c_dev = new nativeI2CDevice{addr_};
+
+    NativeBmp280Device &device = nativeBmp280(addr);
+    device.begins++;
+    return device.present;
+}
+
+void Adafruit_BMP280::setSampling(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                  sensor_filter filter, standby_duration duration)
+{
+    (void)tempSampling, (void)pressSampling, (void)filter, (void)duration;
+
+    // writing forced mode starts a conversion
+    if (mode == MODE_FORCED)
+    {
+        NativeBmp280Device &device = nativeBmp280(addr);
+        device.triggers++;
+        device.triggerMicros = micros();
+    }
+}
+
+bool Adafruit_BMP280::takeForcedMeasurement()
+{
+    NativeBmp280Device &device = nativeBmp280(addr);
+    if (device.present)
+    {
+        device.triggers++;
+        delayMicroseconds(device.conversionMicros);
+        device.triggerMicros = micros() - device.conversionMicros;
+    }
+    return device.present;
+}
+
+float Adafruit_BMP280::readPressure()
+{
+    NativeBmp280Device &device = nativeBmp280(addr);
+
+    if (!device.present)
+    {
+        return NAN;
+    }
+
+    device.reads++;
+    if (micros() - device.triggerMicros < device.conversionMicros)
+    {
+        device.earlyReads++;
+    }
+
+    float noise = 0;
+    if (device.noise > 0)
+    {
+        noise = device.noise * ((float)rand() / (float)RAND_MAX - 0.5f);
+    }
+
+    return device.pressure + noise;
+}
+
+uint8_t Adafruit_BMP280::getStatus()
+{
+    NativeBmp280Device &device = nativeBmp280(addr);
+    return device.present ? device.status : 0xFF;
+}
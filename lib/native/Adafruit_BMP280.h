@@ -0,0 +1,103 @@
+#ifndef NATIVE_ADAFRUIT_BMP280_H
+#define NATIVE_ADAFRUIT_BMP280_H
+
+// Stand-in for the BMP280 driver. Each I2C address (0x76, 0x77) is a simulated device whose
+// pressure, presence and status tests can set through nativeBmp280().
+
+#include "Wire.h"
+
+struct sensors_event_t
+{
+    float pressure;
+};
+
+class Adafruit_Sensor
+{
+};
+
+struct NativeBmp280Device
+{
+    bool present = true;
+    float pressure = 101325.0f; // Pa
+    float noise = 0.0f;         // peak-to-peak, added to every reading
+    uint8_t status = 0;         // value getStatus() returns
+    uint32_t reads = 0;         // readPressure() calls
+    uint32_t triggers = 0;      // forced conversions started
+    uint32_t earlyReads = 0;    // reads before the conversion had time to finish
+    uint32_t begins = 0;        // begin() calls, answered or not
+    uint32_t conversionMicros = 38625;
+    unsigned long triggerMicros = 0;
+};
+
+NativeBmp280Device &nativeBmp280(uint8_t addr);
+
+class Adafruit_BMP280
+{
+public:
+    enum sensor_mode
+    {
+        MODE_SLEEP = 0x00,
+        MODE_FORCED = 0x01,
+        MODE_NORMAL = 0x03,
+        MODE_SOFT_RESET_CODE = 0xB6
+    };
+
+    enum sensor_sampling
+    {
+        SAMPLING_NONE = 0x00,
+        SAMPLING_X1 = 0x01,
+        SAMPLING_X2 = 0x02,
+        SAMPLING_X4 = 0x03,
+        SAMPLING_X8 = 0x04,
+        SAMPLING_X16 = 0x05
+    };
+
+    enum sensor_filter
+    {
+        FILTER_OFF = 0x00,
+        FILTER_X2 = 0x01,
+        FILTER_X4 = 0x02,
+        FILTER_X8 = 0x03,
+        FILTER_X16 = 0x04
+    };
+
+    enum standby_duration
+    {
+        STANDBY_MS_1 = 0x00,
+        STANDBY_MS_63 = 0x01,
+        STANDBY_MS_125 = 0x02,
+        STANDBY_MS_250 = 0x03,
+        STANDBY_MS_500 = 0x04,
+        STANDBY_MS_1000 = 0x05,
+        STANDBY_MS_2000 = 0x06,
+        STANDBY_MS_4000 = 0x07
+    };
+
+    Adafruit_BMP280(TwoWire *theWire = &Wire) { (void)theWire; }
+    ~Adafruit_BMP280();
+
+    bool begin(uint8_t addr = 0x77, uint8_t chipid = 0x58);
+    void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling tempSampling = SAMPLING_X16,
+                     sensor_sampling pressSampling = SAMPLING_X16, sensor_filter filter = FILTER_OFF,
+                     standby_duration duration = STANDBY_MS_1);
+
+    bool takeForcedMeasurement();
+    float readPressure();
+    float readTemperature() { return 20.0f; }
+    uint8_t getStatus();
+    Adafruit_Sensor *getPressureSensor() { return &pressureSensor; }
+
+private:
+    // like the library, begin() replaces the I2C device it allocates and only the destructor frees it. There is
+    // no copy assignment, assigning a fresh object over a begun one loses the device
+    struct nativeI2CDevice
+    {
+        uint8_t addr;
+    };
+
+    nativeI2CDevice *i2c_dev = nullptr;
+    uint8_t addr = 0x77;
+    Adafruit_Sensor pressureSensor;
+};
+
+#endif // NATIVE_ADAFRUIT_BMP280_H
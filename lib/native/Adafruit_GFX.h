@@ -0,0 +1,107 @@
+#ifndef NATIVE_ADAFRUIT_GFX_H
+#define NATIVE_ADAFRUIT_GFX_H
+
+// Stand-in for the part of Adafruit GFX the UI uses, with the library's own algorithms so a display driver built
+// on it sees the same calls: lines pixel by pixel, round rectangles as spans and corner pixels, text in the classic
+// 6x8 cells. The font is the standard 5x7 ASCII set, a few glyphs differ from glcdfont in a pixel or two.
+//
+// Calls from outside the library are counted as draw calls through nativeDrawCall(), the calls it makes to itself
+// are not.
+
+#include "Arduino.h"
+
+class Adafruit_GFX : public Print
+{
+public:
+    Adafruit_GFX(int16_t w, int16_t h);
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+    virtual void startWrite() {}
+    virtual void writePixel(int16_t x, int16_t y, uint16_t color) { drawPixel(x, y, color); }
+    virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { fillRect(x, y, w, h, color); }
+    virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { drawFastVLine(x, y, h, color); }
+    virtual void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { drawFastHLine(x, y, w, color); }
+    virtual void endWrite() {}
+
+    virtual void setRotation(uint8_t r);
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    virtual void fillScreen(uint16_t color);
+    virtual void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
+    void fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
+    void drawRGBBitmap(int16_t x, int16_t y, const uint16_t bitmap[], int16_t w, int16_t h);
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+
+    void setCursor(int16_t x, int16_t y);
+    void setTextColor(uint16_t c);
+    void setTextColor(uint16_t c, uint16_t bg);
+    void setTextSize(uint8_t s);
+    void setTextWrap(bool w) { wrap = w; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override; // one draw call for a whole print()
+    using Print::write;
+
+    int16_t width() const { return _width; }
+    int16_t height() const { return _height; }
+    uint8_t getRotation() const { return rotation; }
+    int16_t getCursorX() const { return cursor_x; }
+    int16_t getCursorY() const { return cursor_y; }
+
+protected:
+    virtual void nativeDrawCall() {}
+
+    // counts the outermost call only
+    class drawCall
+    {
+    public:
+        drawCall(Adafruit_GFX &gfx_);
+        ~drawCall();
+
+    private:
+        Adafruit_GFX &gfx;
+    };
+
+    void writeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+    void drawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, uint16_t color);
+    void fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, int16_t delta, uint16_t color);
+
+    const int16_t WIDTH, HEIGHT; // before rotation
+    int16_t _width, _height;
+    int16_t cursor_x = 0, cursor_y = 0;
+    uint16_t textcolor = 0xFFFF, textbgcolor = 0xFFFF;
+    uint8_t textsize = 1;
+    uint8_t rotation = 0;
+    bool wrap = true;
+    uint16_t drawDepth = 0;
+};
+
+class Adafruit_GFX_Button
+{
+public:
+    void initButton(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t outline, uint16_t fill,
+                    uint16_t textcolor, char *label, uint8_t textsize);
+    void drawButton(bool inverted = false);
+    bool contains(int16_t x, int16_t y);
+
+    void press(bool p);
+    bool isPressed() { return currstate; }
+    bool justPressed() { return currstate && !laststate; }
+    bool justReleased() { return !currstate && laststate; }
+
+private:
+    Adafruit_GFX *_gfx = nullptr;
+    int16_t _x1 = 0, _y1 = 0; // top left
+    uint16_t _w = 0, _h = 0;
+    uint8_t _textsize = 1;
+    uint16_t _outlinecolor = 0, _fillcolor = 0, _textcolor = 0;
+    char _label[10] = "";
+    bool currstate = false, laststate = false;
+};
+
+#endif // NATIVE_ADAFRUIT_GFX_H
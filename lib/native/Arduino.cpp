@@ -0,0 +1,177 @@
+#include "Arduino.h"
+#include <map>
+
+HardwareSerial Serial;
+
+static unsigned long long nowMicros = 0;
+static std::map<uint32_t, int> pinValues;
+static std::map<uint32_t, int> analogInputs;
+
+String::String(long value, unsigned char base)
+{
+    char buffer[34];
+    if (base == 10)
+    {
+        snprintf(buffer, sizeof(buffer), "%ld", value);
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), base == 16 ? "%lx" : "%lo", value);
+    }
+    str = buffer;
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+    char buffer[34];
+    snprintf(buffer, sizeof(buffer), base == 16 ? "%lx" : (base == 8 ? "%lo" : "%lu"), value);
+    str = buffer;
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+    str = buffer;
+}
+
+void String::trim()
+{
+    size_t start = str.find_first_not_of(" \t\r\n");
+    size_t end = str.find_last_not_of(" \t\r\n");
+    str = (start == std::string::npos) ? std::string() : str.substr(start, end - start + 1);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (size--)
+    {
+        written += write(*buffer++);
+    }
+    return written;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length && available())
+    {
+        buffer[count++] = (char)read();
+    }
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length && available())
+    {
+        int c = read();
+        if (c < 0 || c == terminator)
+        {
+            break;
+        }
+        buffer[count++] = (char)c;
+    }
+    return count;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    output.append((const char *)buffer, size);
+    if (echo)
+    {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+unsigned long millis()
+{
+    return nowMicros / 1000;
+}
+
+unsigned long micros()
+{
+    return nowMicros;
+}
+
+void delay(unsigned long ms)
+{
+    nativeRunTimers(nowMicros + ms * 1000ULL, nowMicros);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    nativeRunTimers(nowMicros + us, nowMicros);
+}
+
+void nativeAdvanceMicros(unsigned long us)
+{
+    nativeRunTimers(nowMicros + us, nowMicros);
+}
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+    pinValues[pin] = value;
+}
+
+int digitalRead(uint32_t pin)
+{
+    return pinValues[pin];
+}
+
+int analogRead(uint32_t pin)
+{
+    return analogInputs[pin];
+}
+
+void analogWrite(uint32_t pin, int value)
+{
+    pinValues[pin] = value;
+}
+
+void analogReadResolution(int bits)
+{
+    (void)bits;
+}
+
+void analogWriteResolution(int bits)
+{
+    (void)bits;
+}
+
+int nativePinValue(uint32_t pin)
+{
+    return pinValues[pin];
+}
+
+void nativeSetAnalogInput(uint32_t pin, int value)
+{
+    analogInputs[pin] = value;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
@@ -0,0 +1,216 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core this project uses, only built for [env:native].
+// Time is simulated: millis()/micros() only move when delay() or nativeAdvanceMicros() is called,
+// so tests are deterministic. Running HardwareTimer interrupts fire as that time passes.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#ifndef ARDUINO
+#define ARDUINO 10800
+#endif
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+#define PROGMEM
+#define pgm_read_word(addr) (*(const unsigned short *)(addr))
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::abs;
+using std::max;
+using std::min;
+
+class String
+{
+public:
+    String(const char *cstr = "") : str(cstr ? cstr : "") {}
+    String(const std::string &s) : str(s) {}
+    explicit String(char c) : str(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(int value, unsigned char base = 10) : String((long)value, base) {}
+    explicit String(unsigned int value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(float value, unsigned char decimalPlaces = 2) : String((double)value, decimalPlaces) {}
+    explicit String(double value, unsigned char decimalPlaces = 2);
+
+    unsigned int length() const { return str.size(); }
+    const char *c_str() const { return str.c_str(); }
+    bool reserve(unsigned int size)
+    {
+        str.reserve(size);
+        return true;
+    }
+
+    char charAt(unsigned int index) const { return index < str.size() ? str[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    int indexOf(char c, unsigned int from = 0) const { return find(str.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return find(str.find(s.str, from)); }
+    int lastIndexOf(char c) const { return find(str.rfind(c)); }
+
+    String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < str.size() ? String(str.substr(from, to - from)) : String(); }
+
+    bool startsWith(const String &prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return str.size() >= suffix.str.size() && str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+    }
+
+    void replace(char find, char replace) { std::replace(str.begin(), str.end(), find, replace); }
+    void toUpperCase()
+    {
+        for (char &c : str)
+            c = toupper(c);
+    }
+    void toLowerCase()
+    {
+        for (char &c : str)
+            c = tolower(c);
+    }
+    void trim();
+
+    long toInt() const { return atol(str.c_str()); }
+    float toFloat() const { return atof(str.c_str()); }
+
+    String &operator+=(const String &rhs)
+    {
+        str += rhs.str;
+        return *this;
+    }
+    String &operator+=(const char *rhs)
+    {
+        str += rhs;
+        return *this;
+    }
+    String &operator+=(char rhs)
+    {
+        str += rhs;
+        return *this;
+    }
+
+    bool operator==(const String &rhs) const { return str == rhs.str; }
+    bool operator==(const char *rhs) const { return str == rhs; }
+    bool operator!=(const String &rhs) const { return str != rhs.str; }
+    bool operator<(const String &rhs) const { return str < rhs.str; }
+    int compareTo(const String &rhs) const { return str.compare(rhs.str); }
+
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs.str + rhs.str); }
+    friend String operator+(const String &lhs, const char *rhs) { return String(lhs.str + rhs); }
+    friend String operator+(const char *lhs, const String &rhs) { return String(lhs + rhs.str); }
+
+private:
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    std::string str;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return print(String(n)); }
+    size_t print(unsigned int n) { return print(String(n)); }
+    size_t print(long n) { return print(String(n)); }
+    size_t print(unsigned long n) { return print(String(n)); }
+    size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+    size_t println(double n, int digits) { return print(n, digits) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    operator bool() { return true; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    std::string output; // everything written, for tests to inspect
+    bool echo = false;  // also copy to stdout
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void nativeAdvanceMicros(unsigned long us);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+int analogRead(uint32_t pin);
+void analogWrite(uint32_t pin, int value);
+void analogReadResolution(int bits);
+void analogWriteResolution(int bits);
+
+// last values written, per pin, for tests
+int nativePinValue(uint32_t pin);
+void nativeSetAnalogInput(uint32_t pin, int value);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+void noInterrupts();
+void interrupts();
+
+#include "HardwareTimer.h"
+
+#endif // NATIVE_ARDUINO_H
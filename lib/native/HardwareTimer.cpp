@@ -0,0 +1,191 @@
+#include "HardwareTimer.h"
+#include "Arduino.h"
+
+TIM_TypeDef nativeTimers[15];
+const PinMap PinMap_PWM[] = {{0}};
+
+static HardwareTimer *timers[15];
+
+HardwareTimer::HardwareTimer(TIM_TypeDef *instance_) : instance(instance_)
+{
+    timers[instance - nativeTimers] = this;
+}
+
+HardwareTimer::~HardwareTimer()
+{
+    if (timers[instance - nativeTimers] == this)
+    {
+        timers[instance - nativeTimers] = nullptr;
+    }
+}
+
+void HardwareTimer::setOverflow(uint32_t value, TimerFormat_t format)
+{
+    // same split as the core: a prescaler is only used when the period doesn't fit in 16 bits
+    uint64_t ticks;
+
+    if (format == HERTZ_FORMAT)
+    {
+        ticks = value ? NATIVE_TIMER_CLOCK / value : 0;
+    }
+    else if (format == MICROSEC_FORMAT)
+    {
+        ticks = (uint64_t)value * (NATIVE_TIMER_CLOCK / 1000000UL);
+    }
+    else
+    {
+        ticks = value;
+    }
+
+    uint32_t prescaler = (uint32_t)(ticks / 0x10000) + 1;
+    instance->PSC = prescaler - 1;
+    instance->ARR = ticks ? (uint32_t)(ticks / prescaler) - 1 : 0;
+    periodMicros = (uint32_t)(ticks / (NATIVE_TIMER_CLOCK / 1000000UL));
+}
+
+uint32_t HardwareTimer::getOverflow(TimerFormat_t format)
+{
+    uint64_t ticks = (uint64_t)(instance->ARR + 1) * (instance->PSC + 1);
+
+    if (format == HERTZ_FORMAT)
+    {
+        return (uint32_t)(NATIVE_TIMER_CLOCK / ticks);
+    }
+    else if (format == MICROSEC_FORMAT)
+    {
+        return periodMicros;
+    }
+    return instance->ARR + 1;
+}
+
+void HardwareTimer::setMode(uint32_t channel, TimerModes_t mode, uint32_t pin)
+{
+    (void)channel, (void)mode, (void)pin;
+}
+
+void HardwareTimer::setCaptureCompare(uint32_t channel, uint32_t compare, TimerCompareFormat_t format)
+{
+    if ((channel < 1) || (channel > 4))
+    {
+        return;
+    }
+
+    if (format == PERCENT_COMPARE_FORMAT)
+    {
+        compare = (uint32_t)((uint64_t)compare * (instance->ARR + 1) / 100);
+    }
+    else if (format == MICROSEC_COMPARE_FORMAT)
+    {
+        compare = (uint32_t)((uint64_t)compare * (NATIVE_TIMER_CLOCK / 1000000UL) / (instance->PSC + 1));
+    }
+
+    instance->CCR[channel - 1] = compare;
+    instance->nativeCompareWrites++;
+}
+
+void HardwareTimer::attachInterrupt(callback_function_t callback_)
+{
+    callback = callback_;
+}
+
+void HardwareTimer::detachInterrupt()
+{
+    callback = nullptr;
+}
+
+void HardwareTimer::resume()
+{
+    if (!running)
+    {
+        dueMicros = micros() + periodMicros;
+    }
+    running = true;
+}
+
+void HardwareTimer::pause()
+{
+    running = false;
+}
+
+void HardwareTimer::nativeFire(uint32_t count)
+{
+    if (running && count)
+    {
+        nativeAdvanceMicros(dueMicros + (unsigned long long)(count - 1) * periodMicros - micros());
+    }
+}
+
+bool nativeFireTimer(TIM_TypeDef *instance, uint32_t count)
+{
+    HardwareTimer *timer = timers[instance - nativeTimers];
+
+    if (!timer || !timer->isRunning())
+    {
+        return false;
+    }
+
+    timer->nativeFire(count);
+    return true;
+}
+
+void nativeRunTimers(unsigned long long target, unsigned long long &now)
+{
+    // an interrupt that waits (delayMicroseconds) only moves time, it doesn't nest other interrupts
+    static bool inInterrupt = false;
+
+    if (!inInterrupt)
+    {
+        while (true)
+        {
+            HardwareTimer *next = nullptr;
+            for (HardwareTimer *timer : timers)
+            {
+                if (timer && timer->running && timer->periodMicros && (timer->dueMicros <= target) &&
+                    (!next || (timer->dueMicros < next->dueMicros)))
+                {
+                    next = timer;
+                }
+            }
+
+            if (!next)
+            {
+                break;
+            }
+
+            if (next->dueMicros > now)
+            {
+                now = next->dueMicros;
+            }
+            next->dueMicros += next->periodMicros;
+
+            if (next->callback)
+            {
+                inInterrupt = true;
+                next->callback();
+                inInterrupt = false;
+            }
+        }
+    }
+
+    if (target > now)
+    {
+        now = target;
+    }
+}
+
+PinName digitalPinToPinName(uint32_t pin)
+{
+    return pin;
+}
+
+void *pinmap_peripheral(PinName pin, const PinMap *map)
+{
+    (void)pin, (void)map;
+    return TIM3;
+}
+
+uint32_t pinmap_function(PinName pin, const PinMap *map)
+{
+    (void)map;
+    return (pin % 4) + 1; // channel
+}
@@ -0,0 +1,112 @@
+#ifndef NATIVE_HARDWARE_TIMER_H
+#define NATIVE_HARDWARE_TIMER_H
+
+// Stand-in for the STM32 core's HardwareTimer. Update interrupts of running timers fire whenever simulated
+// time passes their due time (delay(), delayMicroseconds(), nativeAdvanceMicros()), and tests can run a
+// number of them directly with nativeFireTimer().
+
+#include <stdint.h>
+#include <functional>
+
+// the registers the stand-in keeps up to date, plus a count of compare writes for tests
+struct TIM_TypeDef
+{
+    uint32_t CNT;
+    uint32_t ARR;
+    uint32_t PSC;
+    uint32_t CCR[4];
+    uint32_t nativeCompareWrites;
+};
+
+#define NATIVE_TIMER_CLOCK 90000000UL // APB1 timer clock of the F446 at 180 MHz
+
+extern TIM_TypeDef nativeTimers[15];
+#define TIM1 (&nativeTimers[1])
+#define TIM2 (&nativeTimers[2])
+#define TIM3 (&nativeTimers[3])
+#define TIM4 (&nativeTimers[4])
+#define TIM5 (&nativeTimers[5])
+#define TIM6 (&nativeTimers[6])
+#define TIM7 (&nativeTimers[7])
+#define TIM8 (&nativeTimers[8])
+#define TIM9 (&nativeTimers[9])
+#define TIM10 (&nativeTimers[10])
+#define TIM11 (&nativeTimers[11])
+#define TIM12 (&nativeTimers[12])
+#define TIM13 (&nativeTimers[13])
+#define TIM14 (&nativeTimers[14])
+
+typedef std::function<void(void)> callback_function_t;
+
+enum TimerFormat_t
+{
+    TICK_FORMAT,
+    MICROSEC_FORMAT,
+    HERTZ_FORMAT
+};
+
+enum TimerModes_t
+{
+    TIMER_DISABLED,
+    TIMER_OUTPUT_COMPARE_PWM1
+};
+
+enum TimerCompareFormat_t
+{
+    MICROSEC_COMPARE_FORMAT,
+    TICK_COMPARE_FORMAT,
+    PERCENT_COMPARE_FORMAT
+};
+
+// pin to timer channel lookup of the STM32 core, every native pin maps to a channel of TIM3
+typedef uint32_t PinName;
+struct PinMap
+{
+    PinName pin;
+};
+extern const PinMap PinMap_PWM[];
+PinName digitalPinToPinName(uint32_t pin);
+void *pinmap_peripheral(PinName pin, const PinMap *map);
+uint32_t pinmap_function(PinName pin, const PinMap *map);
+#define STM_PIN_CHANNEL(function) (function)
+
+class HardwareTimer
+{
+public:
+    HardwareTimer(TIM_TypeDef *instance_);
+    ~HardwareTimer();
+
+    void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT);
+    uint32_t getOverflow(TimerFormat_t format = TICK_FORMAT);
+    void attachInterrupt(callback_function_t callback_);
+    void detachInterrupt();
+    void resume();
+    void pause();
+
+    void setMode(uint32_t channel, TimerModes_t mode, uint32_t pin = 0);
+    void setCaptureCompare(uint32_t channel, uint32_t compare, TimerCompareFormat_t format = TICK_COMPARE_FORMAT);
+    uint32_t getTimerClkFreq() { return NATIVE_TIMER_CLOCK; }
+
+    bool isRunning() { return running; }
+    TIM_TypeDef *getInstance() { return instance; }
+
+    // advances simulated time until the update interrupt has run count more times
+    void nativeFire(uint32_t count);
+
+private:
+    friend void nativeRunTimers(unsigned long long target, unsigned long long &now);
+
+    TIM_TypeDef *instance;
+    uint32_t periodMicros = 1000; // ARR and PSC as simulated time, for the interrupt
+    bool running = false;
+    unsigned long long dueMicros = 0;
+    callback_function_t callback;
+};
+
+// fires the interrupt of the running timer on instance, returns false if there isn't one
+bool nativeFireTimer(TIM_TypeDef *instance, uint32_t count = 1);
+
+// moves now up to target, running every timer interrupt that falls due on the way; used by Arduino.cpp
+void nativeRunTimers(unsigned long long target, unsigned long long &now);
+
+#endif // NATIVE_HARDWARE_TIMER_H
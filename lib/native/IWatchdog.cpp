@@ -0,0 +1,35 @@
+#include "IWatchdog.h"
+#include "Arduino.h"
+
+IWatchdogClass IWatchdog;
+
+void IWatchdogClass::begin(uint32_t timeout, uint32_t window)
+{
+    (void)window;
+
+    // like the hardware, once started it can't be stopped, only given a new timeout
+    timeoutMicros = constrain(timeout, (uint32_t)IWDG_TIMEOUT_MIN, (uint32_t)IWDG_TIMEOUT_MAX);
+    enabled = true;
+    reload();
+}
+
+void IWatchdogClass::reload()
+{
+    lastReloadMicros = micros();
+    reloads++;
+}
+
+bool IWatchdogClass::isReset(bool clear)
+{
+    bool reset = nativeResetFlag;
+    if (clear)
+    {
+        nativeResetFlag = false;
+    }
+    return reset;
+}
+
+bool IWatchdogClass::nativeExpired()
+{
+    return enabled && (micros() - lastReloadMicros > timeoutMicros);
+}
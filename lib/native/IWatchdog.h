@@ -0,0 +1,34 @@
+#ifndef NATIVE_IWATCHDOG_H
+#define NATIVE_IWATCHDOG_H
+
+// Stand-in for the STM32 core's independent watchdog library. Nothing resets, tests check nativeExpired()
+// to see whether the real one would have.
+
+#include <stdint.h>
+
+#define IWDG_TIMEOUT_MIN 125      // microseconds
+#define IWDG_TIMEOUT_MAX 32768000 // microseconds
+
+class IWatchdogClass
+{
+public:
+    void begin(uint32_t timeout, uint32_t window = IWDG_TIMEOUT_MAX);
+    void reload();
+    bool isEnabled() { return enabled; }
+    bool isReset(bool clear = false);
+    void clearReset() { nativeResetFlag = false; }
+
+    // test helpers
+    bool nativeExpired();
+    uint32_t reloads = 0;
+    bool nativeResetFlag = false; // the last reset was the watchdog's
+
+private:
+    bool enabled = false;
+    uint32_t timeoutMicros = 0;
+    unsigned long lastReloadMicros = 0;
+};
+
+extern IWatchdogClass IWatchdog;
+
+#endif // NATIVE_IWATCHDOG_H
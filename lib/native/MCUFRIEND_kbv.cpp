@@ -0,0 +1,82 @@
+#include "MCUFRIEND_kbv.h"
+
+MCUFRIEND_kbv::MCUFRIEND_kbv(int CS, int RS, int WR, int RD, int RST) : Adafruit_GFX(NATIVE_PANEL_WIDTH, NATIVE_PANEL_HEIGHT)
+{
+    (void)CS;
+    (void)RS;
+    (void)WR;
+    (void)RD;
+    (void)RST;
+}
+
+void MCUFRIEND_kbv::begin(uint16_t ID)
+{
+    (void)ID;
+    setRotation(0);
+}
+
+void MCUFRIEND_kbv::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    drawCall call(*this);
+
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+    {
+        return;
+    }
+    fillRect(x, y, 1, 1, color);
+}
+
+void MCUFRIEND_kbv::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    drawCall call(*this);
+
+    if (w < 0)
+    {
+        x += w;
+        w = -w;
+    }
+    if (h < 0)
+    {
+        y += h;
+        h = -h;
+    }
+
+    // the panel is scanned in portrait, other rotations map the rectangle onto it
+    int16_t px = x, py = y, pw = w, ph = h;
+    switch (rotation)
+    {
+    case 1:
+        px = WIDTH - y - h;
+        py = x;
+        pw = h;
+        ph = w;
+        break;
+    case 2:
+        px = WIDTH - x - w;
+        py = HEIGHT - y - h;
+        break;
+    case 3:
+        px = y;
+        py = HEIGHT - x - w;
+        pw = h;
+        ph = w;
+        break;
+    }
+
+    nativePanel.fill(px, py, pw, ph, color);
+}
+
+void MCUFRIEND_kbv::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    fillRect(x, y, 1, h, color);
+}
+
+void MCUFRIEND_kbv::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    fillRect(x, y, w, 1, color);
+}
+
+void MCUFRIEND_kbv::fillScreen(uint16_t color)
+{
+    fillRect(0, 0, _width, _height, color);
+}
@@ -0,0 +1,29 @@
+#ifndef NATIVE_MCUFRIEND_KBV_H
+#define NATIVE_MCUFRIEND_KBV_H
+
+// Stand-in for the MCUFRIEND shield driver, drawing into nativePanel. Like the real one it sets an address window
+// for every pixel and for every filled rectangle, lines and spans become rectangles, the rest comes from
+// Adafruit_GFX a pixel at a time.
+
+#include "Adafruit_GFX.h"
+#include "NativePanel.h"
+
+class MCUFRIEND_kbv : public Adafruit_GFX
+{
+public:
+    MCUFRIEND_kbv(int CS = 0, int RS = 0, int WR = 0, int RD = 0, int RST = 0);
+
+    uint16_t readID() { return NATIVE_PANEL_ID; }
+    void begin(uint16_t ID = NATIVE_PANEL_ID);
+
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override;
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override;
+    void fillScreen(uint16_t color) override;
+
+protected:
+    void nativeDrawCall() override { nativePanel.drawCall(); }
+};
+
+#endif // NATIVE_MCUFRIEND_KBV_H
@@ -0,0 +1,237 @@
+#include "NativePanel.h"
+#include "Arduino.h"
+#include "Checksum.hpp"
+
+NativePanel nativePanel;
+
+NativePanel::NativePanel()
+{
+    nativeReset();
+}
+
+void NativePanel::nativeReset()
+{
+    framebuffer.assign(NATIVE_PANEL_WIDTH * NATIVE_PANEL_HEIGHT, 0);
+    script.clear();
+    onPoll = nullptr;
+    polls = 0;
+    idlePolls = 0;
+    resetStats();
+}
+
+uint16_t NativePanel::getPixel(int16_t x, int16_t y)
+{
+    if (x < 0 || y < 0 || x >= NATIVE_PANEL_WIDTH || y >= NATIVE_PANEL_HEIGHT)
+    {
+        return 0;
+    }
+    return framebuffer[y * NATIVE_PANEL_WIDTH + x];
+}
+
+uint32_t NativePanel::countPixels(uint16_t colour)
+{
+    return std::count(framebuffer.begin(), framebuffer.end(), colour);
+}
+
+static void toRgb888(uint16_t colour, uint8_t *rgb)
+{
+    // replicate the high bits into the low ones so white stays 255
+    uint8_t r = (colour >> 11) & 0x1F;
+    uint8_t g = (colour >> 5) & 0x3F;
+    uint8_t b = colour & 0x1F;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+bool NativePanel::savePPM(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", NATIVE_PANEL_WIDTH, NATIVE_PANEL_HEIGHT);
+    for (uint16_t colour : framebuffer)
+    {
+        uint8_t rgb[3];
+        toRgb888(colour, rgb);
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+
+    return fclose(file) == 0;
+}
+
+static void putBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void putChunk(FILE *file, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    putBigEndian(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4)); // type and data, not the length
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+bool NativePanel::savePNG(const char *path)
+{
+    // RGB rows, each behind a "no filter" byte, in stored (uncompressed) deflate blocks so no zlib is needed
+    std::vector<uint8_t> rows;
+    rows.reserve(NATIVE_PANEL_HEIGHT * (1 + NATIVE_PANEL_WIDTH * 3));
+    for (int16_t y = 0; y < NATIVE_PANEL_HEIGHT; y++)
+    {
+        rows.push_back(0);
+        for (int16_t x = 0; x < NATIVE_PANEL_WIDTH; x++)
+        {
+            uint8_t rgb[3];
+            toRgb888(framebuffer[y * NATIVE_PANEL_WIDTH + x], rgb);
+            rows.insert(rows.end(), rgb, rgb + 3);
+        }
+    }
+
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t start = 0; start < rows.size(); start += 65535)
+    {
+        uint16_t length = std::min(rows.size() - start, (size_t)65535);
+        zlib.push_back(start + length == rows.size()); // BFINAL on the last block
+        zlib.push_back(length);
+        zlib.push_back(length >> 8);
+        zlib.push_back(~length);
+        zlib.push_back((uint16_t)~length >> 8);
+        zlib.insert(zlib.end(), rows.begin() + start, rows.begin() + start + length);
+    }
+    for (uint8_t byte : rows)
+    {
+        adlerA = (adlerA + byte) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    putBigEndian(zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> header;
+    putBigEndian(header, NATIVE_PANEL_WIDTH);
+    putBigEndian(header, NATIVE_PANEL_HEIGHT);
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlace
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+    putChunk(file, "IHDR", header);
+    putChunk(file, "IDAT", zlib);
+    putChunk(file, "IEND", {});
+
+    return fclose(file) == 0;
+}
+
+void NativePanel::resetStats()
+{
+    total = nativeDrawStats();
+    frame = nativeDrawStats();
+    lastFrame = nativeDrawStats();
+    maxFrame = nativeDrawStats();
+    frames = 0;
+}
+
+void NativePanel::tap(int16_t x, int16_t y, uint16_t holdPolls, uint16_t releasePolls)
+{
+    script.push_back({x, y, true, holdPolls});
+    script.push_back({0, 0, false, releasePolls});
+}
+
+void NativePanel::idle(uint32_t count)
+{
+    script.push_back({0, 0, false, count});
+}
+
+void NativePanel::fill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour)
+{
+    // clipped like the controller's address window
+    int16_t x1 = std::max<int16_t>(x, 0);
+    int16_t y1 = std::max<int16_t>(y, 0);
+    int16_t x2 = std::min<int32_t>((int32_t)x + w, NATIVE_PANEL_WIDTH);
+    int16_t y2 = std::min<int32_t>((int32_t)y + h, NATIVE_PANEL_HEIGHT);
+    if (x1 >= x2 || y1 >= y2)
+    {
+        return;
+    }
+
+    for (int16_t row = y1; row < y2; row++)
+    {
+        std::fill(&framebuffer[row * NATIVE_PANEL_WIDTH + x1], &framebuffer[row * NATIVE_PANEL_WIDTH + x2], colour);
+    }
+
+    uint32_t pixels = (uint32_t)(x2 - x1) * (y2 - y1);
+    frame.transactions++;
+    frame.pixels += pixels;
+    total.transactions++;
+    total.pixels += pixels;
+}
+
+bool NativePanel::readTouch(int16_t &rawX, int16_t &rawY)
+{
+    endFrame();
+    polls++;
+    nativeAdvanceMicros(NATIVE_TOUCH_POLL_US);
+
+    if (onPoll)
+    {
+        onPoll();
+    }
+
+    while (!script.empty() && script.front().polls == 0)
+    {
+        script.pop_front();
+    }
+
+    if (script.empty())
+    {
+        if (++idlePolls > NATIVE_TOUCH_IDLE_LIMIT)
+        {
+            fprintf(stderr, "NativePanel: touch script ran out %d polls ago and the page is still waiting\n", NATIVE_TOUCH_IDLE_LIMIT);
+            exit(1);
+        }
+        return false;
+    }
+
+    idlePolls = 0;
+    touchStep &step = script.front();
+    step.polls--;
+
+    if (!step.pressed)
+    {
+        return false;
+    }
+
+    // the reading that maps back onto the pixel, rounded up so the UI's integer map() lands on it
+    rawX = NATIVE_TOUCH_LEFT + (step.x * (NATIVE_TOUCH_RIGHT - NATIVE_TOUCH_LEFT) + NATIVE_PANEL_WIDTH - 1) / NATIVE_PANEL_WIDTH;
+    rawY = NATIVE_TOUCH_TOP + (step.y * (NATIVE_TOUCH_BOTTOM - NATIVE_TOUCH_TOP) + NATIVE_PANEL_HEIGHT - 1) / NATIVE_PANEL_HEIGHT;
+    return true;
+}
+
+void NativePanel::endFrame()
+{
+    if (frame.drawCalls == 0 && frame.transactions == 0)
+    {
+        return; // a pass of a page loop that drew nothing
+    }
+
+    lastFrame = frame;
+    maxFrame.drawCalls = std::max(maxFrame.drawCalls, frame.drawCalls);
+    maxFrame.transactions = std::max(maxFrame.transactions, frame.transactions);
+    maxFrame.pixels = std::max(maxFrame.pixels, frame.pixels);
+    frames++;
+    frame = nativeDrawStats();
+}
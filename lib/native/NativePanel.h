@@ -0,0 +1,91 @@
+#ifndef NATIVE_PANEL_H
+#define NATIVE_PANEL_H
+
+// The MCUFRIEND shield on the host: an RGB565 framebuffer the MCUFRIEND_kbv stand-in draws into, what drawing it
+// took, and the resistive overlay the TouchScreen stand-in reads, played back from a script. Tests drive UI pages
+// with tap() and read the accounting and the pixels afterwards.
+//
+// Every page loop polls the touch screen once per pass, so a poll ends a frame.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#define NATIVE_PANEL_WIDTH 320 // portrait, rotation 0
+#define NATIVE_PANEL_HEIGHT 480
+#define NATIVE_PANEL_ID 0x6814
+
+// raw readings at the panel edges, UI.h's TS_LEFT .. TS_BOT for the 0x6814 shield
+#define NATIVE_TOUCH_LEFT 100
+#define NATIVE_TOUCH_RIGHT 905
+#define NATIVE_TOUCH_TOP 69
+#define NATIVE_TOUCH_BOTTOM 927
+#define NATIVE_TOUCH_PRESSURE 500
+
+#define NATIVE_TOUCH_POLL_US 100        // a getPoint() on target, four ADC conversions and the pin changes
+#define NATIVE_TOUCH_IDLE_LIMIT 2000000 // polls after the script ran out before a page that never returns is given up on
+
+struct nativeDrawStats
+{
+    uint32_t drawCalls;    // calls into the display from outside the graphics library
+    uint32_t transactions; // address windows set on the bus, one per drawPixel() and one per filled rectangle
+    uint64_t pixels;       // pixels written, clipped ones don't count
+};
+
+class NativePanel
+{
+public:
+    NativePanel();
+
+    // test helpers
+    void nativeReset(); // black screen, no stats, empty touch script
+
+    uint16_t getPixel(int16_t x, int16_t y); // panel coordinates, rotation 0
+    uint32_t countPixels(uint16_t colour);   // on the whole screen
+    bool savePPM(const char *path);
+    bool savePNG(const char *path);
+
+    void resetStats();
+    nativeDrawStats total;     // since resetStats()
+    nativeDrawStats lastFrame; // the last finished frame
+    nativeDrawStats maxFrame;  // largest of each count over the finished frames, not one frame's
+    uint32_t frames = 0;       // passes of a page loop that drew anything
+
+    // screen pixels, pressed for holdPolls touch polls and then released for releasePolls
+    void tap(int16_t x, int16_t y, uint16_t holdPolls = 2, uint16_t releasePolls = 2);
+    void idle(uint32_t count); // polls with nothing touched
+    size_t pendingTouches() { return script.size(); } // steps of the script not played yet
+    uint32_t polls = 0;
+    std::function<void(void)> onPoll; // before each reading, to look at or save the screen while a page is up
+
+    // used by the stand-ins
+    void fill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour); // one transaction, panel coordinates
+    void drawCall()
+    {
+        frame.drawCalls++;
+        total.drawCalls++;
+    }
+    bool readTouch(int16_t &rawX, int16_t &rawY); // ends the frame, true while pressed
+
+private:
+    void endFrame();
+
+    struct touchStep
+    {
+        int16_t x;
+        int16_t y;
+        bool pressed;
+        uint32_t polls;
+    };
+
+    std::vector<uint16_t> framebuffer;
+    nativeDrawStats frame; // since the last poll
+    std::deque<touchStep> script;
+    uint32_t idlePolls = 0;
+};
+
+extern NativePanel nativePanel;
+
+#endif // NATIVE_PANEL_H
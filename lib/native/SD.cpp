@@ -0,0 +1,282 @@
+#include "SD.h"
+
+SDClass SD;
+
+File::File(const std::string &path_, std::shared_ptr<NativeFileData> data_, bool writable_)
+    : open(true), directory(false), writable(writable_), path(path_), data(data_)
+{
+    shortName = path.substr(path.find_last_of('/') + 1);
+    pos = writable ? data->bytes.size() : 0; // FILE_WRITE appends
+
+    // a card has the space already, writing shouldn't allocate any more than it does on target
+    if (writable)
+    {
+        data->bytes.reserve(NATIVE_FILE_RESERVE);
+    }
+}
+
+File::File(const std::string &path_, const std::vector<std::string> &children_)
+    : open(true), directory(true), path(path_), children(children_)
+{
+    shortName = path.substr(path.find_last_of('/') + 1);
+}
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    if (!open || !writable || !SD.nativeCacheBlock({data.get(), (uint32_t)(pos / NATIVE_BLOCK_SIZE)}))
+    {
+        return 0;
+    }
+
+    if (pos + size > data->bytes.size())
+    {
+        data->bytes.resize(pos + size);
+    }
+
+    memcpy(&data->bytes[pos], buffer, size);
+    pos += size;
+    return size;
+}
+
+int File::available()
+{
+    return (open && !directory) ? (int)(data->bytes.size() - pos) : 0;
+}
+
+int File::read()
+{
+    return peek() >= 0 ? data->bytes[pos++] : -1;
+}
+
+int File::peek()
+{
+    if (!available() || !SD.nativeCacheBlock({data.get(), (uint32_t)(pos / NATIVE_BLOCK_SIZE)}))
+    {
+        return -1;
+    }
+    return data->bytes[pos];
+}
+
+int File::read(void *buffer, size_t size)
+{
+    size_t count = std::min(size, (size_t)available());
+    if (count && !SD.nativeCacheBlock({data.get(), (uint32_t)(pos / NATIVE_BLOCK_SIZE)}))
+    {
+        return -1;
+    }
+    if (count)
+    {
+        memcpy(buffer, &data->bytes[pos], count);
+        pos += count;
+    }
+    return count;
+}
+
+bool File::seek(uint32_t newPos)
+{
+    if (!open || directory || newPos > data->bytes.size())
+    {
+        return false;
+    }
+    pos = newPos;
+    return true;
+}
+
+uint32_t File::position()
+{
+    return pos;
+}
+
+uint32_t File::size()
+{
+    return (open && !directory) ? data->bytes.size() : 0;
+}
+
+void File::close()
+{
+    open = false;
+    data.reset();
+}
+
+const char *File::name()
+{
+    return shortName.c_str();
+}
+
+bool File::isDirectory()
+{
+    return directory;
+}
+
+File File::openNextFile(uint8_t mode)
+{
+    if (!directory || nextChild >= children.size())
+    {
+        return File();
+    }
+    return SD.open(children[nextChild++].c_str(), mode);
+}
+
+void File::rewindDirectory()
+{
+    nextChild = 0;
+}
+
+bool SDClass::begin(uint8_t csPin)
+{
+    (void)csPin;
+    cached = {nullptr, 0}; // the volume is read again
+    return present;
+}
+
+bool SDClass::nativeCacheBlock(NativeBlock block)
+{
+    if ((block.owner == cached.owner) && (block.index == cached.index))
+    {
+        return true;
+    }
+    if (!present)
+    {
+        return false;
+    }
+    cached = block;
+    return true;
+}
+
+bool SDClass::cacheDirectoryOf(const std::string &key)
+{
+    // looking a path up reads its parent directory, the root's own entry is kept in RAM
+    static const char root = 0;
+    std::string parent = parentOf(key);
+    auto dir = dirs.find(parent);
+    return nativeCacheBlock({(dir == dirs.end()) ? (const void *)&root : (const void *)&*dir, 0});
+}
+
+bool SDClass::exists(const char *path)
+{
+    std::string key = normalise(path);
+    return cacheDirectoryOf(key) && (files.count(key) || dirs.count(key));
+}
+
+bool SDClass::mkdir(const char *path)
+{
+    if (!present)
+    {
+        return false;
+    }
+
+    // creates parents too, like the real library
+    std::string key = normalise(path);
+    while (!key.empty())
+    {
+        dirs.insert(key);
+        key = parentOf(key);
+    }
+    return true;
+}
+
+bool SDClass::remove(const char *path)
+{
+    return present && files.erase(normalise(path)) > 0;
+}
+
+File SDClass::open(const char *path, uint8_t mode)
+{
+    opens++;
+
+    std::string key = normalise(path);
+    if (!key.empty() && !cacheDirectoryOf(key))
+    {
+        return File();
+    }
+
+    if (key.empty() || dirs.count(key))
+    {
+        std::vector<std::string> children;
+        for (auto &entry : files)
+        {
+            if (parentOf(entry.first) == key)
+                children.push_back(entry.first);
+        }
+        for (auto &dir : dirs)
+        {
+            if (parentOf(dir) == key)
+                children.push_back(dir);
+        }
+        std::sort(children.begin(), children.end());
+        return File(key, children);
+    }
+
+    auto found = files.find(key);
+    if (mode == FILE_READ)
+    {
+        return (found == files.end()) ? File() : File(key, found->second, false);
+    }
+
+    std::string parent = parentOf(key);
+    if (!parent.empty() && !dirs.count(parent))
+    {
+        return File();
+    }
+
+    if (found == files.end())
+    {
+        found = files.emplace(key, std::make_shared<NativeFileData>()).first;
+    }
+    return File(key, found->second, true);
+}
+
+void SDClass::nativeReset()
+{
+    files.clear();
+    dirs.clear();
+    present = true;
+    opens = 0;
+    cached = {nullptr, 0};
+}
+
+void SDClass::nativeWriteFile(const char *path, const std::string &contents)
+{
+    std::string key = normalise(path);
+    std::string parent = parentOf(key);
+    if (!parent.empty())
+    {
+        mkdir(parent.c_str());
+    }
+
+    auto data = std::make_shared<NativeFileData>();
+    data->bytes.assign(contents.begin(), contents.end());
+    files[key] = data;
+}
+
+std::string SDClass::nativeReadFile(const char *path)
+{
+    auto found = files.find(normalise(path));
+    return (found == files.end()) ? std::string() : std::string(found->second->bytes.begin(), found->second->bytes.end());
+}
+
+std::string SDClass::normalise(const char *path)
+{
+    // no leading or trailing slash, upper case
+    std::string key;
+    for (const char *c = path; *c; c++)
+    {
+        key += toupper(*c);
+    }
+    while (!key.empty() && key.front() == '/')
+        key.erase(0, 1);
+    while (!key.empty() && key.back() == '/')
+        key.pop_back();
+    return key;
+}
+
+std::string SDClass::parentOf(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return (slash == std::string::npos) ? std::string() : path.substr(0, slash);
+}
@@ -0,0 +1,116 @@
+#ifndef NATIVE_SD_H
+#define NATIVE_SD_H
+
+// In-memory stand-in for the Arduino SD library. Paths are case-insensitive like FAT and
+// File::name() returns the upper case 8.3 style name the real library reports.
+//
+// Like the library it keeps one 512 byte block of the card cached, and only going to the card fails once the card
+// is pulled: the root directory and whatever block was last used are still served from RAM.
+
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#define FILE_READ 0x01
+#define FILE_WRITE 0x13
+
+// bytes set aside for a file opened for writing, see HeapStats
+#define NATIVE_FILE_RESERVE (1024 * 1024)
+
+#define NATIVE_BLOCK_SIZE 512
+
+// a block of the card: a directory, or one block of a file's data
+struct NativeBlock
+{
+    const void *owner;
+    uint32_t index;
+};
+
+struct NativeFileData
+{
+    std::vector<uint8_t> bytes;
+};
+
+class File : public Stream
+{
+public:
+    File() {}
+    File(const std::string &path_, std::shared_ptr<NativeFileData> data_, bool writable_);
+    File(const std::string &path_, const std::vector<std::string> &children_);
+
+    operator bool() const { return open; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    int read(void *buffer, size_t size);
+
+    bool seek(uint32_t pos);
+    uint32_t position();
+    uint32_t size();
+    void flush() override {}
+    void close();
+
+    const char *name();
+    bool isDirectory();
+    File openNextFile(uint8_t mode = FILE_READ);
+    void rewindDirectory();
+
+private:
+    bool open = false;
+    bool directory = false;
+    bool writable = false;
+    std::string path;
+    std::string shortName;
+    std::shared_ptr<NativeFileData> data;
+    size_t pos = 0;
+
+    std::vector<std::string> children; // full paths, for directories
+    size_t nextChild = 0;
+};
+
+class SDClass
+{
+public:
+    bool begin(uint8_t csPin = 0);
+    void end() {}
+
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool mkdir(const char *path);
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    File open(const char *path, uint8_t mode = FILE_READ);
+    File open(const String &path, uint8_t mode = FILE_READ) { return open(path.c_str(), mode); }
+
+    // test helpers
+    void nativeReset();
+    void nativeWriteFile(const char *path, const std::string &contents);
+    std::string nativeReadFile(const char *path);
+    bool present = true; // card inserted
+    uint32_t opens = 0;  // number of open() calls, for tests that check caching
+
+    // makes block the cached one, false if that needs the card and it's gone
+    bool nativeCacheBlock(NativeBlock block);
+
+private:
+    bool cacheDirectoryOf(const std::string &key);
+
+    static std::string normalise(const char *path);
+    static std::string parentOf(const std::string &path);
+
+    std::map<std::string, std::shared_ptr<NativeFileData>> files;
+    std::set<std::string> dirs;
+    NativeBlock cached = {nullptr, 0};
+};
+
+extern SDClass SD;
+
+#endif // NATIVE_SD_H
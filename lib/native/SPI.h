@@ -0,0 +1,6 @@
+#ifndef NATIVE_SPI_H
+#define NATIVE_SPI_H
+
+// Nothing in the project talks to SPI directly, SD.h covers the card
+
+#endif // NATIVE_SPI_H
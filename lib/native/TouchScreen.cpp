@@ -0,0 +1,21 @@
+#include "TouchScreen.h"
+
+TouchScreen::TouchScreen(uint8_t xp, uint8_t yp, uint8_t xm, uint8_t ym, uint16_t rx)
+{
+    (void)xp;
+    (void)yp;
+    (void)xm;
+    (void)ym;
+    (void)rx;
+}
+
+TSPoint TouchScreen::getPoint()
+{
+    int16_t x = 0;
+    int16_t y = 0;
+    if (nativePanel.readTouch(x, y))
+    {
+        return TSPoint(x, y, NATIVE_TOUCH_PRESSURE);
+    }
+    return TSPoint();
+}
@@ -0,0 +1,26 @@
+#ifndef NATIVE_TOUCHSCREEN_H
+#define NATIVE_TOUCHSCREEN_H
+
+// Stand-in for Adafruit TouchScreen, readings come from nativePanel's touch script
+
+#include "Arduino.h"
+#include "NativePanel.h"
+
+class TSPoint
+{
+public:
+    TSPoint() : x(0), y(0), z(0) {}
+    TSPoint(int16_t x_, int16_t y_, int16_t z_) : x(x_), y(y_), z(z_) {}
+
+    int16_t x, y, z;
+};
+
+class TouchScreen
+{
+public:
+    TouchScreen(uint8_t xp, uint8_t yp, uint8_t xm, uint8_t ym, uint16_t rx);
+
+    TSPoint getPoint();
+};
+
+#endif // NATIVE_TOUCHSCREEN_H
@@ -0,0 +1,19 @@
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire
+{
+public:
+    TwoWire() {}
+    TwoWire(uint32_t sda, uint32_t scl) { (void)sda, (void)scl; }
+
+    void begin() {}
+    void begin(uint32_t sda, uint32_t scl) { (void)sda, (void)scl; }
+    void setClock(uint32_t frequency) { (void)frequency; }
+};
+
+extern TwoWire Wire;
+
+#endif // NATIVE_WIRE_H
@@ -0,0 +1,8 @@
+#ifndef NATIVE_PGMSPACE_H
+#define NATIVE_PGMSPACE_H
+
+// Flash and RAM are one address space on the host, Arduino.h already defines PROGMEM and pgm_read_word
+
+#include "Arduino.h"
+
+#endif // NATIVE_PGMSPACE_H
@@ -0,0 +1,119 @@
+#include "Telemetry.h"
+
+Telemetry telemetry;
+
+Telemetry::Telemetry() : head(0), tail(0), sequence(0), sent(0), dropped(0)
+{
+}
+
+void Telemetry::begin(unsigned long baud)
+{
+    // the ST-Link virtual COM port runs well above the 115200 used for debug text
+    Serial.begin(baud);
+}
+
+bool Telemetry::send(uint8_t type, const void *payload, uint8_t len)
+{
+    if (len > TELEMETRY_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    uint8_t frame[TELEMETRY_MAX_PAYLOAD + 5];
+    frame[0] = type;
+    frame[1] = sequence & 0xFF;
+    frame[2] = sequence >> 8;
+    memcpy(&frame[3], payload, len);
+
+    uint16_t crc = crc16(frame, len + 3);
+    frame[len + 3] = crc & 0xFF;
+    frame[len + 4] = crc >> 8;
+
+    // COBS adds at most one byte per 254. The frame is delimited by 0x00 on both sides so debug
+    // text written to the same port in between can only corrupt itself
+    uint8_t encoded[TELEMETRY_MAX_PAYLOAD + 8];
+    encoded[0] = 0x00;
+    size_t encodedLen = cobsEncode(frame, len + 5, &encoded[1]) + 1;
+    encoded[encodedLen++] = 0x00;
+
+    sequence++; // counts dropped frames too, so the host can see the gaps
+
+    uint16_t used = (head - tail + TELEMETRY_BUFFER_SIZE) % TELEMETRY_BUFFER_SIZE;
+    if (encodedLen > (size_t)(TELEMETRY_BUFFER_SIZE - 1 - used))
+    {
+        dropped++;
+        return false;
+    }
+
+    for (size_t i = 0; i < encodedLen; i++)
+    {
+        buffer[head] = encoded[i];
+        head = (head + 1) % TELEMETRY_BUFFER_SIZE;
+    }
+
+    sent++;
+    return true;
+}
+
+void Telemetry::service()
+{
+    // only hand the UART what fits in its transmit buffer, Serial.write() would block otherwise
+    while (head != tail)
+    {
+        int space = Serial.availableForWrite();
+        if (space <= 0)
+        {
+            break;
+        }
+
+        // contiguous run up to the end of the ring
+        uint16_t available = (head > tail) ? (head - tail) : (TELEMETRY_BUFFER_SIZE - tail);
+        uint16_t count = min((uint16_t)space, available);
+
+        Serial.write(&buffer[tail], count);
+        tail = (tail + count) % TELEMETRY_BUFFER_SIZE;
+    }
+}
+
+uint32_t Telemetry::getSent()
+{
+    return sent;
+}
+
+uint32_t Telemetry::getDropped()
+{
+    return dropped;
+}
+
+size_t Telemetry::cobsEncode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t codeIndex = 0; // where the current block's length byte goes
+    size_t outIndex = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (in[i] == 0)
+        {
+            out[codeIndex] = code;
+            codeIndex = outIndex++;
+            code = 1;
+        }
+        else
+        {
+            out[outIndex++] = in[i];
+            code++;
+
+            if (code == 0xFF)
+            {
+                out[codeIndex] = code;
+                codeIndex = outIndex++;
+                code = 1;
+            }
+        }
+    }
+
+    out[codeIndex] = code;
+
+    return outIndex;
+}
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "Checksum.hpp"
+
+#ifndef TELEMETRY_BAUD
+#define TELEMETRY_BAUD 921600
+#endif
+
+#define TELEMETRY_BUFFER_SIZE 2048 // encoded frames waiting for the UART
+#define TELEMETRY_MAX_PAYLOAD 48
+
+// Every frame is [type][sequence (2)][payload][CRC-16 (2)], COBS encoded and wrapped in 0x00 delimiters.
+// Text from DBG() can share the port, the host decoder drops anything that fails the CRC.
+enum telemetryFrameType : uint8_t
+{
+    TELEMETRY_CONTROL = 1, // telemetryControlSample, one per control tick
+    TELEMETRY_LOG = 2,     // [level][token (4)][arguments], see LOG_INFO() in Debug.hpp
+};
+
+enum telemetryControlState : uint8_t
+{
+    TELEMETRY_RUN = 0,
+    TELEMETRY_CALIBRATE_GROUND = 1,
+    TELEMETRY_CALIBRATE_PUMPING = 2,
+    TELEMETRY_CALIBRATE_LEAKING = 3,
+};
+
+struct __attribute__((packed)) telemetryControlSample
+{
+    uint32_t timeUs;
+    float setpoint; // Pa
+    float input;    // filtered pressure, Pa
+    float output;   // pump command, -100 to 100 %
+    float kp;
+    float ki;
+    float kd;
+    uint8_t state; // telemetryControlState
+};
+
+// Non-blocking binary telemetry. send() only copies the encoded frame into a ring buffer and
+// drops it if there is no room; service() moves as much as the UART can take without waiting.
+class Telemetry
+{
+public:
+    Telemetry();
+
+    void begin(unsigned long baud = TELEMETRY_BAUD);
+    bool send(uint8_t type, const void *payload, uint8_t len);
+    void service();
+
+    uint32_t getSent();
+    uint32_t getDropped();
+
+private:
+    static size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out);
+
+    uint8_t buffer[TELEMETRY_BUFFER_SIZE];
+    uint16_t head; // next byte to write
+    uint16_t tail; // next byte to send
+
+    uint16_t sequence;
+    uint32_t sent;
+    uint32_t dropped;
+};
+
+extern Telemetry telemetry;
+
+#endif // TELEMETRY_H
@@ -0,0 +1,136 @@
+"""
+Decode the binary telemetry stream from lib/telemetry/Telemetry.cpp
+
+usage:
+    python telemetry_decode.py /dev/ttyACM0 run.csv            # live from the board (needs pyserial)
+    python telemetry_decode.py capture.bin run.npy             # from a raw capture
+    python telemetry_decode.py /dev/ttyACM0 run.csv --baud 921600
+
+Output is CSV, or a .npy file that can be opened with np.load(path, mmap_mode="r")
+"""
+
+import argparse
+import struct
+import sys
+
+import numpy as np
+
+TELEMETRY_CONTROL = 1
+
+# must match telemetryControlSample
+CONTROL_FORMAT = "<IffffffB"
+CONTROL_DTYPE = np.dtype(
+    [
+        ("seq", "<u2"),
+        ("time_us", "<u4"),
+        ("setpoint", "<f4"),
+        ("input", "<f4"),
+        ("output", "<f4"),
+        ("kp", "<f4"),
+        ("ki", "<f4"),
+        ("kd", "<f4"),
+        ("state", "u1"),
+    ]
+)
+
+
+def crc16(data):
+    # CRC-16/CCITT-FALSE, same as crc16() in Checksum.cpp
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            return None
+        out += data[i + 1 : i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(chunks):
+    """Yield (type, seq, payload) for every frame that passes the CRC"""
+    pending = bytearray()
+    for chunk in chunks:
+        pending += chunk
+        while True:
+            end = pending.find(b"\x00")
+            if end < 0:
+                break
+            raw = bytes(pending[:end])
+            del pending[: end + 1]
+
+            frame = cobs_decode(raw) if raw else None
+            if frame is None or len(frame) < 5:
+                continue  # debug text or a partial frame
+
+            body, crc = frame[:-2], struct.unpack("<H", frame[-2:])[0]
+            if crc16(body) != crc:
+                continue
+
+            yield body[0], struct.unpack("<H", body[1:3])[0], body[3:]
+
+
+def read_source(path, baud):
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial
+
+        port = serial.Serial(path, baud, timeout=0.1)
+        while True:
+            yield port.read(4096)
+    else:
+        with open(path, "rb") as f:
+            while True:
+                chunk = f.read(65536)
+                if not chunk:
+                    return
+                yield chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="serial port or raw capture file")
+    parser.add_argument("output", help=".csv or .npy")
+    parser.add_argument("--baud", type=int, default=921600)
+    args = parser.parse_args()
+
+    rows = []
+    last_seq = None
+    lost = 0
+
+    try:
+        for frame_type, seq, payload in frames(read_source(args.source, args.baud)):
+            if last_seq is not None:
+                lost += (seq - last_seq - 1) & 0xFFFF
+            last_seq = seq
+
+            if frame_type == TELEMETRY_CONTROL and len(payload) == struct.calcsize(CONTROL_FORMAT):
+                rows.append((seq,) + struct.unpack(CONTROL_FORMAT, payload))
+    except KeyboardInterrupt:
+        pass
+
+    samples = np.array(rows, dtype=CONTROL_DTYPE)
+
+    if args.output.endswith(".npy"):
+        out = np.lib.format.open_memmap(args.output, mode="w+", dtype=CONTROL_DTYPE, shape=samples.shape)
+        out[:] = samples
+        out.flush()
+    else:
+        np.savetxt(args.output, samples, delimiter=",", header=",".join(CONTROL_DTYPE.names), comments="", fmt="%s")
+
+    print(f"{len(samples)} samples, {lost} frames lost", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,20 @@
 #include "UI.h"
 #include <Arduino.h>
 #include "Debug.hpp"
+#include "Telemetry.h"
+#include "Profiler.hpp"
 
 UI *ui;
 
 void setup(void)
 {
     INITIALISE_DBG(115200);
+#ifdef ENABLE_TELEMETRY
+    telemetry.begin(TELEMETRY_BAUD);
+#endif
+#ifdef ENABLE_PROFILER
+    profiler.begin();
+#endif
     delay(500);
 
     ui = new UI();
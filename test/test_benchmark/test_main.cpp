@@ -0,0 +1,485 @@
+#include <unity.h>
+#include <Arduino.h>
+
+#include "ROCKET_SIM.h"
+#include "PID_v1.hpp"
+#include "KalmanFilter.hpp"
+#include "Profiler.hpp"
+#include "Pump.h"
+#include "PumpCurve.h"
+#include "Mpc.hpp"
+#include "RunMetrics.h"
+#include "HeapStats.hpp"
+
+#ifdef TARGET_ENV_NATIVE
+#include <SD.h>
+#include <Adafruit_BMP280.h>
+#include "Controller.h"
+#include "SD.hpp"
+#endif
+
+// Microbenchmarks for the compute paths. `pio test -e native -f test_benchmark` reports ns/op and
+// heap allocations per op, `pio test -e nucleo_f446re -f test_benchmark` reports cycles/op from DWT.
+// Each case also checks its result so a broken optimisation can't look fast.
+
+struct benchResult
+{
+    uint32_t iterations;
+    uint64_t ticks;
+    uint32_t allocations;
+};
+
+static benchResult bench;
+
+static void benchStart()
+{
+    bench = benchResult();
+}
+
+// call with the ticks of one timed operation
+static inline void benchRecord(uint32_t ticks)
+{
+    bench.iterations++;
+    bench.ticks += ticks;
+}
+
+static void benchReport(const char *name)
+{
+    char line[96];
+    uint32_t perOp = bench.iterations ? bench.ticks / bench.iterations : 0;
+#ifdef TARGET_ENV_NATIVE
+    snprintf(line, sizeof(line), "%-28s %10lu ns/op %6.2f allocs/op (%lu ops)", name, (unsigned long)perOp,
+             bench.iterations ? (double)bench.allocations / bench.iterations : 0.0, (unsigned long)bench.iterations);
+#else
+    snprintf(line, sizeof(line), "%-28s %10lu cycles/op %8lu ns/op (%lu ops)", name, (unsigned long)perOp,
+             (unsigned long)((uint64_t)perOp * 1000000000ULL / SystemCoreClock), (unsigned long)bench.iterations);
+#endif
+    TEST_MESSAGE(line);
+}
+
+#ifdef TARGET_ENV_NATIVE
+#define BENCH_ALLOC_START() uint32_t allocStart = HeapStats::getCounts().allocations
+#define BENCH_ALLOC_STOP() bench.allocations += HeapStats::getCounts().allocations - allocStart
+#else
+#define BENCH_ALLOC_START()
+#define BENCH_ALLOC_STOP()
+#endif
+
+void setUp(void)
+{
+#ifdef TARGET_ENV_NATIVE
+    SD.nativeReset();
+#endif
+}
+
+void tearDown(void)
+{
+}
+
+static volatile float sink; // keeps results alive
+
+// ************************ ROCKET_SIM ************************
+
+void bench_run_simulation(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+
+    benchStart();
+    for (int i = 0; i < 20; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        bool valid = sim.runSimulation(data);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+
+        TEST_ASSERT_TRUE(valid);
+        TEST_ASSERT_FLOAT_WITHIN(10.0f, 1000.0f, data.apogee);
+    }
+    benchReport("ROCKET_SIM::runSimulation");
+
+    // what the POINT page slider regenerates
+    benchStart();
+    for (int i = 0; i < 20; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        sim.runSimulation(data, SIM_TIME | SIM_ALTITUDE);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    benchReport("runSimulation time+altitude");
+
+    // drag model with RK4, the same slider regeneration
+    ROCKET_SIM drag(2.0f, 1000.0f, -10.0f, SIM_MODEL_DRAG);
+    benchStart();
+    for (int i = 0; i < 20; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        bool valid = drag.runSimulation(data, SIM_TIME | SIM_ALTITUDE);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+
+        TEST_ASSERT_TRUE(valid);
+        TEST_ASSERT_FLOAT_WITHIN(10.0f, 1000.0f, data.apogee);
+    }
+    benchReport("runSimulation drag (RK4)");
+}
+
+void bench_batch_altitude_to_pressure(void)
+{
+    static float altitude[resolution];
+    static float pressure[resolution];
+
+    for (int i = 0; i < resolution; i++)
+    {
+        altitude[i] = i * 4.0f;
+    }
+
+    benchStart();
+    for (int i = 0; i < 20; i++)
+    {
+        uint32_t start = Profiler::now();
+        ROCKET_SIM::altitudeToPressure(altitude, pressure, resolution);
+        uint32_t ticks = Profiler::now() - start;
+
+        // reported per point
+        bench.iterations += resolution;
+        bench.ticks += ticks;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 28062.25f, pressure[2500]);
+    benchReport("altitudeToPressure (batch)");
+}
+
+void bench_sample_pressure(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+
+    TEST_ASSERT_TRUE(sim.runSimulation(data));
+    TEST_ASSERT_LESS_OR_EQUAL(SIM_TOLERANCE_PA, data.max_error);
+
+    char line[96];
+    snprintf(line, sizeof(line), "  %d points, max error %.2f Pa", data.num_points, data.max_error);
+    TEST_MESSAGE(line);
+
+    // a setpoint lookup per control tick over the whole run
+    int cursor = 1;
+    float pressure, sum = 0;
+    float end = data.time[data.num_points - 1];
+
+    benchStart();
+    for (float t = 0; t < end; t += 0.01f)
+    {
+        uint32_t start = Profiler::now();
+        ROCKET_SIM::samplePressure(data, t, cursor, pressure);
+        benchRecord(Profiler::now() - start);
+        sum += pressure;
+    }
+    sink = sum;
+    benchReport("ROCKET_SIM::samplePressure");
+}
+
+void bench_altitude_to_pressure(void)
+{
+    benchStart();
+    float sum = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        sum += ROCKET_SIM::altitudeToPressure(i);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    sink = sum;
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 28062.25f, ROCKET_SIM::altitudeToPressure(10000));
+    benchReport("altitudeToPressure");
+}
+
+void bench_pressure_to_altitude(void)
+{
+    benchStart();
+    float sum = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        sum += ROCKET_SIM::pressureToAltitude(30000 + i * 7);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    sink = sum;
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 1000.0f, ROCKET_SIM::pressureToAltitude(90302.47f));
+    benchReport("pressureToAltitude");
+}
+
+// ************************ PID ************************
+
+void bench_pid_compute(void)
+{
+    double input = 50000, output = 0, setpoint = 60000;
+    PID pid(&input, &output, &setpoint, 0.01, 0.001, 0, DIRECT);
+    pid.SetOutputLimits(-255, 255);
+    pid.SetSampleTime(1);
+    pid.SetMode(AUTOMATIC);
+
+    // only calls that actually compute an output are timed
+    benchStart();
+    while (bench.iterations < 1000)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        bool computed = pid.Compute();
+        uint32_t ticks = Profiler::now() - start;
+        BENCH_ALLOC_STOP();
+
+        if (computed)
+        {
+            benchRecord(ticks);
+            input += output;
+        }
+#ifdef TARGET_ENV_NATIVE
+        delay(1);
+#endif
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1000.0, 60000.0, input);
+    benchReport("PID::Compute");
+}
+
+void bench_pid_set_tunings(void)
+{
+    double input = 0, output = 0, setpoint = 0;
+    PID pid(&input, &output, &setpoint, 0, 0, 0, DIRECT);
+
+    benchStart();
+    for (int i = 0; i < 10000; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        pid.SetTunings(0.01 + i * 1e-6, 0.001, 0.0001);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 0.01 + 9999 * 1e-6, pid.GetKp());
+    benchReport("PID::SetTunings");
+}
+
+// ************************ KALMAN ************************
+
+void bench_kalman_update(void)
+{
+    KalmanFilter filter(1.0f, 4.0f, 1.0f, 0.0f);
+
+    benchStart();
+    for (int i = 0; i < 10000; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        filter.update(101325.0f);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 101325.0f, filter.getValue());
+    benchReport("KalmanFilter::update");
+}
+
+void bench_pump_curve_apply(void)
+{
+    static PumpCurve curve;
+    volatile float sink = 0;
+
+    benchStart();
+    for (int i = 0; i < 10000; i++)
+    {
+        float command = (i % 101);
+        float pressure = 30000 + (i % 70) * 1000;
+
+        uint32_t start = Profiler::now();
+        sink = curve.apply(command, pressure);
+        benchRecord(Profiler::now() - start);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, (9999 % 101), sink);
+    benchReport("PumpCurve::apply");
+}
+
+void bench_mpc_solve(void)
+{
+    static Mpc mpc;
+    float reference[MPC_HORIZON];
+    float pressure = 100000;
+    float command = 0;
+
+    // closed loop on a descending ramp, so each solve warm starts from the last plan like in a run
+    benchStart();
+    for (int i = 0; i < 200; i++)
+    {
+        for (uint8_t k = 0; k < MPC_HORIZON; k++)
+        {
+            reference[k] = 100000 - 500 * 0.1f * (i + k + 1);
+        }
+
+        uint32_t start = Profiler::now();
+        mpc.solve(pressure, reference, 0.05f, 40, 101325, command);
+        benchRecord(Profiler::now() - start);
+
+        pressure += 0.1f * (0.05f * (101325 - pressure) - 40 * command);
+    }
+    TEST_ASSERT_TRUE(command >= 0 && command <= 100);
+    benchReport("Mpc::solve");
+}
+
+void bench_run_metrics_add(void)
+{
+    static RunMetrics metrics;
+    metrics.begin();
+
+    benchStart();
+    for (int i = 0; i < 10000; i++)
+    {
+        float setpoint = 100000 - i;
+        float pressure = setpoint + (i % 100);
+
+        uint32_t start = Profiler::now();
+        metrics.add(i * 550, setpoint, pressure, -50);
+        benchRecord(Profiler::now() - start);
+    }
+    TEST_ASSERT_EQUAL(10000, metrics.getSummary().samples);
+    benchReport("RunMetrics::add");
+}
+
+void bench_pump_send_command(void)
+{
+    static Pump pump;
+
+    // near equilibrium the PID output only wanders by a fraction of a duty step between ticks
+    uint32_t writes = pump.getWrites();
+
+    benchStart();
+    for (int i = 0; i < 10000; i++)
+    {
+        double output = -40.0 - 0.001 * (i % 8);
+
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        pump.sendCommand(output);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+    TEST_ASSERT_LESS_THAN(100, pump.getWrites() - writes);
+    benchReport("Pump::sendCommand");
+}
+
+#ifdef TARGET_ENV_NATIVE
+// ************************ GAIN SCHEDULE (host, needs the SD stand-in) ************************
+
+static void writeGainSchedule(int rows)
+{
+    std::string csv;
+    for (int i = 0; i < rows; i++)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "%.4f,%.5f,%.6f,%d\n", 0.01 + i * 0.001, 0.001, 0.0001, 110000 - i * 1000);
+        csv += line;
+    }
+    SD.nativeWriteFile("/CONTROL/gains.csv", csv);
+}
+
+void bench_update_gains(void)
+{
+    static Controller controller;
+
+    writeGainSchedule(MAX_GAIN_ROWS);
+    nativeBmp280(0x76).pressure = 101325;
+    nativeBmp280(0x77).pressure = 101325;
+    TEST_ASSERT_TRUE(controller.initDevices());
+    TEST_ASSERT_TRUE(controller.initGainSchedule("/CONTROL/gains.csv"));
+
+    benchStart();
+    for (int i = 0; i < 1000; i++)
+    {
+        nativeBmp280(0x76).pressure = 30000 + (i % 80) * 1000;
+        nativeBmp280(0x77).pressure = 30000 + (i % 80) * 1000;
+        controller.updateReading();
+
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        controller.updateGains();
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+    }
+
+    double Kp, Ki, Kd;
+    controller.getGains(Kp, Ki, Kd);
+    TEST_ASSERT_TRUE(Kp > 0);
+    benchReport("Controller::updateGains");
+}
+
+void bench_gain_csv_parser(void)
+{
+    static gainScheduleData gains;
+    Sd sd;
+
+    writeGainSchedule(MAX_GAIN_ROWS);
+
+    benchStart();
+    for (int i = 0; i < 50; i++)
+    {
+        BENCH_ALLOC_START();
+        uint32_t start = Profiler::now();
+        bool loaded = sd.loadGainsFromFile("/CONTROL/gains.csv", gains);
+        benchRecord(Profiler::now() - start);
+        BENCH_ALLOC_STOP();
+
+        TEST_ASSERT_TRUE(loaded);
+    }
+    TEST_ASSERT_EQUAL(MAX_GAIN_ROWS, gains.height);
+    TEST_ASSERT_EQUAL_FLOAT(110000 - (MAX_GAIN_ROWS - 1) * 1000, gains.data[0][3]);
+    benchReport("Sd::loadGainsFromFile");
+}
+#endif // TARGET_ENV_NATIVE
+
+static void runBenchmarks()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(bench_run_simulation);
+    RUN_TEST(bench_altitude_to_pressure);
+    RUN_TEST(bench_batch_altitude_to_pressure);
+    RUN_TEST(bench_sample_pressure);
+    RUN_TEST(bench_pressure_to_altitude);
+    RUN_TEST(bench_pid_compute);
+    RUN_TEST(bench_pid_set_tunings);
+    RUN_TEST(bench_kalman_update);
+    RUN_TEST(bench_pump_curve_apply);
+    RUN_TEST(bench_pump_send_command);
+    RUN_TEST(bench_mpc_solve);
+    RUN_TEST(bench_run_metrics_add);
+#ifdef TARGET_ENV_NATIVE
+    RUN_TEST(bench_update_gains);
+    RUN_TEST(bench_gain_csv_parser);
+#endif
+
+    UNITY_END();
+}
+
+#ifdef TARGET_ENV_NATIVE
+int main(int argc, char **argv)
+{
+    runBenchmarks();
+    return 0;
+}
+#else
+void setup()
+{
+    delay(2000); // give the test runner time to open the port
+    profiler.begin();
+    runBenchmarks();
+}
+
+void loop()
+{
+}
+#endif
@@ -0,0 +1,1468 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <Adafruit_BMP280.h>
+
+#include "ROCKET_SIM.h"
+#include "SimCache.h"
+#include "PID_v1.hpp"
+#include "KalmanFilter.hpp"
+#include "Mpc.hpp"
+#include "Controller.h"
+#include "SD.hpp"
+#include "TrajectoryStream.h"
+#include "pressureSensor.h"
+#include "AnalogSampler.h"
+#include "DeviceManager.h"
+#include "Pump.h"
+#include "PumpCurve.h"
+#include "SafetyMonitor.h"
+#include "BatchRunner.h"
+#include "RunMetrics.h"
+#include "DirIndex.h"
+#include "Arena.hpp"
+#include "FixedString.hpp"
+#include "HeapStats.hpp"
+#include "Profiler.hpp"
+#include <IWatchdog.h>
+
+// Correctness checks for the compute libraries, run with `pio test -e native`
+
+void setUp(void)
+{
+    SD.nativeReset();
+    nativeBmp280(0x76) = NativeBmp280Device();
+    nativeBmp280(0x77) = NativeBmp280Device();
+    analogSampler.end();
+    AnalogSampler::unlockAdc();
+    safetyMonitor.disarm();
+}
+
+void tearDown(void)
+{
+}
+
+// ************************ ROCKET_SIM ************************
+
+void test_altitude_to_pressure_reference(void)
+{
+    // reference values from the same barometric formula (300 K base, -6.5 K/km lapse rate)
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101325.0f, ROCKET_SIM::altitudeToPressure(0));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 90302.47f, ROCKET_SIM::altitudeToPressure(1000));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 55449.52f, ROCKET_SIM::altitudeToPressure(5000));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 28062.25f, ROCKET_SIM::altitudeToPressure(10000));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 102484.57f, ROCKET_SIM::altitudeToPressure(-100));
+}
+
+void test_pressure_altitude_round_trip(void)
+{
+    for (float h = -100; h <= 10000; h += 250)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, h, ROCKET_SIM::pressureToAltitude(ROCKET_SIM::altitudeToPressure(h)));
+    }
+}
+
+void test_simulation_reaches_apogee(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+
+    TEST_ASSERT_TRUE(sim.runSimulation(data));
+    TEST_ASSERT_EQUAL(SIM_ALL, data.columns);
+    TEST_ASSERT_GREATER_THAN(10, data.num_points);
+
+    // apogee within 1% of the request, a = 65.3 m/s^2 for 2 s then coasting -> t = 15.3 s
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, 1000.0f, data.apogee);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 15.3f, data.time_at_apogee);
+
+    // time ascends from 0, pressure matches altitude, ends on the ground
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, data.time[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101325.0f, data.pressure[0]);
+    for (int i = 1; i < data.num_points; i++)
+    {
+        TEST_ASSERT_TRUE(data.time[i] > data.time[i - 1]);
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, ROCKET_SIM::altitudeToPressure(data.altitude[i]), data.pressure[i]);
+    }
+    TEST_ASSERT_LESS_THAN(1.0f, data.altitude[data.num_points - 1]);
+}
+
+void test_simulation_lazy_columns(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+
+    // points past the landing and columns that weren't asked for are left alone
+    for (int i = 0; i < SIM_MAX_POINTS; i++)
+    {
+        data.velocity[i] = -1;
+        data.altitude[i] = -1;
+    }
+
+    // pressure comes with every profile, points are placed by it
+    TEST_ASSERT_TRUE(sim.runSimulation(data, SIM_TIME | SIM_ALTITUDE));
+    TEST_ASSERT_EQUAL(SIM_TIME | SIM_ALTITUDE | SIM_PRESSURE, data.columns);
+    TEST_ASSERT_EQUAL_FLOAT(-1, data.velocity[10]);
+    TEST_ASSERT_EQUAL_FLOAT(-1, data.altitude[data.num_points]);
+    TEST_ASSERT_TRUE(ROCKET_SIM::fillColumns(data, SIM_PRESSURE));
+
+    // velocity can't be derived afterwards
+    TEST_ASSERT_FALSE(ROCKET_SIM::fillColumns(data, SIM_VELOCITY));
+
+    // an apogee the burn can't reach
+    ROCKET_SIM impossible(2.0f, -1000.0f, -10.0f);
+    TEST_ASSERT_FALSE(impossible.runSimulation(data));
+    TEST_ASSERT_EQUAL(0, data.num_points);
+}
+
+// altitude of the kinematic model worked out directly: burn, coast under gravity, then terminal velocity
+static float kinematicAltitude(float time, float acceleration, float burnout_time, float terminal_velocity)
+{
+    const float g = -9.81f;
+    if (time <= burnout_time)
+    {
+        return 0.5f * acceleration * time * time;
+    }
+
+    float burnoutAltitude = 0.5f * acceleration * burnout_time * burnout_time;
+    float burnoutVelocity = acceleration * burnout_time;
+    float coast = (terminal_velocity - burnoutVelocity) / g;
+    float t = time - burnout_time;
+    if (t <= coast)
+    {
+        return burnoutAltitude + burnoutVelocity * t + 0.5f * g * t * t;
+    }
+    return burnoutAltitude + burnoutVelocity * coast + 0.5f * g * coast * coast + terminal_velocity * (t - coast);
+}
+
+void test_points_follow_the_curve_within_tolerance(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+
+    TEST_ASSERT_TRUE(sim.runSimulation(data, SIM_ALL, 5.0f));
+    TEST_ASSERT_LESS_OR_EQUAL(5.0f, data.max_error);
+
+    // a fraction of the integration steps, and the whole profile takes less memory than one column of them did
+    TEST_ASSERT_LESS_THAN(resolution / 20, data.num_points);
+    TEST_ASSERT_LESS_THAN(resolution * sizeof(float), sizeof(sim_data));
+
+    // interpolating the points stays within tolerance of the flight everywhere, not just at the points.
+    // a = 65.3 m/s^2 reaches 1000 m in a 2 s burn
+    const float acceleration = 65.3023f;
+    float end = data.time[data.num_points - 1];
+    int cursor = 1;
+    float worst = 0;
+    for (int i = 0; i < 5000; i++)
+    {
+        float time = end * i / 5000.0f;
+        float pressure;
+        TEST_ASSERT_TRUE(ROCKET_SIM::samplePressure(data, time, cursor, pressure));
+        worst = max(worst, abs(pressure - ROCKET_SIM::altitudeToPressure(kinematicAltitude(time, acceleration, 2.0f, -10.0f))));
+    }
+    TEST_ASSERT_LESS_THAN(5.0f + 1.0f, worst);
+
+    // burnout and apogee are points of their own, apogee placed closer than a step of the integration, while the
+    // straight descent needs next to nothing
+    const float step = end / (resolution - 1);
+    bool burnout = false;
+    for (int i = 1; i < data.num_points; i++)
+    {
+        burnout = burnout || (data.time[i] == 2.0f);
+    }
+    TEST_ASSERT_TRUE(burnout);
+    TEST_ASSERT_FLOAT_WITHIN(step / 4, 15.3134f, data.time_at_apogee);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1000.0f, data.apogee);
+    TEST_ASSERT_GREATER_THAN(5.0f, data.time[data.num_points - 1] - data.time[data.num_points - 2]);
+
+    // a tighter tolerance places more points
+    static sim_data fine;
+    TEST_ASSERT_TRUE(sim.runSimulation(fine, SIM_ALL, 1.0f));
+    TEST_ASSERT_LESS_OR_EQUAL(1.0f, fine.max_error);
+    TEST_ASSERT_GREATER_THAN(data.num_points, fine.num_points);
+}
+
+void test_sample_pressure_interpolates(void)
+{
+    static sim_data data;
+    data.num_points = 3;
+    data.time[0] = 0;
+    data.time[1] = 1;
+    data.time[2] = 5;
+    data.pressure[0] = 100000;
+    data.pressure[1] = 99000;
+    data.pressure[2] = 95000;
+
+    int cursor = 1;
+    float pressure;
+
+    TEST_ASSERT_TRUE(ROCKET_SIM::samplePressure(data, 0.5f, cursor, pressure));
+    TEST_ASSERT_EQUAL_FLOAT(99500, pressure);
+    TEST_ASSERT_TRUE(ROCKET_SIM::samplePressure(data, 4.0f, cursor, pressure));
+    TEST_ASSERT_EQUAL_FLOAT(96000, pressure);
+    TEST_ASSERT_EQUAL(2, cursor);
+
+    // going back in time still works
+    TEST_ASSERT_TRUE(ROCKET_SIM::samplePressure(data, 0.0f, cursor, pressure));
+    TEST_ASSERT_EQUAL_FLOAT(100000, pressure);
+
+    TEST_ASSERT_FALSE(ROCKET_SIM::samplePressure(data, 5.0f, cursor, pressure));
+}
+
+void test_sim_cache_keeps_entries_loaded_before_the_card(void)
+{
+    static sim_data data;
+    static sim_data loaded;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f);
+    TEST_ASSERT_TRUE(sim.runSimulation(data));
+
+    simKey first = SimCache::makeKey(1000, 2, -10);
+    simKey second = SimCache::makeKey(1100, 2, -10);
+    simKey third = SimCache::makeKey(1200, 2, -10);
+
+    static SimCache cache;
+    TEST_ASSERT_TRUE(cache.store(first, data));
+    TEST_ASSERT_TRUE(cache.store(second, data));
+
+    // after a restart the UI asks for a profile before the card is up
+    static SimCache restarted;
+    SD.present = false;
+    TEST_ASSERT_FALSE(restarted.load(first, loaded));
+
+    // the next store adds to the index on the card instead of replacing it
+    SD.present = true;
+    TEST_ASSERT_TRUE(restarted.store(third, data));
+
+    static SimCache later;
+    TEST_ASSERT_TRUE(later.load(first, loaded));
+    TEST_ASSERT_TRUE(later.load(second, loaded));
+    TEST_ASSERT_TRUE(later.load(third, loaded));
+    TEST_ASSERT_EQUAL(data.num_points, loaded.num_points);
+}
+
+void test_drag_model_reaches_apogee_smoothly(void)
+{
+    static sim_data data;
+    ROCKET_SIM sim(2.0f, 1000.0f, -10.0f, SIM_MODEL_DRAG);
+
+    TEST_ASSERT_TRUE(sim.runSimulation(data));
+    TEST_ASSERT_FLOAT_WITHIN(10.0f, 1000.0f, data.apogee);
+
+    // drag makes the coast shorter than the kinematic 15.3 s
+    TEST_ASSERT_LESS_THAN(15.3f, data.time_at_apogee);
+    TEST_ASSERT_GREATER_THAN(5.0f, data.time_at_apogee);
+
+    // no corners after burnout: the mean acceleration between points changes no faster than drag can change it,
+    // under 10 m/s^3 with the parachute opening at apogee
+    float lastAcceleration = (data.velocity[1] - data.velocity[0]) / data.time[1];
+    for (int i = 2; i < data.num_points; i++)
+    {
+        TEST_ASSERT_TRUE(data.time[i] > data.time[i - 1]);
+        float acceleration = (data.velocity[i] - data.velocity[i - 1]) / (data.time[i] - data.time[i - 1]);
+        if (data.time[i - 2] >= 2.0f)
+        {
+            float span = 0.5f * (data.time[i] - data.time[i - 2]);
+            TEST_ASSERT_FLOAT_WITHIN(10.0f * span + 0.1f, lastAcceleration, acceleration);
+        }
+        lastAcceleration = acceleration;
+    }
+
+    // settles on the terminal velocity and lands
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, -10.0f, data.velocity[data.num_points - 1]);
+    TEST_ASSERT_LESS_THAN(1.0f, data.altitude[data.num_points - 1]);
+
+    // apogees the motor can't reach
+    ROCKET_SIM impossible(2.0f, -5.0f, -10.0f, SIM_MODEL_DRAG);
+    TEST_ASSERT_FALSE(impossible.runSimulation(data));
+}
+
+void test_models_fly_the_point_page_slider_range(void)
+{
+    static sim_data data;
+
+    // corners and middle of the POINT page sliders, short burns are where the step used to swallow the burn or the coast
+    const float burnTimes[] = {0.05f, 0.1f, 0.5f, 2.0f, 4.0f};
+    const float apogees[] = {25.0f, 500.0f, 1000.0f, 2000.0f};
+
+    for (simModel model : {SIM_MODEL_KINEMATIC, SIM_MODEL_DRAG})
+    {
+        for (float burnTime : burnTimes)
+        {
+            for (float apogee : apogees)
+            {
+                ROCKET_SIM sim(burnTime, apogee, -10.0f, model);
+                TEST_ASSERT_TRUE(sim.runSimulation(data, SIM_TIME | SIM_ALTITUDE));
+                TEST_ASSERT_FLOAT_WITHIN(0.01f * apogee, apogee, data.apogee);
+                TEST_ASSERT_LESS_THAN(1.0f, data.altitude[data.num_points - 1]);
+            }
+        }
+    }
+}
+
+void test_batch_altitude_to_pressure(void)
+{
+    static float altitude[1001];
+    static float pressure[1001];
+
+    for (int i = 0; i <= 1000; i++)
+    {
+        altitude[i] = -500 + i * 15.5f;
+    }
+
+    ROCKET_SIM::altitudeToPressure(altitude, pressure, 1001);
+
+    for (int i = 0; i <= 1000; i++)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, ROCKET_SIM::altitudeToPressure(altitude[i]), pressure[i]);
+    }
+}
+
+// ************************ PID ************************
+
+void test_pid_proportional(void)
+{
+    double input = 900, output = 0, setpoint = 1000;
+    PID pid(&input, &output, &setpoint, 0.5, 0, 0, DIRECT);
+    pid.SetOutputLimits(-100, 100);
+    pid.SetMode(AUTOMATIC);
+
+    TEST_ASSERT_TRUE(pid.Compute());
+    TEST_ASSERT_EQUAL_FLOAT(50.0, output);
+
+    // nothing happens until a sample time has passed
+    TEST_ASSERT_FALSE(pid.Compute());
+}
+
+void test_pid_integral_and_limits(void)
+{
+    double input = 990, output = 0, setpoint = 1000;
+    PID pid(&input, &output, &setpoint, 0, 1.0, 0, DIRECT);
+    pid.SetOutputLimits(-100, 100);
+    pid.SetMode(AUTOMATIC);
+
+    // Ki is per second, sample time is 100 ms, error 10 -> +1 per compute
+    for (int i = 1; i <= 5; i++)
+    {
+        TEST_ASSERT_TRUE(pid.Compute());
+        TEST_ASSERT_FLOAT_WITHIN(1e-6, i, output);
+        delay(100);
+    }
+
+    setpoint = 100000; // saturates at the limit
+    delay(100);
+    pid.Compute();
+    TEST_ASSERT_EQUAL_FLOAT(100.0, output);
+}
+
+void test_pid_set_tunings(void)
+{
+    double input = 0, output = 0, setpoint = 0;
+    PID pid(&input, &output, &setpoint, 1, 2, 3, DIRECT);
+
+    pid.SetTunings(0.1, 0.2, 0.3);
+    TEST_ASSERT_EQUAL_FLOAT(0.1, pid.GetKp());
+    TEST_ASSERT_EQUAL_FLOAT(0.2, pid.GetKi());
+    TEST_ASSERT_EQUAL_FLOAT(0.3, pid.GetKd());
+
+    // negative gains are rejected
+    pid.SetTunings(-1, 0, 0);
+    TEST_ASSERT_EQUAL_FLOAT(0.1, pid.GetKp());
+}
+
+// ************************ KALMAN ************************
+
+void test_kalman_update(void)
+{
+    KalmanFilter filter(1.0f, 4.0f, 1.0f, 0.0f);
+
+    // P = 1 + 1 = 2, K = 2 / (2 + 4) = 1/3, X = 0 + (9 - 0) / 3
+    filter.update(9.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.0f, filter.getValue());
+
+    for (int i = 0; i < 200; i++)
+    {
+        filter.update(9.0f);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 9.0f, filter.getValue());
+}
+
+// ************************ MPC ************************
+
+// plant the MPC is tested on, the same first order model it predicts with
+static float mpcPlant(float pressure, float command, float dt)
+{
+    return pressure + dt * (0.05f * (101325 - pressure) - 40 * command);
+}
+
+void test_mpc_respects_limits(void)
+{
+    static Mpc mpc;
+    float reference[MPC_HORIZON];
+    float command;
+
+    // far below what the pump can reach: flat out, every step of the plan on the upper bound
+    for (uint8_t k = 0; k < MPC_HORIZON; k++)
+    {
+        reference[k] = 30000;
+    }
+    TEST_ASSERT_TRUE(mpc.solve(100000, reference, 0.05f, 40, 101325, command));
+    TEST_ASSERT_EQUAL_FLOAT(100, command);
+    for (uint8_t k = 0; k < MPC_HORIZON; k++)
+    {
+        TEST_ASSERT_TRUE(mpc.getPlan()[k] >= 0 && mpc.getPlan()[k] <= 100);
+    }
+    TEST_ASSERT_TRUE(mpc.getIterations() <= MPC_MAX_ITERATIONS);
+
+    // above ambient the pump can't help, it stays off
+    for (uint8_t k = 0; k < MPC_HORIZON; k++)
+    {
+        reference[k] = 103000;
+    }
+    TEST_ASSERT_TRUE(mpc.solve(100000, reference, 0.05f, 40, 101325, command));
+    TEST_ASSERT_EQUAL_FLOAT(0, command);
+}
+
+static float mpcTrackRamp(bool lookahead)
+{
+    // 1 kPa/s descent starting after 2 s, sum of squared error over the run
+    static Mpc mpc;
+    mpc.reset();
+    float dt = 0.1f;
+    float pressure = 100000;
+    float error = 0;
+
+    for (int step = 0; step < 100; step++)
+    {
+        float reference[MPC_HORIZON];
+        for (uint8_t k = 0; k < MPC_HORIZON; k++)
+        {
+            float time = (step + (lookahead ? k + 1 : 0)) * dt;
+            reference[k] = 100000 - 1000 * max(0.0f, time - 2);
+        }
+
+        float command;
+        TEST_ASSERT_TRUE(mpc.solve(pressure, reference, 0.05f, 40, 101325, command));
+        TEST_ASSERT_TRUE(command >= 0 && command <= 100);
+
+        pressure = mpcPlant(pressure, command, dt);
+
+        float target = 100000 - 1000 * max(0.0f, (step + 1) * dt - 2);
+        error += (pressure - target) * (pressure - target);
+    }
+
+    return error;
+}
+
+void test_mpc_tracks_ramp_with_lookahead(void)
+{
+    float withLookahead = mpcTrackRamp(true);
+    float withoutLookahead = mpcTrackRamp(false);
+
+    // seeing the descent coming beats reacting to it
+    TEST_ASSERT_TRUE(withLookahead < withoutLookahead);
+    TEST_ASSERT_TRUE(sqrtf(withLookahead / 100) < 200); // rms error in Pa
+}
+
+// ************************ GAIN SCHEDULE ************************
+
+static const char *gainsCsv = "0.3, 0.03, 0.003, 90000\n"
+                              "0.1,0.01,0.001,30000\n"
+                              "\n"
+                              "0.2 ,0.02 ,0.002 ,60000\n";
+
+void test_gain_csv_parser_sorts_rows(void)
+{
+    static gainScheduleData gains;
+    Sd sd;
+
+    SD.nativeWriteFile("/CONTROL/gains.csv", gainsCsv);
+
+    TEST_ASSERT_TRUE(sd.loadGainsFromFile("/CONTROL/gains.csv", gains));
+    TEST_ASSERT_EQUAL(3, gains.height);
+
+    TEST_ASSERT_EQUAL_FLOAT(30000, gains.data[0][3]);
+    TEST_ASSERT_EQUAL_FLOAT(0.1f, gains.data[0][0]);
+    TEST_ASSERT_EQUAL_FLOAT(60000, gains.data[1][3]);
+    TEST_ASSERT_EQUAL_FLOAT(0.02f, gains.data[1][1]);
+    TEST_ASSERT_EQUAL_FLOAT(90000, gains.data[2][3]);
+    TEST_ASSERT_EQUAL_FLOAT(0.003f, gains.data[2][2]);
+
+    TEST_ASSERT_FALSE(sd.loadGainsFromFile("/CONTROL/missing.csv", gains));
+}
+
+void test_gain_schedule_compiled_cache(void)
+{
+    static gainScheduleData gains;
+    Sd sd;
+
+    SD.nativeWriteFile("/CONTROL/gains.csv", gainsCsv);
+
+    TEST_ASSERT_TRUE(sd.loadGainSchedule("/CONTROL/gains.csv", gains));
+    TEST_ASSERT_TRUE(SD.exists("/CONTROL/gains.gsb"));
+
+    // the second load comes from the compiled copy
+    std::string compiled = SD.nativeReadFile("/CONTROL/gains.gsb");
+    TEST_ASSERT_EQUAL(sizeof(gainScheduleHeader) + 3 * 4 * sizeof(float), compiled.size());
+
+    memset(&gains, 0, sizeof(gains));
+    TEST_ASSERT_TRUE(sd.loadGainSchedule("/CONTROL/gains.csv", gains));
+    TEST_ASSERT_EQUAL(3, gains.height);
+    TEST_ASSERT_EQUAL_FLOAT(90000, gains.data[2][3]);
+
+    // editing the CSV invalidates the compiled copy
+    SD.nativeWriteFile("/CONTROL/gains.csv", "0.5,0,0,50000\n");
+    TEST_ASSERT_TRUE(sd.loadGainSchedule("/CONTROL/gains.csv", gains));
+    TEST_ASSERT_EQUAL(1, gains.height);
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, gains.data[0][0]);
+
+    // a damaged compiled file is ignored
+    compiled = SD.nativeReadFile("/CONTROL/gains.gsb");
+    compiled[compiled.size() - 1] ^= 0xFF;
+    SD.nativeWriteFile("/CONTROL/gains.gsb", compiled);
+    TEST_ASSERT_TRUE(sd.loadGainSchedule("/CONTROL/gains.csv", gains));
+    TEST_ASSERT_EQUAL_FLOAT(50000, gains.data[0][3]);
+}
+
+// ************************ CONTROLLER ************************
+
+static void settleReading(Controller &controller, float pressure)
+{
+    // the BMP280 stand-in was at 101325 Pa during base calibration, so readings are absolute
+    nativeBmp280(0x76).pressure = pressure;
+    nativeBmp280(0x77).pressure = pressure;
+    for (int i = 0; i < 200; i++)
+    {
+        controller.updateReading();
+    }
+}
+
+void test_controller_update_gains(void)
+{
+    static Controller controller;
+    double Kp, Ki, Kd;
+
+    SD.nativeWriteFile("/CONTROL/gains.csv", gainsCsv);
+
+    TEST_ASSERT_TRUE(controller.initDevices());
+    TEST_ASSERT_TRUE(controller.initGainSchedule("/CONTROL/gains.csv"));
+
+    settleReading(controller, 25000);
+    TEST_ASSERT_TRUE(controller.updateGains());
+    controller.getGains(Kp, Ki, Kd);
+    TEST_ASSERT_EQUAL_FLOAT(0.1, Kp);
+
+    settleReading(controller, 59000);
+    controller.updateGains();
+    controller.getGains(Kp, Ki, Kd);
+    TEST_ASSERT_EQUAL_FLOAT(0.2, Kp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.02, Ki);
+
+    // above the highest row the last row is used
+    settleReading(controller, 100000);
+    controller.updateGains();
+    controller.getGains(Kp, Ki, Kd);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.3, Kp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.003, Kd);
+}
+
+// the line of a CSV file that starts with prefix has this many fields and none of them is empty
+static bool csvRowFilled(const std::string &text, const char *prefix, int fields)
+{
+    size_t start = text.find(std::string("\n") + prefix);
+    if (start == std::string::npos)
+    {
+        return false;
+    }
+    std::string row = text.substr(start + 1, text.find('\n', start + 1) - start - 1);
+
+    int count = 0;
+    size_t from = 0;
+    while (true)
+    {
+        size_t comma = row.find(',', from);
+        size_t end = (comma == std::string::npos) ? row.size() : comma;
+        if (end == from)
+        {
+            return false;
+        }
+        count++;
+        if (comma == std::string::npos)
+        {
+            return count == fields;
+        }
+        from = comma + 1;
+    }
+}
+
+void test_batch_runs_queue_back_to_back(void)
+{
+    static Controller controller;
+    static BatchRunner batch(controller);
+
+    SD.nativeWriteFile("/TRAJ/FLAT.CSV", "time,pressure\n0,101000\n1,100900\n2,100800\n");
+    SD.nativeWriteFile("/CONTROL/gains.csv", gainsCsv);
+    SD.nativeWriteFile(BATCH_MANIFEST, "trajectory, gains, alpha\n"
+                                       "/TRAJ/FLAT.CSV, , 0.5\n"
+                                       "# not run\n"
+                                       "/TRAJ/MISSING.CSV\n"
+                                       "\n"
+                                       "/TRAJ/FLAT.CSV, /CONTROL/gains.csv\n");
+
+    // calibrated away from sea level, readings are still reported against 101325
+    nativeBmp280(0x76).pressure = 98000;
+    nativeBmp280(0x77).pressure = 98000;
+    TEST_ASSERT_TRUE(controller.initDevices());
+    TEST_ASSERT_TRUE(batch.load());
+    TEST_ASSERT_EQUAL(3, batch.getNumRuns());
+    TEST_ASSERT_EQUAL_STRING("/CONTROL/gains.csv", batch.getRun(2).gains.c_str());
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, batch.getRun(0).alpha);
+    TEST_ASSERT_TRUE(batch.getRun(1).alpha < 0);
+
+    // the chamber is still down from an earlier run, nothing starts until it is back at base pressure
+    nativeBmp280(0x76).pressure = 92000;
+    nativeBmp280(0x77).pressure = 92000;
+    TEST_ASSERT_TRUE(batch.start());
+    unsigned long start = millis();
+    while (millis() - start < 3000)
+    {
+        TEST_ASSERT_TRUE(batch.service());
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(BATCH_SETTLING, batch.getState());
+
+    nativeBmp280(0x76).pressure = 98000;
+    nativeBmp280(0x77).pressure = 98000;
+    int ticks = 0;
+    while (batch.service() && ticks++ < 100000)
+    {
+        delay(1);
+    }
+
+    TEST_ASSERT_EQUAL(BATCH_DONE, batch.getState());
+    TEST_ASSERT_EQUAL(RUN_OK, batch.getRun(0).result);
+    TEST_ASSERT_EQUAL(RUN_SKIPPED, batch.getRun(1).result);
+    TEST_ASSERT_EQUAL(RUN_OK, batch.getRun(2).result);
+    TEST_ASSERT_TRUE(batch.getRun(0).summary.samples > 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2, batch.getRun(2).summary.duration);
+    TEST_ASSERT_FLOAT_WITHIN(50, 425, batch.getRun(0).summary.rmsError); // held at 101325 against 101000 to 100800
+
+    // a log for each run that started, one summary row per run
+    TEST_ASSERT_TRUE(SD.exists("/BATCH/RUN_0.CSV"));
+    TEST_ASSERT_TRUE(SD.exists("/BATCH/RUN_1.CSV"));
+    TEST_ASSERT_FALSE(SD.exists("/BATCH/RUN_2.CSV"));
+    TEST_ASSERT_TRUE(SD.exists("/BATCH/RUN_0.IDX"));
+
+    std::string summary = SD.nativeReadFile("/BATCH/SUMMARY_0.CSV");
+    TEST_ASSERT_EQUAL(4, std::count(summary.begin(), summary.end(), '\n'));
+    TEST_ASSERT_TRUE(summary.find("2,/TRAJ/MISSING.CSV,,-1.00,skipped") != std::string::npos);
+    TEST_ASSERT_TRUE(csvRowFilled(summary, "3,", 9));
+    TEST_ASSERT_FALSE(csvRowFilled(summary, "1,", 9)); // no gains file
+
+    // and the controller's own results table, one line per run that started
+    std::string results = SD.nativeReadFile(RUN_SUMMARY_PATH);
+    TEST_ASSERT_EQUAL(3, std::count(results.begin(), results.end(), '\n'));
+    TEST_ASSERT_TRUE(results.find("PID,completed,") != std::string::npos);
+    TEST_ASSERT_TRUE(csvRowFilled(results, "PID,completed,", 13));
+
+    // the profiler's times for the same runs
+    TEST_ASSERT_TRUE(controller.saveProfile());
+    std::string profile = SD.nativeReadFile("/PROFILE/prof_0.csv");
+    TEST_ASSERT_TRUE(csvRowFilled(profile, Profiler::getName(PROBE_ITERATE), 6));
+}
+
+void test_arena_scopes_release_and_track_high_water(void)
+{
+    static uint8_t buffer[sizeof(sim_data) + 4096];
+    Arena arena(buffer + 1, sizeof(buffer) - 1); // misaligned on purpose
+
+    // a session object at the bottom, zeroed like a member would be
+    sim_data *data = arena.create<sim_data>();
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)data % alignof(sim_data));
+    TEST_ASSERT_EQUAL(0, data->num_points);
+    size_t session = arena.getUsed();
+
+    // page buffers come and go above it
+    for (int page = 0; page < 3; page++)
+    {
+        ArenaScope scope(arena);
+        logPlotColumn *columns = arena.createArray<logPlotColumn>(200);
+        TEST_ASSERT_NOT_NULL(columns);
+        TEST_ASSERT_EQUAL(0, (uintptr_t)columns % alignof(logPlotColumn));
+        columns[199].maxPressure = 1;
+    }
+    TEST_ASSERT_EQUAL(session, arena.getUsed());
+    TEST_ASSERT_TRUE(arena.getHighWater() >= session + 200 * sizeof(logPlotColumn));
+    TEST_ASSERT_TRUE(arena.getHighWater() < session + 200 * sizeof(logPlotColumn) + 2 * ARENA_ALIGN);
+
+    // too big fails without disturbing what is there
+    {
+        ArenaScope scope(arena);
+        TEST_ASSERT_NULL(arena.createArray<logPlotColumn>(1000));
+        TEST_ASSERT_EQUAL(1, arena.getFailures());
+        TEST_ASSERT_EQUAL(session, arena.getUsed());
+    }
+
+    arena.reset();
+    TEST_ASSERT_EQUAL(0, arena.getUsed());
+}
+
+void test_fixed_string_truncates_in_place(void)
+{
+    FixedString<8> path("/RUNS");
+    path += '/';
+    path += "run";
+    TEST_ASSERT_EQUAL_STRING("/RUNS/ru", path.c_str());
+    TEST_ASSERT_TRUE(path.truncated());
+    TEST_ASSERT_EQUAL(8, path.length());
+
+    path = "/CALIB";
+    TEST_ASSERT_FALSE(path.truncated());
+    TEST_ASSERT_TRUE(path == "/CALIB");
+    TEST_ASSERT_TRUE((path + "/a").endsWith("B/a"));
+
+    TEST_ASSERT_EQUAL_STRING("/RUNS/RUN_0.IDX", withExtension("/RUNS/RUN_0.CSV", ".IDX").c_str());
+    TEST_ASSERT_EQUAL_STRING("/A.B/LOG.IDX", withExtension("/A.B/LOG", ".IDX").c_str());
+}
+
+void test_run_loop_makes_no_heap_operations(void)
+{
+    static Controller controller;
+
+    // long enough for the log buffer to flush and the trajectory to be refilled many times
+    std::string csv = "time,pressure\n";
+    for (int i = 0; i <= 400; i++)
+    {
+        char line[32];
+        snprintf(line, sizeof(line), "%.2f,%d\n", i * 0.05, 101000 - i);
+        csv += line;
+    }
+    SD.nativeWriteFile("/TRAJ/LONG.CSV", csv);
+    SD.nativeWriteFile("/CONTROL/gains.csv", gainsCsv);
+
+    TEST_ASSERT_TRUE(controller.initDevices());
+    TEST_ASSERT_TRUE(controller.loadTrajectory("/TRAJ/LONG.CSV"));
+    TEST_ASSERT_TRUE(controller.initGainSchedule());
+    TEST_ASSERT_TRUE(controller.initStream());
+    controller.initPID();
+
+    uint32_t before = HeapStats::getOperations();
+    TEST_ASSERT_TRUE(controller.run());
+
+    while (controller.iterate())
+    {
+        controller.serviceStream();
+        delay(1);
+    }
+
+    runSummary summary = controller.getRunSummary();
+    TEST_ASSERT_TRUE(controller.runCompleted());
+    TEST_ASSERT_GREATER_THAN(1000, summary.samples);
+    TEST_ASSERT_EQUAL(0, summary.heapOperations);
+
+#ifdef ENABLE_HEAP_STATS
+    // while opening the log did allocate, so the counter is live
+    TEST_ASSERT_GREATER_THAN(before, HeapStats::getOperations());
+#endif
+}
+
+void test_dir_index_caches_sorted_listing(void)
+{
+    dirIndex.invalidate();
+
+    // created out of order, more than a page and more than the old five file limit
+    for (int i = 299; i >= 0; i -= 3)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "/CONTROL/G%03d.CSV", i);
+        SD.nativeWriteFile(path, "x\n");
+    }
+    SD.nativeWriteFile("/CONTROL/gains.gsb", "x");
+    SD.mkdir("/CONTROL/OLD");
+
+    uint32_t scans = dirIndex.getScans();
+    TEST_ASSERT_TRUE(dirIndex.select("/control/", ".csv"));
+    TEST_ASSERT_EQUAL(100, dirIndex.getCount());
+    TEST_ASSERT_EQUAL_STRING("G002.CSV", dirIndex.getName(0));
+    TEST_ASSERT_EQUAL_STRING("G299.CSV", dirIndex.getName(99));
+    TEST_ASSERT_TRUE(dirIndex.contains("gains.gsb"));
+    TEST_ASSERT_FALSE(dirIndex.contains("OLD"));
+
+    // the second listing, and other extensions, come from RAM
+    uint32_t opens = SD.opens;
+    TEST_ASSERT_TRUE(dirIndex.select("/CONTROL", ".GSB"));
+    TEST_ASSERT_EQUAL(1, dirIndex.getCount());
+    TEST_ASSERT_TRUE(dirIndex.select("/CONTROL", ".CSV"));
+    TEST_ASSERT_EQUAL(opens, SD.opens);
+    TEST_ASSERT_EQUAL(scans + 1, dirIndex.getScans());
+
+    // a file written through Sd makes the next listing read the folder again, others stay cached
+    SD.nativeWriteFile("/TRAJ/FLAT.CSV", "x\n");
+    TEST_ASSERT_TRUE(dirIndex.select("/TRAJ", ".CSV"));
+    Sd sd;
+    TEST_ASSERT_TRUE(sd.appendLine("/CONTROL/A.CSV", "a", "1"));
+    TEST_ASSERT_TRUE(dirIndex.select("/CONTROL", ".CSV"));
+    TEST_ASSERT_EQUAL(101, dirIndex.getCount());
+    TEST_ASSERT_EQUAL_STRING("A.CSV", dirIndex.getName(0));
+    TEST_ASSERT_TRUE(dirIndex.select("/TRAJ", ".CSV"));
+    TEST_ASSERT_EQUAL(scans + 3, dirIndex.getScans());
+
+    // appending to it again doesn't change the listing
+    TEST_ASSERT_TRUE(sd.appendLine("/CONTROL/A.CSV", "a", "2"));
+    TEST_ASSERT_TRUE(dirIndex.select("/CONTROL", ".CSV"));
+    TEST_ASSERT_EQUAL(scans + 3, dirIndex.getScans());
+
+    // a missing folder isn't cached
+    TEST_ASSERT_FALSE(dirIndex.select("/NOPE", ".CSV"));
+    TEST_ASSERT_EQUAL(0, dirIndex.getCount());
+}
+
+void test_log_index_overview_and_zoom(void)
+{
+    // small buffer so blocks finish between flushes and while one is pending
+    Sd log(256);
+    TEST_ASSERT_TRUE(log.createIndexedFile("time, pressure, setpoint", "/LOGS/test", {0, 1, 2}));
+
+    // 10 Pa per line descent with one 80 kPa spike, setpoint 5 Pa above
+    for (int i = 0; i < 1000; i++)
+    {
+        float t = i * 0.01f;
+        float pressure = (i == 500) ? 80000 : 101325 - 10 * i;
+
+        char line[48];
+        snprintf(line, sizeof(line), "%.2f,%.1f,%.1f\n", t, pressure, pressure + 5);
+        TEST_ASSERT_TRUE(log.writeSample(line, t, pressure, pressure + 5));
+    }
+    log.closeFile();
+
+    TEST_ASSERT_EQUAL(sizeof(logIndexHeader) + 32 * sizeof(logIndexEntry), SD.nativeReadFile("/LOGS/test_0.IDX").size());
+
+    static LogIndex index;
+    TEST_ASSERT_TRUE(index.open("/LOGS/test_0.csv"));
+    TEST_ASSERT_EQUAL(32, index.getBlocks());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0, index.getStartTime());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 9.99f, index.getEndTime());
+    TEST_ASSERT_EQUAL_FLOAT(80000, index.getMinPressure());
+
+    // the whole run from the index alone
+    static logPlotColumn columns[320];
+    TEST_ASSERT_TRUE(index.plot(index.getStartTime(), index.getEndTime(), columns, 16));
+    TEST_ASSERT_EQUAL(0, index.getLinesRead());
+    TEST_ASSERT_EQUAL_FLOAT(101325, columns[0].maxPressure);
+    TEST_ASSERT_EQUAL_FLOAT(101330, columns[0].maxSetpoint);
+    TEST_ASSERT_EQUAL_FLOAT(80000, columns[8].minPressure);
+    TEST_ASSERT_EQUAL_FLOAT(101325 - 10 * 999, columns[15].minPressure);
+
+    // still only the index at full screen width, with fewer blocks than columns
+    TEST_ASSERT_TRUE(index.plot(index.getStartTime(), index.getEndTime(), columns, 320));
+    TEST_ASSERT_EQUAL(0, index.getLinesRead());
+    TEST_ASSERT_EQUAL_FLOAT(80000, columns[160].minPressure);
+
+    // a zoom reads only the blocks it shows, line by line
+    TEST_ASSERT_TRUE(index.plot(4.9f, 5.2f, columns, 320));
+    TEST_ASSERT_TRUE(index.getLinesRead() > 0);
+    TEST_ASSERT_TRUE(index.getLinesRead() <= 2 * LOG_INDEX_BLOCK);
+
+    float spikeMin = 1e9;
+    for (int x = 0; x < 320; x++)
+    {
+        if (columns[x].minPressure <= columns[x].maxPressure)
+        {
+            spikeMin = min(spikeMin, columns[x].minPressure);
+            TEST_ASSERT_TRUE(columns[x].maxPressure <= 101325 - 10 * 489);
+        }
+    }
+    TEST_ASSERT_EQUAL_FLOAT(80000, spikeMin);
+
+    index.close();
+}
+
+void test_log_index_skips_lines_with_empty_columns(void)
+{
+    // what a log looks like when the numbers didn't format: every 10th line is ",,,"
+    Sd log(256);
+    TEST_ASSERT_TRUE(log.createIndexedFile("time, pressure, setpoint", "/LOGS/empty", {0, 1, 2}));
+
+    for (int i = 0; i < 200; i++)
+    {
+        float t = i * 0.01f;
+        char line[48];
+        snprintf(line, sizeof(line), "%.2f,100000.0,100005.0\n", t);
+        TEST_ASSERT_TRUE(log.writeSample((i % 10 == 5) ? ",,,\n" : line, t, 100000, 100005));
+    }
+    log.closeFile();
+
+    static LogIndex index;
+    static logPlotColumn columns[320];
+    TEST_ASSERT_TRUE(index.open("/LOGS/empty_0.csv"));
+    TEST_ASSERT_TRUE(index.plot(0, 0.5f, columns, 320));
+    TEST_ASSERT_TRUE(index.getLinesRead() > 0);
+
+    for (int x = 0; x < 320; x++)
+    {
+        if (columns[x].minPressure <= columns[x].maxPressure)
+        {
+            TEST_ASSERT_EQUAL_FLOAT(100000, columns[x].minPressure);
+            TEST_ASSERT_EQUAL_FLOAT(100005, columns[x].minSetpoint);
+        }
+    }
+
+    index.close();
+}
+
+void test_run_metrics_streaming_summary(void)
+{
+    static RunMetrics metrics;
+    metrics.begin();
+
+    // 1 kPa/s descent to 90 kPa followed 200 ms late, ticks every 1 ms with every 50th taking 5 ms
+    uint32_t now = 0;
+    for (int i = 0; i < 20000; i++)
+    {
+        now += (i % 50 == 49) ? 5000 : 1000;
+        float t = now * 1e-6f;
+        float setpoint = max(90000.0f, 101325 - 1000 * t);
+        float pressure = max(90000.0f, 101325 - 1000 * max(0.0f, t - 0.2f));
+        float output = (t < 5) ? -100 : -40;
+
+        metrics.add(now, setpoint, pressure, output);
+    }
+
+    runSummary summary = metrics.getSummary();
+    TEST_ASSERT_EQUAL(20000, summary.samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.2f, summary.lag);
+    TEST_ASSERT_FLOAT_WITHIN(1, 200, summary.maxError);
+    TEST_ASSERT_TRUE(summary.rmsError > 100 && summary.rmsError < 200);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 0, summary.apogeeError); // both end at 90 kPa
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 5, summary.saturatedTime);
+
+    // percentiles to within a histogram bucket
+    TEST_ASSERT_UINT32_WITHIN(50, 1000, summary.loopP50Us);
+    TEST_ASSERT_TRUE(summary.loopP95Us < 1100);
+    TEST_ASSERT_EQUAL(5000, summary.loopP99Us);
+    TEST_ASSERT_EQUAL(5000, summary.loopMaxUs);
+}
+
+void test_device_manager_recovers_failed_device_only(void)
+{
+    static Sd sd;
+    static PressureSensor sensor;
+    static DeviceManager devices(sd, sensor);
+
+    TEST_ASSERT_TRUE(devices.begin());
+    TEST_ASSERT_EQUAL(2, sensor.getActiveSensors());
+
+    // later calls only probe, no second calibration
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(devices.begin());
+    TEST_ASSERT_LESS_THAN(BMP280_CONVERSION_US, micros() - start);
+
+    // card pulled: found by the next probe, the sensor is left alone
+    SD.present = false;
+    delay(DEVICE_PROBE_MS);
+    devices.service();
+    TEST_ASSERT_EQUAL(DEVICE_FAILED, devices.getSdState());
+    TEST_ASSERT_EQUAL(DEVICE_OK, devices.getSensorState());
+    TEST_ASSERT_FALSE(devices.ready());
+
+    // put back, picked up on a retry
+    SD.present = true;
+    devices.service();
+    TEST_ASSERT_FALSE(devices.sdReady());
+    delay(DEVICE_RETRY_MS);
+    devices.service();
+    TEST_ASSERT_TRUE(devices.ready());
+
+    // one BMP280 of the pair unplugged and back, the other keeps running throughout
+    nativeBmp280(0x77).present = false;
+    delay(DEVICE_PROBE_MS);
+    devices.service();
+    TEST_ASSERT_TRUE(devices.sensorReady());
+    TEST_ASSERT_EQUAL(1, sensor.getActiveSensors());
+
+    nativeBmp280(0x77).present = true;
+    delay(DEVICE_PROBE_MS);
+    devices.service();
+    TEST_ASSERT_EQUAL(2, sensor.getActiveSensors());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101325, sensor.getBasePressure());
+}
+
+void test_absent_sensor_retries_back_off_without_leaking(void)
+{
+    static Sd sd;
+    static PressureSensor sensor;
+    static DeviceManager devices(sd, sensor);
+
+    // single sensor rig, 0x77 isn't fitted
+    nativeBmp280(0x77).present = false;
+    TEST_ASSERT_TRUE(devices.begin());
+    TEST_ASSERT_EQUAL(1, sensor.getActiveSensors());
+
+    heapCounts before = HeapStats::getCounts();
+    uint32_t beginsBefore = nativeBmp280(0x77).begins;
+
+    // ten minutes of probes
+    for (int i = 0; i < 600; i++)
+    {
+        delay(DEVICE_PROBE_MS);
+        devices.service();
+    }
+
+    heapCounts after = HeapStats::getCounts();
+    TEST_ASSERT_EQUAL(after.allocations - before.allocations, after.frees - before.frees);
+
+    // 1, 2, 4 ... 32 s then once a minute
+    TEST_ASSERT_LESS_OR_EQUAL(16, nativeBmp280(0x77).begins - beginsBefore);
+    TEST_ASSERT_EQUAL(1, sensor.getActiveSensors());
+
+    // still picked up when it's plugged in
+    nativeBmp280(0x77).present = true;
+    delay(BMP280_RETRY_MAX_MS);
+    devices.service();
+    TEST_ASSERT_EQUAL(2, sensor.getActiveSensors());
+}
+
+// ************************ PUMP ************************
+
+void test_pump_fine_duty_and_write_on_change(void)
+{
+    static Pump pump;
+    uint32_t channel = STM_PIN_CHANNEL(pinmap_function(digitalPinToPinName(MOTOR_PWM), PinMap_PWM));
+    TIM_TypeDef *timer = (TIM_TypeDef *)pinmap_peripheral(digitalPinToPinName(MOTOR_PWM), PinMap_PWM);
+    uint32_t period = timer->ARR + 1;
+
+    TEST_ASSERT_EQUAL(NATIVE_TIMER_CLOCK / PUMP_PWM_FREQ, period);
+
+    pump.sendCommand(-37.5);
+    TEST_ASSERT_EQUAL(LOW, nativePinValue(MOTOR_DIR));
+    TEST_ASSERT_UINT32_WITHIN(1, period * 3 / 8, timer->CCR[channel - 1]);
+
+    // a twentieth of a percent still moves the output, the old driver only had whole percent steps
+    uint32_t compare = timer->CCR[channel - 1];
+    pump.sendCommand(-37.55);
+    TEST_ASSERT_TRUE(timer->CCR[channel - 1] > compare);
+    TEST_ASSERT_TRUE(timer->CCR[channel - 1] - compare < period / 200);
+
+    // the same command again doesn't touch the timer
+    uint32_t writes = timer->nativeCompareWrites;
+    for (int i = 0; i < 100; i++)
+    {
+        pump.sendCommand(-37.55);
+    }
+    TEST_ASSERT_EQUAL(writes, timer->nativeCompareWrites);
+
+    // slew limited ramp, stopping is immediate
+    pump.setSlewRate(100); // percent per second
+    delay(10);
+    pump.sendCommand(-100);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 38.55f, pump.getCommand().speed);
+    delay(100);
+    pump.sendCommand(-100);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 48.55f, pump.getCommand().speed);
+    pump.sendCommand(0);
+    TEST_ASSERT_EQUAL(0, timer->CCR[channel - 1]);
+    pump.setSlewRate(0);
+}
+
+void test_safety_interlock_stops_pump_from_interrupt(void)
+{
+    static Pump pump;
+    uint32_t channel = STM_PIN_CHANNEL(pinmap_function(digitalPinToPinName(MOTOR_PWM), PinMap_PWM));
+    TIM_TypeDef *timer = (TIM_TypeDef *)pinmap_peripheral(digitalPinToPinName(MOTOR_PWM), PinMap_PWM);
+    uint32_t period = 1000000 / SAFETY_CHECK_HZ;
+
+    TEST_ASSERT_TRUE(safetyMonitor.begin(pump));
+    safetyMonitor.clearTrip();
+    safetyMonitor.arm(26436, 102532);
+
+    // fed and in bounds: the pump keeps running and the watchdog is kept happy by the interrupt alone
+    pump.sendCommand(-50);
+    for (int i = 0; i < 20; i++)
+    {
+        safetyMonitor.feed(90000);
+        delay(10);
+    }
+    TEST_ASSERT_EQUAL(SAFETY_OK, safetyMonitor.getTrip());
+    TEST_ASSERT_TRUE(timer->CCR[channel - 1] > 0);
+    TEST_ASSERT_FALSE(IWatchdog.nativeExpired());
+
+    // the control loop stalls (blocked delay, slow flush): off within one check of the timeout, nothing else runs
+    delay(SAFETY_SAMPLE_TIMEOUT_MS + 2);
+    TEST_ASSERT_EQUAL(SAFETY_STALE, safetyMonitor.getTrip());
+    TEST_ASSERT_EQUAL(0, timer->CCR[channel - 1]);
+    TEST_ASSERT_TRUE(safetyMonitor.getTripLatencyMicros() <= period);
+    TEST_ASSERT_TRUE(safetyMonitor.getMaxCheckGapMicros() <= period);
+
+    // latched: later commands stay off until the trip is cleared
+    pump.sendCommand(-80);
+    TEST_ASSERT_EQUAL(0, timer->CCR[channel - 1]);
+    TEST_ASSERT_TRUE(pump.isInterlocked());
+
+    // out of bounds, caught on the next check
+    safetyMonitor.clearTrip();
+    safetyMonitor.arm(26436, 102532);
+    pump.sendCommand(-80);
+    TEST_ASSERT_TRUE(timer->CCR[channel - 1] > 0);
+    safetyMonitor.feed(20000);
+    delayMicroseconds(period);
+    TEST_ASSERT_EQUAL(SAFETY_LOW, safetyMonitor.getTrip());
+    TEST_ASSERT_EQUAL(0, timer->CCR[channel - 1]);
+    TEST_ASSERT_TRUE(safetyMonitor.getTripLatencyMicros() <= period);
+
+    // disarmed: no checks, but the watchdog is still reloaded
+    safetyMonitor.disarm();
+    safetyMonitor.clearTrip();
+    uint32_t reloads = IWatchdog.reloads;
+    delay(SAFETY_SAMPLE_TIMEOUT_MS * 2);
+    TEST_ASSERT_EQUAL(SAFETY_OK, safetyMonitor.getTrip());
+    TEST_ASSERT_TRUE(IWatchdog.reloads > reloads);
+    pump.sendCommand(0);
+}
+
+static float pumpFlow(float duty, float pressure)
+{
+    // dead band to 20 %, flow rising faster than linear above it and falling off with vacuum, like sim.py's f(P)
+    float drive = (duty > 20) ? powf((duty - 20) / 80, 1.5f) : 0;
+    return 2000 * drive * (1 - expf(-pressure / 30000));
+}
+
+void test_pump_curve_linearises_measured_flow(void)
+{
+    static PumpCurve curve;
+
+    // what calibration sees: pump flow minus a leak that grows with vacuum, rows above 60 kPa only
+    curve.beginMeasurement();
+    for (uint8_t row = 3; row < PUMP_CURVE_PRESSURES; row++)
+    {
+        float pressure = PumpCurve::rowPressure(row);
+        float leak = (101325 - pressure) * 0.01f;
+        for (uint8_t level = 0; level < PUMP_CURVE_COMMANDS; level++)
+        {
+            curve.addMeasurement(level, pressure + 1000, pumpFlow(PumpCurve::levelDuty(level), pressure) - leak);
+        }
+    }
+    TEST_ASSERT_TRUE(curve.build());
+    TEST_ASSERT_TRUE(curve.isMeasured());
+
+    // equal steps of command give equal steps of flow, 40 kPa uses the copied rows
+    const float pressures[] = {73000, 89000, 40000};
+    for (float pressure : pressures)
+    {
+        float full = pumpFlow(curve.apply(100, pressure), pressure);
+        for (int command = 10; command <= 100; command += 10)
+        {
+            float share = pumpFlow(curve.apply(command, pressure), pressure) / full;
+            TEST_ASSERT_FLOAT_WITHIN(0.05f, command / 100.0f, share); // uncorrected, 30 % would give 0.04
+        }
+    }
+
+    // off is off, the smallest command starts from the last duty level measured doing nothing
+    TEST_ASSERT_EQUAL_FLOAT(0, curve.apply(0, 80000));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, PumpCurve::levelDuty(1), curve.apply(0.1f, 80000));
+
+    // the model the MPC predicts with: leak pulls back to ambient at 1 %/s, full command gives the full effect
+    float leakRate, pumpGain;
+    curve.model(81000, leakRate, pumpGain);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.01f, leakRate);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, pumpFlow(curve.apply(100, 81000), 81000) / 100, pumpGain);
+
+    // stored and read back, a bad file is rejected
+    SD.mkdir("/CONTROL");
+    static Sd sd;
+    static PumpCurve loaded;
+    TEST_ASSERT_TRUE(sd.savePumpCurve(PUMP_CURVE_PATH, curve));
+    TEST_ASSERT_TRUE(sd.loadPumpCurve(PUMP_CURVE_PATH, loaded));
+    TEST_ASSERT_EQUAL_FLOAT(curve.apply(55, 81000), loaded.apply(55, 81000));
+
+    std::string bytes = SD.nativeReadFile(PUMP_CURVE_PATH);
+    bytes[sizeof(pumpCurveHeader) + 8] ^= 0x40;
+    SD.nativeWriteFile(PUMP_CURVE_PATH, bytes);
+    loaded.reset();
+    TEST_ASSERT_FALSE(sd.loadPumpCurve(PUMP_CURVE_PATH, loaded));
+    TEST_ASSERT_FALSE(loaded.isMeasured());
+    TEST_ASSERT_EQUAL_FLOAT(55, loaded.apply(55, 81000));
+}
+
+// ************************ PRESSURE SENSOR ************************
+
+void test_dual_bmp280_interleaved_and_fused(void)
+{
+    static PressureSensor sensor;
+
+    // the second sensor reads 150 Pa high
+    nativeBmp280(0x76).pressure = 101325;
+    nativeBmp280(0x77).pressure = 101475;
+
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76, 0x77));
+    TEST_ASSERT_EQUAL(2, sensor.getActiveSensors());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101400, sensor.getBasePressure());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, -75, sensor.getSensorOffset(0));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 75, sensor.getSensorOffset(1));
+
+    // both follow the same change once their offsets are removed, alternating sensors
+    nativeBmp280(0x76).pressure = 90000;
+    nativeBmp280(0x77).pressure = 90150;
+
+    uint32_t readsA = nativeBmp280(0x76).reads;
+    uint32_t readsB = nativeBmp280(0x77).reads;
+    unsigned long start = micros();
+
+    for (int i = 0; i < 20; i++)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, 90000, sensor.getPressure(true));
+    }
+
+    TEST_ASSERT_EQUAL(10, nativeBmp280(0x76).reads - readsA);
+    TEST_ASSERT_EQUAL(10, nativeBmp280(0x77).reads - readsB);
+    TEST_ASSERT_EQUAL(0, nativeBmp280(0x76).earlyReads + nativeBmp280(0x77).earlyReads);
+
+    // twice the rate of one sensor: 20 readings in about 10 conversion times
+    TEST_ASSERT_LESS_THAN(11 * BMP280_CONVERSION_US, micros() - start);
+}
+
+void test_dual_bmp280_dropout(void)
+{
+    static PressureSensor sensor;
+
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76, 0x77));
+
+    // 0x77 stops answering mid run, every call still returns a reading
+    nativeBmp280(0x77).present = false;
+    for (int i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(1.0f, 101325, sensor.getPressure(true));
+    }
+    TEST_ASSERT_EQUAL(1, sensor.getActiveSensors());
+    TEST_ASSERT_TRUE(sensor.testConnection());
+
+    nativeBmp280(0x76).present = false;
+    TEST_ASSERT_EQUAL_FLOAT(-1, sensor.getPressure(true));
+    TEST_ASSERT_EQUAL(0, sensor.getActiveSensors());
+    TEST_ASSERT_FALSE(sensor.testConnection());
+
+    // a board with only one sensor fitted still starts
+    nativeBmp280(0x76).present = true;
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76, 0x77));
+    TEST_ASSERT_EQUAL(1, sensor.getActiveSensors());
+}
+
+void test_base_pressure_tracks_ambient_drift(void)
+{
+    static PressureSensor sensor;
+
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101325, sensor.getBasePressure());
+
+    // weather moves ambient by 100 Pa, the estimate follows it
+    nativeBmp280(0x76).pressure = 101425;
+    for (int i = 0; i < 30 * BASE_TRACK_BLOCK; i++)
+    {
+        sensor.trackBasePressure();
+        delay(BASE_TRACK_INTERVAL_MS);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1, 101425, sensor.getBasePressure());
+
+    // a pumped down chamber or one still leaking back is ignored
+    nativeBmp280(0x76).pressure = 95000;
+    for (int i = 0; i < 5 * BASE_TRACK_BLOCK; i++)
+    {
+        TEST_ASSERT_FALSE(sensor.trackBasePressure());
+        delay(BASE_TRACK_INTERVAL_MS);
+    }
+    nativeBmp280(0x76).pressure = 101425;
+    nativeBmp280(0x76).noise = 200;
+    for (int i = 0; i < 5 * BASE_TRACK_BLOCK; i++)
+    {
+        TEST_ASSERT_FALSE(sensor.trackBasePressure());
+        delay(BASE_TRACK_INTERVAL_MS);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1, 101425, sensor.getBasePressure());
+}
+
+void test_base_pressure_check_at_run_start(void)
+{
+    static PressureSensor sensor;
+
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76));
+
+    // close to the estimate: one reading, no recalibration, and begin() again keeps it
+    nativeBmp280(0x76).pressure = 101425;
+    uint32_t reads = nativeBmp280(0x76).reads;
+    TEST_ASSERT_TRUE(sensor.checkBasePressure());
+    TEST_ASSERT_EQUAL(1, nativeBmp280(0x76).reads - reads);
+    TEST_ASSERT_TRUE(sensor.begin(0, 0, 0x76));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 101325, sensor.getBasePressure());
+
+    // far off: recalibrated
+    nativeBmp280(0x76).pressure = 100325;
+    TEST_ASSERT_TRUE(sensor.checkBasePressure());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 100325, sensor.getBasePressure());
+}
+
+void test_controller_restart_skips_calibration(void)
+{
+    static Controller controller;
+
+    TEST_ASSERT_TRUE(controller.initDevices());
+
+    // pressing START again only checks the cached base pressure
+    delay(AMBIENT_SETTLE_MS);
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(controller.initDevices());
+    TEST_ASSERT_LESS_THAN(2 * BMP280_CONVERSION_US, micros() - start);
+}
+
+void test_analog_sampler_decimates_on_timer(void)
+{
+    const uint32_t pin = 5;
+    nativeSetAnalogInput(pin, 2000);
+
+    TEST_ASSERT_TRUE(analogSampler.begin(pin, 4000, 16));
+    unsigned long start = micros();
+
+    // 16 conversions at 250 us make one sample, stamped in the middle of its block
+    TEST_ASSERT_TRUE(nativeFireTimer(TIM7, 15));
+    TEST_ASSERT_EQUAL(0, analogSampler.available());
+    nativeSetAnalogInput(pin, 2016);
+    TEST_ASSERT_TRUE(nativeFireTimer(TIM7, 1));
+    TEST_ASSERT_EQUAL(1, analogSampler.available());
+
+    analogSample sample;
+    TEST_ASSERT_TRUE(analogSampler.read(sample));
+    TEST_ASSERT_EQUAL_FLOAT(2001, sample.counts);
+    TEST_ASSERT_EQUAL(start + 250 + (15 * 250) / 2, sample.timeMicros);
+    TEST_ASSERT_FALSE(analogSampler.read(sample));
+
+    // ticks that land while the touch panel holds the ADC are skipped, not converted
+    AnalogSampler::lockAdc();
+    nativeFireTimer(TIM7, 8);
+    AnalogSampler::unlockAdc();
+    TEST_ASSERT_EQUAL(8, analogSampler.getSkipped());
+    TEST_ASSERT_EQUAL(0, analogSampler.available());
+
+    // a main loop that falls behind loses the oldest samples, the ring keeps the newest
+    nativeAdvanceMicros(40 * 16 * 250);
+    TEST_ASSERT_EQUAL(ANALOG_SAMPLER_RING - 1, analogSampler.available());
+    TEST_ASSERT_EQUAL(40 - (ANALOG_SAMPLER_RING - 1), analogSampler.getOverruns());
+    TEST_ASSERT_TRUE(analogSampler.read(sample));
+    TEST_ASSERT_GREATER_OR_EQUAL(micros() - ANALOG_SAMPLER_RING * 16 * 250, sample.timeMicros);
+
+    analogSampler.end();
+    TEST_ASSERT_FALSE(nativeFireTimer(TIM7, 1));
+}
+
+void test_analog_pressure_continuous(void)
+{
+    static PressureSensor sensor;
+    const uint32_t pin = 6;
+
+    // 1.5 V at 12 bits is 37.5 psi over the 0.5 V offset
+    nativeSetAnalogInput(pin, 1862);
+    TEST_ASSERT_TRUE(sensor.beginContinuous(pin, 4000, 16));
+    TEST_ASSERT_TRUE(analogSampler.isRunning());
+    TEST_ASSERT_FLOAT_WITHIN(50, 258553, sensor.getBasePressure());
+
+    // the reading is the mean of everything decimated since the last call
+    TEST_ASSERT_FLOAT_WITHIN(50, 0, sensor.getPressure(false));
+    nativeSetAnalogInput(pin, 1986);
+    nativeAdvanceMicros(10 * 16 * 250);
+    float expected = ((1986 * 3.3f / 4096) - 0.5f) * (75.0f / 2.0f) * 6894.76f - sensor.getBasePressure();
+    TEST_ASSERT_FLOAT_WITHIN(1, expected, sensor.getPressure(false));
+    TEST_ASSERT_EQUAL(0, analogSampler.available());
+    TEST_ASSERT_TRUE(micros() - sensor.getLastSampleMicros() < 16 * 250);
+
+    // nothing new yet, the last value holds
+    TEST_ASSERT_FLOAT_WITHIN(1, expected, sensor.getPressure(false));
+}
+
+// ************************ TRAJECTORY STREAM ************************
+
+void test_trajectory_stream_interpolates_across_chunks(void)
+{
+    static TrajectoryStream stream;
+
+    // 1000 points, 10 ms apart, pressure falls 1 Pa per point
+    std::string csv = "time,pressure\n";
+    for (int i = 0; i < 1000; i++)
+    {
+        char line[32];
+        snprintf(line, sizeof(line), "%.2f,%d\n", i * 0.01, 100000 - i);
+        csv += line;
+    }
+    SD.nativeWriteFile("/TRAJ/LONG.CSV", csv);
+
+    TEST_ASSERT_TRUE(stream.open("/TRAJ/LONG.CSV"));
+    TEST_ASSERT_EQUAL(1000, stream.getNumPoints());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 9.99f, stream.getDuration());
+    TEST_ASSERT_EQUAL_FLOAT(100000 - 999, stream.getMinPressure());
+
+    float pressure;
+    for (float t = 0; t < 9.98f; t += 0.0037f)
+    {
+        stream.prefetch();
+        TEST_ASSERT_TRUE(stream.sample(t, pressure));
+        TEST_ASSERT_FLOAT_WITHIN(0.05f, 100000 - t * 100, pressure);
+    }
+    TEST_ASSERT_EQUAL(0, stream.getUnderruns());
+
+    TEST_ASSERT_FALSE(stream.sample(10.5f, pressure));
+
+    // without prefetching the tick reads the card itself but stays correct
+    TEST_ASSERT_TRUE(stream.rewind());
+    TEST_ASSERT_TRUE(stream.sample(5.005f, pressure));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 100000 - 500.5f, pressure);
+    TEST_ASSERT_GREATER_THAN(0, stream.getUnderruns());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_altitude_to_pressure_reference);
+    RUN_TEST(test_pressure_altitude_round_trip);
+    RUN_TEST(test_simulation_reaches_apogee);
+    RUN_TEST(test_simulation_lazy_columns);
+    RUN_TEST(test_drag_model_reaches_apogee_smoothly);
+    RUN_TEST(test_models_fly_the_point_page_slider_range);
+    RUN_TEST(test_batch_altitude_to_pressure);
+    RUN_TEST(test_points_follow_the_curve_within_tolerance);
+    RUN_TEST(test_sim_cache_keeps_entries_loaded_before_the_card);
+    RUN_TEST(test_sample_pressure_interpolates);
+
+    RUN_TEST(test_pid_proportional);
+    RUN_TEST(test_pid_integral_and_limits);
+    RUN_TEST(test_pid_set_tunings);
+
+    RUN_TEST(test_kalman_update);
+
+    RUN_TEST(test_mpc_respects_limits);
+    RUN_TEST(test_mpc_tracks_ramp_with_lookahead);
+
+    RUN_TEST(test_gain_csv_parser_sorts_rows);
+    RUN_TEST(test_gain_schedule_compiled_cache);
+    RUN_TEST(test_controller_update_gains);
+    RUN_TEST(test_device_manager_recovers_failed_device_only);
+    RUN_TEST(test_absent_sensor_retries_back_off_without_leaking);
+    RUN_TEST(test_batch_runs_queue_back_to_back);
+    RUN_TEST(test_run_metrics_streaming_summary);
+    RUN_TEST(test_log_index_overview_and_zoom);
+    RUN_TEST(test_log_index_skips_lines_with_empty_columns);
+    RUN_TEST(test_dir_index_caches_sorted_listing);
+    RUN_TEST(test_arena_scopes_release_and_track_high_water);
+    RUN_TEST(test_fixed_string_truncates_in_place);
+    RUN_TEST(test_run_loop_makes_no_heap_operations);
+    RUN_TEST(test_pump_fine_duty_and_write_on_change);
+    RUN_TEST(test_safety_interlock_stops_pump_from_interrupt);
+    RUN_TEST(test_pump_curve_linearises_measured_flow);
+
+    RUN_TEST(test_dual_bmp280_interleaved_and_fused);
+    RUN_TEST(test_dual_bmp280_dropout);
+    RUN_TEST(test_base_pressure_tracks_ambient_drift);
+    RUN_TEST(test_base_pressure_check_at_run_start);
+    RUN_TEST(test_controller_restart_skips_calibration);
+    RUN_TEST(test_analog_sampler_decimates_on_timer);
+    RUN_TEST(test_analog_pressure_continuous);
+
+    RUN_TEST(test_trajectory_stream_interpolates_across_chunks);
+
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <Adafruit_BMP280.h>
+#include <NativePanel.h>
+
+#include "UI.h"
+
+// UI pages on the host framebuffer, `pio test -e native -f test_ui`. Each page is driven by a touch script and
+// reports what drawing it took; set NATIVE_SNAPSHOT_DIR to also save a PNG of every page while it is up.
+
+static UI ui;
+
+static const uint16_t BLACK = 0x0000;
+static const uint16_t WHITE = 0xFFFF;
+
+void setUp(void)
+{
+    SD.nativeReset();
+    nativeBmp280(0x76) = NativeBmp280Device();
+    nativeBmp280(0x77) = NativeBmp280Device();
+    nativePanel.nativeReset();
+}
+
+void tearDown(void)
+{
+}
+
+static void report(const char *page)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%-8s %7lu draw calls %8lu transactions %8lu pixels, worst frame %6lu / %7lu / %7lu (%lu frames)", page,
+             (unsigned long)nativePanel.total.drawCalls, (unsigned long)nativePanel.total.transactions,
+             (unsigned long)nativePanel.total.pixels, (unsigned long)nativePanel.maxFrame.drawCalls,
+             (unsigned long)nativePanel.maxFrame.transactions, (unsigned long)nativePanel.maxFrame.pixels,
+             (unsigned long)nativePanel.frames);
+    TEST_MESSAGE(line);
+}
+
+// saves the screen the first time the page polls the touch screen, once everything is drawn
+static void snapshotOnFirstPoll(const char *page)
+{
+    const char *dir = getenv("NATIVE_SNAPSHOT_DIR");
+    if (!dir)
+    {
+        return;
+    }
+
+    std::string path = std::string(dir) + "/" + page + ".png";
+    nativePanel.onPoll = [path]()
+    {
+        nativePanel.savePNG(path.c_str());
+        nativePanel.onPoll = nullptr;
+    };
+}
+
+void test_start_page_draws_and_clears(void)
+{
+    uint16_t buttonFill = 0;
+    nativePanel.onPoll = [&buttonFill]()
+    {
+        buttonFill = nativePanel.getPixel(70, 110); // inside CREATE, clear of its corners and label
+        nativePanel.onPoll = nullptr;
+    };
+
+    ui.begin();
+    nativePanel.tap(160, 150); // CREATE
+    ui.command();
+
+    report("START");
+    TEST_ASSERT_EQUAL_HEX16(WHITE, buttonFill);
+    TEST_ASSERT_GREATER_THAN(0, nativePanel.frames);
+
+    // five buttons, each a filled and an outlined round rectangle and a label, then the pressed one again
+    TEST_ASSERT_GREATER_OR_EQUAL(18, nativePanel.total.drawCalls);
+
+    // the page is cleared on the way out
+    TEST_ASSERT_EQUAL(NATIVE_PANEL_WIDTH * NATIVE_PANEL_HEIGHT, nativePanel.countPixels(BLACK));
+}
+
+void test_create_page_bitmap_is_drawn_pixel_by_pixel(void)
+{
+    ui.begin();
+    nativePanel.tap(160, 150); // START > CREATE
+    ui.command();
+
+    nativePanel.resetStats();
+    snapshotOnFirstPoll("create");
+    nativePanel.tap(20, 20); // back
+    ui.command();
+
+    report("CREATE");
+
+    // the background image is one draw call and an address window for every pixel
+    TEST_ASSERT_GREATER_OR_EQUAL(NATIVE_PANEL_WIDTH * NATIVE_PANEL_HEIGHT, nativePanel.total.transactions);
+    TEST_ASSERT_GREATER_OR_EQUAL(NATIVE_PANEL_WIDTH * NATIVE_PANEL_HEIGHT, nativePanel.maxFrame.transactions);
+}
+
+void test_point_page_slider_redraws_graph(void)
+{
+    ui.begin();
+    nativePanel.tap(160, 150); // START > CREATE
+    ui.command();
+    nativePanel.tap(80, 455); // CREATE > POINT
+    ui.command();
+
+    nativePanel.resetStats();
+    snapshotOnFirstPoll("point");
+
+    // the first frame is the page itself, then a slider drag redraws the graph
+    nativePanel.tap(200, 270, 1, 4); // apogee slider
+    nativePanel.tap(20, 20);         // back
+    ui.command();
+
+    report("POINT");
+    TEST_ASSERT_GREATER_OR_EQUAL(2, nativePanel.frames);
+
+    // the curve is drawn with drawLine() a segment per point, so a redraw takes many calls in one frame
+    TEST_ASSERT_GREATER_THAN(50, nativePanel.maxFrame.drawCalls);
+    TEST_ASSERT_GREATER_THAN(nativePanel.maxFrame.drawCalls, nativePanel.maxFrame.transactions);
+
+    nativePanel.tap(20, 20); // CREATE > START
+    ui.command();
+}
+
+void test_snapshots_are_valid_images(void)
+{
+    ui.begin();
+    nativePanel.tap(160, 150);
+    nativePanel.onPoll = []()
+    {
+        nativePanel.savePPM("test_ui_snapshot.ppm");
+        nativePanel.savePNG("test_ui_snapshot.png");
+        nativePanel.onPoll = nullptr;
+    };
+    ui.command();
+
+    FILE *ppm = fopen("test_ui_snapshot.ppm", "rb");
+    TEST_ASSERT_NOT_NULL(ppm);
+    char magic[16] = "";
+    int width = 0, height = 0, depth = 0;
+    TEST_ASSERT_EQUAL(4, fscanf(ppm, "%2s %d %d %d", magic, &width, &height, &depth));
+    TEST_ASSERT_EQUAL_STRING("P6", magic);
+    TEST_ASSERT_EQUAL(NATIVE_PANEL_WIDTH, width);
+    TEST_ASSERT_EQUAL(NATIVE_PANEL_HEIGHT, height);
+    fseek(ppm, 0, SEEK_END);
+    TEST_ASSERT_EQUAL(NATIVE_PANEL_WIDTH * NATIVE_PANEL_HEIGHT * 3 + 15, ftell(ppm)); // "P6\n320 480\n255\n"
+    fclose(ppm);
+
+    FILE *png = fopen("test_ui_snapshot.png", "rb");
+    TEST_ASSERT_NOT_NULL(png);
+    uint8_t signature[8];
+    TEST_ASSERT_EQUAL(8, fread(signature, 1, sizeof(signature), png));
+    TEST_ASSERT_EQUAL_HEX8(0x89, signature[0]);
+    TEST_ASSERT_EQUAL_HEX8('P', signature[1]);
+    fclose(png);
+
+    remove("test_ui_snapshot.ppm");
+    remove("test_ui_snapshot.png");
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_start_page_draws_and_clears);
+    RUN_TEST(test_create_page_bitmap_is_drawn_pixel_by_pixel);
+    RUN_TEST(test_point_page_slider_redraws_graph);
+    RUN_TEST(test_snapshots_are_valid_images);
+
+    return UNITY_END();
+}